@@ -0,0 +1,15 @@
+#ifndef __LOADER_AREAS_H__
+#define __LOADER_AREAS_H__
+
+#include <cstdint>
+
+// These look up the team's own areas in the area table the server keeps
+// for it, and fall back to the servercalls for anything not found there.
+int loader_area_for(void* address);
+int loader_get_area_info(int area, void* info);
+// Returns a file descriptor for the memory behind a shared area, received from the server.
+int loader_get_shared_area_fd(int area, bool writable);
+// Drops the parent team's area table.
+void loader_areas_child_atfork();
+
+#endif // __LOADER_AREAS_H__
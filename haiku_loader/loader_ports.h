@@ -0,0 +1,24 @@
+#ifndef __LOADER_PORTS_H__
+#define __LOADER_PORTS_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "haiku_port.h"
+
+// These go through the port's shared ring when possible,
+// and fall back to the equivalent servercalls otherwise.
+int loader_write_port_etc(int port, int32_t messageCode, const void* buffer,
+    size_t bufferSize, uint32_t flags, int64_t timeout);
+intptr_t loader_read_port_etc(int port, int32_t* messageCode, void* buffer,
+    size_t bufferSize, uint32_t flags, int64_t timeout);
+// Store each message behind a haiku_port_message_header.
+intptr_t loader_read_port_multiple_etc(int port, void* buffer, size_t bufferSize,
+    int maxCount, uint32_t flags, int64_t timeout);
+intptr_t loader_read_port_sized_etc(int port, void* buffer, size_t bufferSize,
+    uint32_t flags, int64_t timeout);
+int loader_get_port_message_info_etc(int port, haiku_port_message_info* info,
+    size_t infoSize, uint32_t flags, int64_t timeout);
+int loader_delete_port(int port);
+
+#endif // __LOADER_PORTS_H__
@@ -1,9 +1,16 @@
 #ifndef __LOADER_SEMAPHORE_H__
 #define __LOADER_SEMAPHORE_H__
 
+#include <cstdint>
+
 #include "BeDefs.h"
 #include "haiku_semaphore.h"
 
+// These take and return counts in the shared semaphore table when
+// nobody is waiting, and fall back to the servercalls otherwise.
+int loader_acquire_sem_etc(int id, uint32_t count, uint32_t flags, int64_t timeout);
+int loader_release_sem_etc(int id, uint32_t count, uint32_t flags);
+
 int loader_realtime_sem_open(const char *name, int openFlagsOrShared, haiku_mode_t mode,
     uint32_t semCount, haiku_sem_t* sem, haiku_sem_t** usedSem);
 
@@ -1,7 +1,41 @@
 #ifndef __LOADER_SERVERCALLS_H__
 #define __LOADER_SERVERCALLS_H__
 
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "servercalls.h"
+
 bool loader_init_servercalls();
+// Takes the file descriptor the server sent along with the last servercall
+// of this thread. Returns -1 if there is none.
+int loader_hserver_receive_fd();
+
+// Collects servercalls to be submitted together in a single round trip.
+// The calls run in order on the server. Memory passed to them must stay
+// valid until Submit returns. Store can be used to keep copies around.
+class ServercallBatch
+{
+private:
+    std::vector<intptr_t> _calls;
+    std::vector<intptr_t> _results;
+    std::deque<std::vector<char>> _storage;
+public:
+    size_t Add(servercall_id id, intptr_t a1 = 0, intptr_t a2 = 0, intptr_t a3 = 0,
+        intptr_t a4 = 0, intptr_t a5 = 0, intptr_t a6 = 0);
+
+    const void* Store(const void* data, size_t size);
+    template <typename T>
+    const T* Store(const T& value) { return (const T*)Store(&value, sizeof(T)); }
+
+    // Returns false if the batch as a whole could not be submitted.
+    bool Submit();
+
+    size_t GetCount() const { return _calls.size() / HYCLONE_SERVERCALL_BATCH_CALL_LENGTH; }
+    intptr_t GetResult(size_t index) const { return _results[index]; }
+};
 
 #define HYCLONE_SERVERCALL0(name) \
     intptr_t loader_hserver_call_##name();
@@ -28,5 +62,29 @@ bool loader_init_servercalls();
 #undef HYCLONE_SERVERCALL5
 #undef HYCLONE_SERVERCALL6
 
+#define HYCLONE_SERVERCALL0(name) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch);
+#define HYCLONE_SERVERCALL1(name, arg1) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1);
+#define HYCLONE_SERVERCALL2(name, arg1, arg2) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2);
+#define HYCLONE_SERVERCALL3(name, arg1, arg2, arg3) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3);
+#define HYCLONE_SERVERCALL4(name, arg1, arg2, arg3, arg4) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4);
+#define HYCLONE_SERVERCALL5(name, arg1, arg2, arg3, arg4, arg5) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4, arg5 a5);
+#define HYCLONE_SERVERCALL6(name, arg1, arg2, arg3, arg4, arg5, arg6) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4, arg5 a5, arg6 a6);
+
+#include "servercall_defs.h"
+
+#undef HYCLONE_SERVERCALL0
+#undef HYCLONE_SERVERCALL1
+#undef HYCLONE_SERVERCALL2
+#undef HYCLONE_SERVERCALL3
+#undef HYCLONE_SERVERCALL4
+#undef HYCLONE_SERVERCALL5
+#undef HYCLONE_SERVERCALL6
 
 #endif // __LOADER_SERVERCALLS_H__
\ No newline at end of file
@@ -41,4 +41,7 @@ extern int64_t get_max_procs();
 __attribute__((weak))
 extern int get_process_usage(int pid, int who, team_usage_info* info);
 
+__attribute__((weak))
+extern int get_memory_node();
+
 #endif // __LOADER_SYSINFO_H__
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef __LOADER_THREAD_BLOCK_H__
+#define __LOADER_THREAD_BLOCK_H__
+
+#include <cstdint>
+
+struct user_thread;
+
+// Sets up blocking for the calling thread, with the slot in the
+// thread wait table returned by the register_user_thread servercall.
+void loader_init_thread_block(user_thread* userThread, intptr_t waitSlot);
+// Forgets the threads of the parent team and sets up the calling thread again.
+void loader_thread_block_child_atfork();
+
+// These sleep and wake up threads of the same team in the thread wait
+// table, and fall back to the servercalls for threads of other teams.
+int loader_block_thread(uint32_t flags, int64_t timeout);
+int loader_unblock_thread(int thread, int status);
+
+#endif // __LOADER_THREAD_BLOCK_H__
@@ -7,6 +7,7 @@
 #include "haiku_tls.h"
 #include "loader_ids.h"
 #include "loader_servercalls.h"
+#include "loader_thread_block.h"
 #include "user_thread_defs.h"
 
 #include "loader_tls.h"
@@ -64,5 +65,5 @@ void loader_init_tls()
     sUserThread.defer_signals = 0;
     sUserThread.wait_status = 0;
     sUserThread.pending_signals = 0;
-    loader_hserver_call_register_user_thread(&sUserThread);
+    loader_init_thread_block(&sUserThread, loader_hserver_call_register_user_thread(&sUserThread));
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "area_table.h"
+#include "haiku_errors.h"
+#include "loader_areas.h"
+#include "loader_servercalls.h"
+#include "loader_vchroot.h"
+#include "servercalls.h"
+
+static std::mutex sAreaTableLock;
+static const area_table* sAreaTable = NULL;
+static bool sAreaTableRequested = false;
+
+static const area_table* loader_get_area_table()
+{
+    const area_table* table = __atomic_load_n(&sAreaTable, __ATOMIC_ACQUIRE);
+    if (table != NULL || __atomic_load_n(&sAreaTableRequested, __ATOMIC_ACQUIRE))
+    {
+        return table;
+    }
+
+    auto lock = std::unique_lock(sAreaTableLock);
+
+    if (sAreaTableRequested)
+    {
+        return sAreaTable;
+    }
+
+    intptr_t tableId = loader_hserver_call_get_area_table();
+    if (tableId >= 0)
+    {
+        auto path = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME /
+            (AREA_TABLE_FILE_PREFIX + std::to_string(tableId));
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            void* address = mmap(NULL, sizeof(area_table), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (address != MAP_FAILED)
+            {
+                __atomic_store_n(&sAreaTable, (const area_table*)address, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    // Do not ask again if the table is not available.
+    __atomic_store_n(&sAreaTableRequested, true, __ATOMIC_RELEASE);
+
+    return sAreaTable;
+}
+
+int loader_area_for(void* address)
+{
+    const area_table* table = loader_get_area_table();
+    haiku_area_info info;
+
+    if (table != NULL && area_table_find_address(table, address, info))
+    {
+        return info.area;
+    }
+
+    return loader_hserver_call_area_for(address);
+}
+
+// Copies to the team's memory like the server would, failing on bad addresses instead of crashing.
+static bool loader_copy_out(void* to, const void* from, size_t size)
+{
+    struct iovec local = { (void*)from, size };
+    struct iovec remote = { to, size };
+    return process_vm_writev(getpid(), &local, 1, &remote, 1, 0) == (ssize_t)size;
+}
+
+int loader_get_area_info(int area, void* info)
+{
+    const area_table* table = loader_get_area_table();
+    haiku_area_info areaInfo;
+
+    if (table != NULL && area_table_find_id(table, area, areaInfo))
+    {
+        return loader_copy_out(info, &areaInfo, sizeof(areaInfo)) ? B_OK : B_BAD_ADDRESS;
+    }
+
+    return loader_hserver_call_get_area_info(area, info);
+}
+
+int loader_get_shared_area_fd(int area, bool writable)
+{
+    intptr_t status = loader_hserver_call_send_shared_area_fd(area, writable);
+    if (status != B_OK)
+    {
+        return status;
+    }
+
+    int fd = loader_hserver_receive_fd();
+    return fd >= 0 ? fd : B_ERROR;
+}
+
+void loader_areas_child_atfork()
+{
+    // The child is still single threaded here.
+    if (sAreaTable != NULL)
+    {
+        munmap((void*)sAreaTable, sizeof(area_table));
+    }
+
+    sAreaTable = NULL;
+    sAreaTableRequested = false;
+    new (&sAreaTableLock) std::mutex();
+}
@@ -9,12 +9,14 @@
 #include "extended_commpage.h"
 #include "haiku_image.h"
 #include "haiku_tls.h"
+#include "loader_areas.h"
 #include "loader_debugger.h"
 #include "loader_exec.h"
 #include "loader_fork.h"
 #include "loader_idmap.h"
 #include "loader_lock.h"
 #include "loader_mutex.h"
+#include "loader_ports.h"
 #include "loader_protectedfd.h"
 #include "loader_pty.h"
 #include "loader_readdir.h"
@@ -26,6 +28,7 @@
 #include "loader_spawn_thread.h"
 #include "loader_sysinfo.h"
 #include "loader_systemtime.h"
+#include "loader_thread_block.h"
 #include "loader_tls.h"
 #include "loader_vchroot.h"
 #include "real_time_data.h"
@@ -78,6 +81,7 @@ void* loader_allocate_commpage()
     hostcalls_ptr->get_max_sems = get_max_sems;
     hostcalls_ptr->get_max_procs = get_max_procs;
     hostcalls_ptr->get_process_usage = get_process_usage;
+    hostcalls_ptr->get_memory_node = get_memory_node;
 
     hostcalls_ptr->lock_reserved_range_data = loader_lock_reserved_range_data;
     hostcalls_ptr->unlock_reserved_range_data = loader_unlock_reserved_range_data;
@@ -100,6 +104,9 @@ void* loader_allocate_commpage()
     hostcalls_ptr->idmap_get = loader_idmap_get;
     hostcalls_ptr->idmap_remove = loader_idmap_remove;
 
+    hostcalls_ptr->area_for = loader_area_for;
+    hostcalls_ptr->get_area_info = loader_get_area_info;
+    hostcalls_ptr->get_shared_area_fd = loader_get_shared_area_fd;
     hostcalls_ptr->fork = loader_fork;
     hostcalls_ptr->exec = loader_exec;
     hostcalls_ptr->spawn = loader_spawn;
@@ -107,11 +114,22 @@ void* loader_allocate_commpage()
     hostcalls_ptr->spawn_thread = loader_spawn_thread;
     hostcalls_ptr->exit_thread = loader_exit_thread;
     hostcalls_ptr->wait_for_thread = loader_wait_for_thread;
+    hostcalls_ptr->block_thread = loader_block_thread;
+    hostcalls_ptr->unblock_thread = loader_unblock_thread;
 
     hostcalls_ptr->mutex_lock = loader_mutex_lock;
     hostcalls_ptr->mutex_unblock = loader_mutex_unblock;
     hostcalls_ptr->mutex_switch_lock = loader_mutex_switch_lock;
 
+    hostcalls_ptr->write_port_etc = loader_write_port_etc;
+    hostcalls_ptr->read_port_etc = loader_read_port_etc;
+    hostcalls_ptr->get_port_message_info_etc = loader_get_port_message_info_etc;
+    hostcalls_ptr->read_port_multiple_etc = loader_read_port_multiple_etc;
+    hostcalls_ptr->read_port_sized_etc = loader_read_port_sized_etc;
+    hostcalls_ptr->delete_port = loader_delete_port;
+
+    hostcalls_ptr->acquire_sem_etc = loader_acquire_sem_etc;
+    hostcalls_ptr->release_sem_etc = loader_release_sem_etc;
     hostcalls_ptr->realtime_sem_open = loader_realtime_sem_open;
 
     hostcalls_ptr->get_sigrtmin = loader_get_sigrtmin;
@@ -8,9 +8,11 @@
 #include "haiku_area.h"
 #include "haiku_errors.h"
 #include "haiku_tls.h"
+#include "loader_areas.h"
 #include "loader_debugger.h"
 #include "loader_fork.h"
 #include "loader_servercalls.h"
+#include "loader_thread_block.h"
 #include "loader_tls.h"
 #include "loader_vchroot.h"
 #include "servercalls.h"
@@ -35,6 +37,8 @@ int loader_fork()
         // libroot's getpid() function depends on it.
         tls_set(TLS_THREAD_ID_SLOT, (void*)(uintptr_t)gettid());
         loader_hserver_child_atfork();
+        loader_thread_block_child_atfork();
+        loader_areas_child_atfork();
 
         // Fix areas
         ssize_t cookie = 0;
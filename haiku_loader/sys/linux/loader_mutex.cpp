@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "BeDefs.h"
+#include "haiku_errors.h"
+#include "loader_mutex.h"
+#include "loader_systemtime.h"
+#include "user_mutex_defs.h"
+
+// Logic based on https://xref.landonf.org/source/xref/haiku/src/system/kernel/locks/user_mutex.cpp
+//
+// Instead of a kernel side table, the threads waiting on a mutex are counted in
+// the mutex value itself, above the flags Haiku defines. Userland only sets and
+// clears those flags, so the counts survive, and the value goes back to the plain
+// flags once nobody waits. This also works for mutexes shared between teams.
+//
+// Unblocking a mutex turns waiters into grants. Any waiter may take a grant, and
+// taking one means the mutex has been handed over to it.
+
+static const int32_t kWaiterShift = 4;
+static const int32_t kGrantShift = 17;
+static const int32_t kCountMask = 0x1fff;
+static const int32_t kOneWaiter = 1 << kWaiterShift;
+static const int32_t kOneGrant = 1 << kGrantShift;
+
+static inline int32_t loader_mutex_waiters(int32_t value)
+{
+    return (value >> kWaiterShift) & kCountMask;
+}
+
+static inline int32_t loader_mutex_grants(int32_t value)
+{
+    return (value >> kGrantShift) & kCountMask;
+}
+
+static inline bool loader_mutex_cas(int32_t* mutex, int32_t& oldValue, int32_t newValue)
+{
+    return __atomic_compare_exchange_n(mutex, &oldValue, newValue, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline int loader_mutex_futex_op(int op, uint32_t flags)
+{
+    return (flags & B_USER_MUTEX_SHARED) ? op : (op | FUTEX_PRIVATE_FLAG);
+}
+
+static void loader_mutex_wake(int32_t* mutex, uint32_t flags, int count)
+{
+    syscall(SYS_futex, mutex, loader_mutex_futex_op(FUTEX_WAKE, flags), count, NULL, NULL, 0);
+}
+
+// Sleeps while the mutex holds value. Returns false once the timeout has passed.
+static bool loader_mutex_sleep(int32_t* mutex, int32_t value, uint32_t flags, int64_t deadline)
+{
+    struct timespec timeout;
+    struct timespec* timeoutPtr = NULL;
+    int op = FUTEX_WAIT_BITSET;
+
+    if (deadline != B_INFINITE_TIMEOUT)
+    {
+        if ((flags & B_ABSOLUTE_TIMEOUT) && (flags & B_TIMEOUT_REAL_TIME_BASE))
+        {
+            op |= FUTEX_CLOCK_REALTIME;
+        }
+        timeout.tv_sec = deadline / 1000000;
+        timeout.tv_nsec = (deadline % 1000000) * 1000;
+        timeoutPtr = &timeout;
+    }
+
+    return syscall(SYS_futex, mutex, loader_mutex_futex_op(op, flags), value, timeoutPtr,
+        NULL, FUTEX_BITSET_MATCH_ANY) == 0 || errno != ETIMEDOUT;
+}
+
+// Returns the deadline on the clock the flags ask for.
+static int64_t loader_mutex_deadline(uint32_t flags, int64_t timeout)
+{
+    if (timeout == B_INFINITE_TIMEOUT)
+    {
+        return B_INFINITE_TIMEOUT;
+    }
+
+    if (flags & B_RELATIVE_TIMEOUT)
+    {
+        int64_t now = loader_system_time();
+        return timeout > B_INFINITE_TIMEOUT - now ? B_INFINITE_TIMEOUT : now + std::max<int64_t>(timeout, 0);
+    }
+
+    if (flags & B_ABSOLUTE_TIMEOUT)
+    {
+        return std::max<int64_t>(timeout, 0);
+    }
+
+    return B_INFINITE_TIMEOUT;
+}
+
+// Takes the mutex if it is free and nobody is in line, otherwise gets in line.
+// Returns true if the mutex has been taken.
+static bool loader_mutex_enqueue(int32_t* mutex)
+{
+    int32_t oldValue = __atomic_load_n(mutex, __ATOMIC_ACQUIRE);
+    int32_t newValue;
+
+    while (true)
+    {
+        bool available = (oldValue & B_USER_MUTEX_DISABLED)
+            || (!(oldValue & B_USER_MUTEX_LOCKED)
+                && loader_mutex_waiters(oldValue) == 0 && loader_mutex_grants(oldValue) == 0);
+
+        if (available)
+        {
+            newValue = (oldValue | B_USER_MUTEX_LOCKED) & ~(int32_t)B_USER_MUTEX_WAITING;
+        }
+        else if (loader_mutex_waiters(oldValue) == kCountMask)
+        {
+            // Practically never happens, just wait for someone to leave.
+            sched_yield();
+            oldValue = __atomic_load_n(mutex, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        else
+        {
+            newValue = (oldValue | B_USER_MUTEX_LOCKED | B_USER_MUTEX_WAITING) + kOneWaiter;
+        }
+
+        if (loader_mutex_cas(mutex, oldValue, newValue))
+        {
+            return available;
+        }
+    }
+}
+
+// Waits in line until the mutex is handed over or the deadline has passed.
+static int loader_mutex_wait(int32_t* mutex, uint32_t flags, int64_t deadline)
+{
+    bool timedOut = false;
+    int32_t oldValue = __atomic_load_n(mutex, __ATOMIC_ACQUIRE);
+
+    while (true)
+    {
+        int32_t newValue;
+        int status;
+
+        if (loader_mutex_grants(oldValue) > 0)
+        {
+            newValue = oldValue - kOneGrant;
+            status = B_OK;
+        }
+        else if (timedOut || (oldValue & B_USER_MUTEX_DISABLED))
+        {
+            newValue = oldValue - kOneWaiter;
+            status = timedOut ? B_TIMED_OUT : B_OK;
+        }
+        else
+        {
+            timedOut = !loader_mutex_sleep(mutex, oldValue, flags, deadline);
+            oldValue = __atomic_load_n(mutex, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        if (loader_mutex_waiters(newValue) == 0 && loader_mutex_grants(newValue) == 0)
+        {
+            newValue &= ~(int32_t)B_USER_MUTEX_WAITING;
+        }
+
+        if (loader_mutex_cas(mutex, oldValue, newValue))
+        {
+            return status;
+        }
+    }
+}
+
+static void loader_mutex_unblock_internal(int32_t* mutex, uint32_t flags)
+{
+    int32_t oldValue = __atomic_load_n(mutex, __ATOMIC_ACQUIRE);
+    int32_t newValue;
+    int32_t granted;
+
+    do
+    {
+        int32_t waiters = loader_mutex_waiters(oldValue);
+
+        if (waiters == 0)
+        {
+            // no one is waiting -- clear locked flag
+            newValue = oldValue & ~(int32_t)B_USER_MUTEX_LOCKED;
+            if (loader_mutex_grants(oldValue) == 0)
+            {
+                newValue &= ~(int32_t)B_USER_MUTEX_WAITING;
+            }
+            granted = 0;
+            continue;
+        }
+
+        // Someone is waiting -- set the locked flag. It might still be set,
+        // but when using userland atomic operations, the caller will usually
+        // have cleared it already.
+        if ((flags & B_USER_MUTEX_UNBLOCK_ALL) || (oldValue & B_USER_MUTEX_DISABLED))
+        {
+            granted = waiters;
+        }
+        else
+        {
+            granted = 1;
+        }
+
+        newValue = (oldValue | B_USER_MUTEX_LOCKED) - granted * kOneWaiter + granted * kOneGrant;
+    }
+    while (!loader_mutex_cas(mutex, oldValue, newValue));
+
+    if (granted > 0)
+    {
+        // Waiters that have not gone to sleep yet notice the new value by themselves.
+        loader_mutex_wake(mutex, flags, granted);
+    }
+}
+
+static int loader_mutex_check(int32_t* mutex)
+{
+    if (mutex == NULL || ((intptr_t)mutex) % 4 != 0)
+    {
+        return B_BAD_ADDRESS;
+    }
+
+    return B_OK;
+}
+
+int loader_mutex_lock(int32_t* mutex, const char* name, uint32_t flags, int64_t timeout)
+{
+    int error = loader_mutex_check(mutex);
+    if (error != B_OK)
+    {
+        return error;
+    }
+
+    int64_t deadline = loader_mutex_deadline(flags, timeout);
+
+    if (loader_mutex_enqueue(mutex))
+    {
+        return B_OK;
+    }
+
+    return loader_mutex_wait(mutex, flags, deadline);
+}
+
+int loader_mutex_unblock(int32_t* mutex, uint32_t flags)
+{
+    int error = loader_mutex_check(mutex);
+    if (error != B_OK)
+    {
+        return error;
+    }
+
+    loader_mutex_unblock_internal(mutex, flags);
+
+    return B_OK;
+}
+
+int loader_mutex_switch_lock(int32_t* fromMutex, int32_t* toMutex,
+    const char* name, uint32_t flags, int64_t timeout)
+{
+    int error = loader_mutex_check(fromMutex);
+    if (error == B_OK)
+    {
+        error = loader_mutex_check(toMutex);
+    }
+    if (error != B_OK)
+    {
+        return error;
+    }
+
+    int64_t deadline = loader_mutex_deadline(flags, timeout);
+
+    // Get in line before unlocking the first mutex, so that
+    // whoever takes it next cannot unblock the second one without us.
+    bool locked = loader_mutex_enqueue(toMutex);
+
+    loader_mutex_unblock_internal(fromMutex, flags);
+
+    if (locked)
+    {
+        return B_OK;
+    }
+
+    return loader_mutex_wait(toMutex, flags, deadline);
+}
@@ -0,0 +1,550 @@
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <linux/futex.h>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "BeDefs.h"
+#include "haiku_errors.h"
+#include "loader_ports.h"
+#include "loader_servercalls.h"
+#include "loader_systemtime.h"
+#include "loader_vchroot.h"
+#include "port_ring.h"
+#include "servercalls.h"
+
+static const bool sUsePortRings = getenv("HYCLONE_NO_PORT_RING") == NULL;
+
+// Deleted rings are only noticed when they are used again,
+// so look for them once this many rings are mapped.
+static const size_t kPortRingSweepThreshold = 64;
+
+struct PortRingMapping
+{
+    port_ring* ring = NULL;
+    size_t size = 0;
+    // Read once when mapping, the shared header is not trusted afterwards.
+    int32_t capacity = 0;
+
+    ~PortRingMapping()
+    {
+        if (ring != NULL)
+        {
+            munmap(ring, size);
+        }
+    }
+};
+
+static std::shared_mutex sPortRingsLock;
+static std::unordered_map<int, std::shared_ptr<PortRingMapping>> sPortRings;
+
+static std::shared_ptr<PortRingMapping> loader_get_port_ring(int port)
+{
+    if (!sUsePortRings)
+    {
+        return NULL;
+    }
+
+    {
+        auto lock = std::shared_lock(sPortRingsLock);
+        auto it = sPortRings.find(port);
+        if (it != sPortRings.end())
+        {
+            return it->second;
+        }
+    }
+
+    intptr_t ringId = loader_hserver_call_get_port_ring(port);
+    if (ringId < 0)
+    {
+        return NULL;
+    }
+
+    auto path = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME /
+        (PORT_RING_FILE_PREFIX + std::to_string(ringId));
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    auto mapping = std::make_shared<PortRingMapping>();
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(port_ring))
+    {
+        void* address = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            mapping->ring = (port_ring*)address;
+            mapping->size = st.st_size;
+            mapping->capacity = mapping->ring->capacity;
+        }
+    }
+
+    close(fd);
+
+    if (mapping->ring == NULL || mapping->capacity <= 0
+        || port_ring_size(mapping->capacity) != mapping->size)
+    {
+        return NULL;
+    }
+
+    {
+        auto lock = std::unique_lock(sPortRingsLock);
+
+        if (sPortRings.size() >= kPortRingSweepThreshold)
+        {
+            std::erase_if(sPortRings, [](const auto& entry)
+            {
+                return __atomic_load_n(&entry.second->ring->flags, __ATOMIC_RELAXED) & PORT_RING_DELETED;
+            });
+        }
+
+        auto [it, inserted] = sPortRings.emplace(port, mapping);
+        return it->second;
+    }
+}
+
+static void loader_forget_port_ring(int port, const std::shared_ptr<PortRingMapping>& mapping)
+{
+    auto lock = std::unique_lock(sPortRingsLock);
+    auto it = sPortRings.find(port);
+    if (it != sPortRings.end() && it->second == mapping)
+    {
+        sPortRings.erase(it);
+    }
+}
+
+static int64_t loader_port_deadline(uint32_t flags, int64_t timeout)
+{
+    if (!(flags & B_TIMEOUT) || timeout == B_INFINITE_TIMEOUT)
+    {
+        return B_INFINITE_TIMEOUT;
+    }
+
+    int64_t now = loader_system_time();
+    if (timeout > B_INFINITE_TIMEOUT - now)
+    {
+        return B_INFINITE_TIMEOUT;
+    }
+
+    return now + timeout;
+}
+
+// Sleeps until sequence changes. Returns false once the deadline has passed.
+static bool loader_port_ring_wait(std::unique_lock<PortRingLock>& lock, uint32_t* sequence,
+    uint32_t* waiters, int64_t deadline)
+{
+    struct timespec timeout;
+    struct timespec* timeoutPtr = NULL;
+
+    if (deadline != B_INFINITE_TIMEOUT)
+    {
+        int64_t remaining = deadline - loader_system_time();
+        if (remaining <= 0)
+        {
+            return false;
+        }
+        timeout.tv_sec = remaining / 1000000;
+        timeout.tv_nsec = (remaining % 1000000) * 1000;
+        timeoutPtr = &timeout;
+    }
+
+    uint32_t value = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+    ++*waiters;
+    lock.unlock();
+
+    // The ring is shared with other processes, so FUTEX_PRIVATE_FLAG must not be used.
+    syscall(SYS_futex, sequence, FUTEX_WAIT, value, timeoutPtr, NULL, 0);
+
+    lock.lock();
+    --*waiters;
+
+    return true;
+}
+
+static void loader_port_ring_wake(uint32_t* sequence, int count)
+{
+    syscall(SYS_futex, sequence, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Waits for a message and returns its slot, with the ring locked.
+// Returns false if the call should go to the server instead.
+static bool loader_port_ring_wait_for_message(int port, const std::shared_ptr<PortRingMapping>& mapping,
+    std::unique_lock<PortRingLock>& lock, uint32_t flags, int64_t timeout,
+    port_ring_slot*& slot, status_t& status)
+{
+    port_ring* ring = mapping->ring;
+    int64_t deadline = loader_port_deadline(flags, timeout);
+
+    while (true)
+    {
+        if (ring->flags & PORT_RING_DELETED)
+        {
+            lock.unlock();
+            loader_forget_port_ring(port, mapping);
+            return false;
+        }
+
+        if (!port_ring_is_valid(ring, mapping->capacity))
+        {
+            return false;
+        }
+
+        if (ring->count > 0)
+        {
+            break;
+        }
+
+        if ((flags & B_TIMEOUT) && timeout == 0)
+        {
+            status = B_WOULD_BLOCK;
+            return true;
+        }
+
+        if (!loader_port_ring_wait(lock, &ring->readSequence, &ring->readWaiters, deadline))
+        {
+            status = B_TIMED_OUT;
+            return true;
+        }
+    }
+
+    slot = port_ring_slot_at(ring, mapping->capacity, ring->head);
+    if (!port_ring_slot_is_valid(slot))
+    {
+        return false;
+    }
+
+    status = B_OK;
+    return true;
+}
+
+static bool loader_port_ring_write(int port, const std::shared_ptr<PortRingMapping>& mapping,
+    int32_t messageCode, const void* buffer, size_t bufferSize, uint32_t flags, int64_t timeout,
+    status_t& status)
+{
+    port_ring* ring = mapping->ring;
+    int64_t deadline = loader_port_deadline(flags, timeout);
+
+    PortRingLock ringLock(ring, mapping->capacity);
+    std::unique_lock<PortRingLock> lock(ringLock);
+
+    while (true)
+    {
+        if (ring->flags & PORT_RING_DELETED)
+        {
+            lock.unlock();
+            loader_forget_port_ring(port, mapping);
+            return false;
+        }
+
+        if (ring->flags & PORT_RING_CLOSED)
+        {
+            status = B_BAD_PORT_ID;
+            return true;
+        }
+
+        if (!port_ring_is_valid(ring, mapping->capacity))
+        {
+            return false;
+        }
+
+        if (ring->count < mapping->capacity)
+        {
+            break;
+        }
+
+        if ((flags & B_TIMEOUT) && timeout == 0)
+        {
+            status = B_WOULD_BLOCK;
+            return true;
+        }
+
+        if (!loader_port_ring_wait(lock, &ring->writeSequence, &ring->writeWaiters, deadline))
+        {
+            status = B_TIMED_OUT;
+            return true;
+        }
+    }
+
+    port_ring_slot slot;
+    memset(&slot, 0, sizeof(slot));
+
+    // Messages that do not fit are kept by the server.
+    if (!port_ring_find_space(ring, bufferSize, slot.offset, slot.reserved))
+    {
+        return false;
+    }
+
+    memcpy(port_ring_data(ring, mapping->capacity) + slot.offset, buffer, bufferSize);
+
+    slot.code = messageCode;
+    slot.info.size = bufferSize;
+    slot.info.sender_team = getpid();
+
+    port_ring_commit_push(ring, mapping->capacity, slot);
+
+    bool wakeReaders = ring->readWaiters > 0;
+    lock.unlock();
+
+    if (wakeReaders)
+    {
+        // Peeking readers do not consume the message, so wake everyone.
+        loader_port_ring_wake(&ring->readSequence, INT_MAX);
+    }
+
+    status = B_OK;
+    return true;
+}
+
+static bool loader_port_ring_read(int port, const std::shared_ptr<PortRingMapping>& mapping,
+    int32_t* messageCode, void* buffer, size_t bufferSize, uint32_t flags, int64_t timeout,
+    intptr_t& result)
+{
+    port_ring* ring = mapping->ring;
+
+    PortRingLock ringLock(ring, mapping->capacity);
+    std::unique_lock<PortRingLock> lock(ringLock);
+
+    port_ring_slot* slot;
+    status_t status;
+    if (!loader_port_ring_wait_for_message(port, mapping, lock, flags, timeout, slot, status))
+    {
+        return false;
+    }
+
+    if (status != B_OK)
+    {
+        result = status;
+        return true;
+    }
+
+    if (slot->flags & PORT_RING_SLOT_EXTERNAL)
+    {
+        return false;
+    }
+
+    size_t readSize = std::min(slot->info.size, bufferSize);
+    memcpy(buffer, port_ring_data(ring, mapping->capacity) + slot->offset, readSize);
+    *messageCode = slot->code;
+
+    port_ring_commit_pop(ring, mapping->capacity);
+
+    bool wakeWriter = ring->writeWaiters > 0;
+    lock.unlock();
+
+    if (wakeWriter)
+    {
+        loader_port_ring_wake(&ring->writeSequence, 1);
+    }
+
+    result = readSize;
+    return true;
+}
+
+static bool loader_port_ring_read_multiple(int port, const std::shared_ptr<PortRingMapping>& mapping,
+    void* buffer, size_t bufferSize, int maxCount, uint32_t flags, int64_t timeout,
+    intptr_t& result, size_t& firstSize)
+{
+    port_ring* ring = mapping->ring;
+
+    PortRingLock ringLock(ring, mapping->capacity);
+    std::unique_lock<PortRingLock> lock(ringLock);
+
+    port_ring_slot* slot;
+    status_t status;
+    if (!loader_port_ring_wait_for_message(port, mapping, lock, flags, timeout, slot, status))
+    {
+        return false;
+    }
+
+    if (status != B_OK)
+    {
+        result = status;
+        return true;
+    }
+
+    // Messages kept by the server have to be read from there.
+    if (slot->flags & PORT_RING_SLOT_EXTERNAL)
+    {
+        return false;
+    }
+
+    firstSize = slot->info.size;
+
+    if (port_ring_record_end(0, slot->info.size) > bufferSize)
+    {
+        haiku_port_message_header header;
+        memset(&header, 0, sizeof(header));
+        header.code = slot->code;
+        header.sender_team = slot->info.sender_team;
+        header.size = slot->info.size;
+        memcpy(buffer, &header, sizeof(header));
+
+        result = B_BUFFER_OVERFLOW;
+        return true;
+    }
+
+    size_t offset = 0;
+    int count = 0;
+
+    while (count < maxCount && ring->count > 0)
+    {
+        slot = port_ring_slot_at(ring, mapping->capacity, ring->head);
+        if (!port_ring_slot_is_valid(slot) || (slot->flags & PORT_RING_SLOT_EXTERNAL)
+            || port_ring_record_end(offset, slot->info.size) > bufferSize)
+        {
+            break;
+        }
+
+        haiku_port_message_header header;
+        memset(&header, 0, sizeof(header));
+        header.code = slot->code;
+        header.sender_team = slot->info.sender_team;
+        header.size = slot->info.size;
+
+        char* record = (char*)buffer + offset;
+        memcpy(record, &header, sizeof(header));
+        memcpy(record + sizeof(header), port_ring_data(ring, mapping->capacity) + slot->offset,
+            header.size);
+
+        offset = port_ring_next_record(offset, header.size);
+        port_ring_commit_pop(ring, mapping->capacity);
+        ++count;
+    }
+
+    bool wakeWriters = ring->writeWaiters > 0;
+    lock.unlock();
+
+    if (wakeWriters)
+    {
+        loader_port_ring_wake(&ring->writeSequence, count);
+    }
+
+    result = count;
+    return true;
+}
+
+int loader_write_port_etc(int port, int32_t messageCode, const void* buffer,
+    size_t bufferSize, uint32_t flags, int64_t timeout)
+{
+    auto mapping = loader_get_port_ring(port);
+    status_t status;
+
+    if (mapping && loader_port_ring_write(port, mapping, messageCode, buffer, bufferSize,
+        flags, timeout, status))
+    {
+        return status;
+    }
+
+    return loader_hserver_call_write_port_etc(port, messageCode, buffer, bufferSize, flags, timeout);
+}
+
+intptr_t loader_read_port_etc(int port, int32_t* messageCode, void* buffer,
+    size_t bufferSize, uint32_t flags, int64_t timeout)
+{
+    // Let the server report bad addresses.
+    if (messageCode != NULL && (buffer != NULL || bufferSize == 0))
+    {
+        auto mapping = loader_get_port_ring(port);
+        intptr_t result;
+
+        if (mapping && loader_port_ring_read(port, mapping, messageCode, buffer, bufferSize,
+            flags, timeout, result))
+        {
+            return result;
+        }
+    }
+
+    return loader_hserver_call_read_port_etc(port, (int*)messageCode, buffer, bufferSize, flags, timeout);
+}
+
+intptr_t loader_read_port_multiple_etc(int port, void* buffer, size_t bufferSize,
+    int maxCount, uint32_t flags, int64_t timeout)
+{
+    // Let the server report bad arguments.
+    if (buffer != NULL && maxCount >= 1 && bufferSize >= sizeof(haiku_port_message_header))
+    {
+        auto mapping = loader_get_port_ring(port);
+        intptr_t result;
+        size_t firstSize;
+
+        if (mapping && loader_port_ring_read_multiple(port, mapping, buffer, bufferSize,
+            maxCount, flags, timeout, result, firstSize))
+        {
+            return result;
+        }
+    }
+
+    return loader_hserver_call_read_port_multiple_etc(port, buffer, bufferSize, maxCount, flags, timeout);
+}
+
+intptr_t loader_read_port_sized_etc(int port, void* buffer, size_t bufferSize,
+    uint32_t flags, int64_t timeout)
+{
+    if (buffer != NULL && bufferSize >= sizeof(haiku_port_message_header))
+    {
+        auto mapping = loader_get_port_ring(port);
+        intptr_t result;
+        size_t firstSize;
+
+        if (mapping && loader_port_ring_read_multiple(port, mapping, buffer, bufferSize,
+            1, flags, timeout, result, firstSize))
+        {
+            return result < 0 ? result : firstSize;
+        }
+    }
+
+    return loader_hserver_call_read_port_sized_etc(port, buffer, bufferSize, flags, timeout);
+}
+
+int loader_get_port_message_info_etc(int port, haiku_port_message_info* info,
+    size_t infoSize, uint32_t flags, int64_t timeout)
+{
+    if (info != NULL && infoSize == sizeof(haiku_port_message_info))
+    {
+        auto mapping = loader_get_port_ring(port);
+
+        if (mapping)
+        {
+            PortRingLock ringLock(mapping->ring, mapping->capacity);
+            std::unique_lock<PortRingLock> lock(ringLock);
+
+            port_ring_slot* slot;
+            status_t status;
+            if (loader_port_ring_wait_for_message(port, mapping, lock, flags, timeout, slot, status))
+            {
+                if (status == B_OK)
+                {
+                    *info = slot->info;
+                }
+                return status;
+            }
+        }
+    }
+
+    return loader_hserver_call_get_port_message_info_etc(port, info, infoSize, flags, timeout);
+}
+
+int loader_delete_port(int port)
+{
+    int status = loader_hserver_call_delete_port(port);
+
+    {
+        auto lock = std::unique_lock(sPortRingsLock);
+        sPortRings.erase(port);
+    }
+
+    return status;
+}
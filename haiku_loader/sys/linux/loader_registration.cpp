@@ -59,6 +59,7 @@ bool loader_register_process(int argc, char** args)
 
 bool loader_register_builtin_areas(user_space_program_args* args, void* commpage)
 {
+    ServercallBatch batch;
     haiku_area_info areaInfo;
     memset(&areaInfo, 0, sizeof(areaInfo));
     areaInfo.team = getpid();
@@ -67,16 +68,19 @@ bool loader_register_builtin_areas(user_space_program_args* args, void* commpage
     areaInfo.protection = B_READ_AREA | B_WRITE_AREA;
     areaInfo.lock = B_FULL_LOCK;
     strncpy(areaInfo.name, "commpage", sizeof(areaInfo.name));
-    if (loader_hserver_call_register_area(&areaInfo, REGION_PRIVATE_MAP) < 0)
-        return false;
+    loader_hserver_batch_register_area(batch, (void*)batch.Store(areaInfo), REGION_PRIVATE_MAP);
 
     // Get pthread stack address and size
     pthread_attr_t attr;
     if (pthread_getattr_np(pthread_self(), &attr) == -1)
+    {
+        batch.Submit();
         return false;
+    }
     if (pthread_attr_getstack(&attr, &areaInfo.address, &areaInfo.size) == -1)
     {
         pthread_attr_destroy(&attr);
+        batch.Submit();
         return false;
     }
     pthread_attr_destroy(&attr);
@@ -87,12 +91,14 @@ bool loader_register_builtin_areas(user_space_program_args* args, void* commpage
         std::string areaName = std::filesystem::path(*args->args).filename().string() + "_" + std::to_string(getpid()) + "_stack";
         strncpy(areaInfo.name, areaName.c_str(), sizeof(areaInfo.name));
     }
-    if (loader_hserver_call_register_area(&areaInfo, REGION_PRIVATE_MAP) < 0)
-        return false;
+    loader_hserver_batch_register_area(batch, (void*)batch.Store(areaInfo), REGION_PRIVATE_MAP);
 
     std::ifstream fin("/proc/self/maps");
     if (!fin.is_open())
+    {
+        batch.Submit();
         return false;
+    }
     std::string line;
     std::vector<std::tuple<uintptr_t, uintptr_t, bool>> regions;
     while (getline(fin, line))
@@ -142,8 +148,7 @@ bool loader_register_builtin_areas(user_space_program_args* args, void* commpage
         areaInfo.lock = 0;
         std::string areaName = std::string("runtime_loader_seg") + std::to_string(i) + (isWritable ? "rw" : "ro");
         strncpy(areaInfo.name, areaName.c_str(), sizeof(areaInfo.name));
-        if (loader_hserver_call_register_area(&areaInfo, REGION_PRIVATE_MAP) < 0)
-            return false;
+        loader_hserver_batch_register_area(batch, (void*)batch.Store(areaInfo), REGION_PRIVATE_MAP);
     }
 
     // TODO: On real Haiku systems, the arguments are stored on the stack instead
@@ -159,10 +164,17 @@ bool loader_register_builtin_areas(user_space_program_args* args, void* commpage
     areaInfo.protection = B_READ_AREA | B_WRITE_AREA;
     areaInfo.lock = 0;
     strncpy(areaInfo.name, "program args", sizeof(areaInfo.name));
+    loader_hserver_batch_register_area(batch, (void*)batch.Store(areaInfo), REGION_PRIVATE_MAP);
 
-    if (loader_hserver_call_register_area(&areaInfo, REGION_PRIVATE_MAP) < 0)
+    if (!batch.Submit())
         return false;
 
+    for (size_t i = 0; i < batch.GetCount(); ++i)
+    {
+        if (batch.GetResult(i) < 0)
+            return false;
+    }
+
     // Still missing a certain "user area" area of size 16384.
     // Haiku uses it to store internal kernel stuff.
     // We might be able to use such an area for our "extended commpage".
@@ -188,13 +200,20 @@ bool loader_register_existing_fds()
     char path[PATH_MAX];
     char resolvedPath[PATH_MAX];
 
-    for (int fd = 0; fd <= STDERR_FILENO; ++fd)
+    ServercallBatch batch;
+
+    const auto registerFd = [&](int fd)
     {
-        snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, fd);
         loader_vchroot_unexpand(path, resolvedPath, sizeof(resolvedPath));
+        size_t resolvedPathLength = strnlen(resolvedPath, sizeof(resolvedPath));
+        loader_hserver_batch_register_fd(batch, fd, HAIKU_AT_FDCWD,
+            (const char*)batch.Store(resolvedPath, resolvedPathLength), resolvedPathLength, false);
+    };
 
-        if (loader_hserver_call_register_fd(fd, HAIKU_AT_FDCWD, resolvedPath, sizeof(resolvedPath), false) < 0)
-            return false;
+    for (int fd = 0; fd <= STDERR_FILENO; ++fd)
+    {
+        snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, fd);
+        registerFd(fd);
     }
 
     struct dirent* entry;
@@ -222,9 +241,15 @@ bool loader_register_existing_fds()
             snprintf(path, sizeof(path), "/proc/%d/fd/%s", pid, entry->d_name);
         }
 
-        loader_vchroot_unexpand(path, resolvedPath, sizeof(resolvedPath));
+        registerFd(fd);
+    }
+
+    if (!batch.Submit())
+        return false;
 
-        if (loader_hserver_call_register_fd(fd, HAIKU_AT_FDCWD, resolvedPath, sizeof(resolvedPath), false) < 0)
+    for (size_t i = 0; i < batch.GetCount(); ++i)
+    {
+        if (batch.GetResult(i) < 0)
             return false;
     }
 
@@ -247,12 +272,24 @@ bool loader_register_groups()
         return false;
     }
 
+    ServercallBatch batch;
+
+    for (const auto& hostGid : gids)
+    {
+        loader_hserver_batch_gid_for(batch, hostGid);
+    }
+
+    if (!batch.Submit())
+    {
+        return false;
+    }
+
     std::vector<haiku_gid_t> gidsToRegister;
     gidsToRegister.reserve(gidCount);
 
-    for (const auto& hostGid : gids)
+    for (size_t i = 0; i < batch.GetCount(); ++i)
     {
-        gidsToRegister.push_back(loader_hserver_call_gid_for(hostGid));
+        gidsToRegister.push_back(batch.GetResult(i));
     }
 
     if (loader_hserver_call_setgroups(gidsToRegister.size(), (int*)gidsToRegister.data(), NULL) < 0)
@@ -34,6 +34,7 @@ private:
 
     bool _Send(const void* data, size_t size);
     bool _Receive(void* data, size_t size);
+    bool _ReceiveReply(intptr_t& result);
 public:
     RequestContext();
     ~RequestContext();
@@ -69,7 +70,7 @@ RequestContext::RequestContext()
         throw std::system_error(errno, std::generic_category(), "failed to connect to hyclone");
     }
 
-    intptr_t serverArgs[HYCLONE_SERVERCALL_MAX_ARGS + 1] =
+    intptr_t serverArgs[HYCLONE_SERVERCALL_FRAME_LENGTH] =
         { SERVERCALL_ID_request_ack, getpid(), gettid() };
     intptr_t returnCode = -1;
 
@@ -78,7 +79,7 @@ RequestContext::RequestContext()
         throw std::system_error(errno, std::generic_category(), "failed to send request ack");
     }
 
-    if (!_Receive(&returnCode, sizeof(returnCode)))
+    if (!_ReceiveReply(returnCode))
     {
         throw std::system_error(errno, std::generic_category(), "failed to receive request ack");
     }
@@ -98,7 +99,7 @@ RequestContext::RequestContext()
         throw std::system_error(errno, std::generic_category(), "failed to send request read");
     }
 
-    if (!_Receive(&returnCode, sizeof(returnCode)))
+    if (!_ReceiveReply(returnCode))
     {
         throw std::system_error(errno, std::generic_category(), "failed to receive request read");
     }
@@ -120,7 +121,7 @@ RequestContext::~RequestContext()
 
     if (_socket != -1)
     {
-        intptr_t serverArgs[HYCLONE_SERVERCALL_MAX_ARGS + 1] =
+        intptr_t serverArgs[HYCLONE_SERVERCALL_FRAME_LENGTH] =
             { SERVERCALL_ID_disconnect };
 
         _Send(serverArgs, sizeof(serverArgs));
@@ -135,7 +136,7 @@ bool RequestContext::Reply(intptr_t result)
         return false;
     }
 
-    intptr_t serverArgs[HYCLONE_SERVERCALL_MAX_ARGS + 1] =
+    intptr_t serverArgs[HYCLONE_SERVERCALL_FRAME_LENGTH] =
         { SERVERCALL_ID_request_reply, result };
     intptr_t returnCode = -1;
 
@@ -144,7 +145,7 @@ bool RequestContext::Reply(intptr_t result)
         return false;
     }
 
-    if (!_Receive(&returnCode, sizeof(returnCode)))
+    if (!_ReceiveReply(returnCode))
     {
         return false;
     }
@@ -188,9 +189,29 @@ bool RequestContext::_Receive(void* data, size_t size)
     return true;
 }
 
+bool RequestContext::_ReceiveReply(intptr_t& result)
+{
+    intptr_t reply[HYCLONE_SERVERCALL_REPLY_LENGTH];
+    if (!_Receive(reply, sizeof(reply)))
+    {
+        return false;
+    }
+
+    // Request servercalls never carry inline payloads.
+    if (reply[1] != 0)
+    {
+        return false;
+    }
+
+    result = reply[0];
+    return true;
+}
+
+struct servercall_channel;
 struct ServerConnection
 {
     int _socket;
+    servercall_channel* _channel;
 };
 extern thread_local ServerConnection gServerConnection;
 
@@ -199,7 +220,10 @@ static void loader_handle_request(int sig, siginfo_t* info, void* context)
     RequestContext requestContext;
 
     int oldSocket = gServerConnection._socket;
+    servercall_channel* oldChannel = gServerConnection._channel;
     gServerConnection._socket = requestContext.Socket();
+    // The interrupted thread may be in the middle of a channel call.
+    gServerConnection._channel = NULL;
 
     switch (requestContext.RequestId())
     {
@@ -212,4 +236,5 @@ static void loader_handle_request(int sig, siginfo_t* info, void* context)
     }
 
     gServerConnection._socket = oldSocket;
+    gServerConnection._channel = oldChannel;
 }
\ No newline at end of file
@@ -1,10 +1,19 @@
 #include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
 #include <mutex>
 #include <semaphore.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <unordered_map>
 
 #include "haiku_errors.h"
+#include "haiku_sem.h"
 #include "loader_semaphore.h"
+#include "loader_servercalls.h"
+#include "loader_vchroot.h"
+#include "sem_table.h"
+#include "servercalls.h"
 
 std::mutex gSemaphoresMutex;
 std::unordered_map<sem_t *, haiku_sem_t*> gSemaphores;
@@ -32,3 +41,71 @@ int loader_realtime_sem_open(const char *name, int openFlagsOrShared, haiku_mode
 
     return 0;
 }
+
+static uint64_t* loader_get_sem_state(int id)
+{
+    static uint64_t* sTable = []() -> uint64_t*
+    {
+        auto path = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME / HYCLONE_SEM_TABLE_NAME;
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return NULL;
+        }
+
+        void* address = mmap(NULL, sizeof(uint64_t) * HYCLONE_SEM_TABLE_SIZE,
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        return address == MAP_FAILED ? NULL : (uint64_t*)address;
+    }();
+
+    if (sTable == NULL || id < 0 || id >= HYCLONE_SEM_TABLE_SIZE)
+    {
+        return NULL;
+    }
+
+    return &sTable[id];
+}
+
+int loader_acquire_sem_etc(int id, uint32_t count, uint32_t flags, int64_t timeout)
+{
+    uint64_t* state = loader_get_sem_state(id);
+
+    // Anything the server would reject goes to the server.
+    if (state != NULL && count >= 1 && count <= INT32_MAX
+        && !(flags & ~(B_CAN_INTERRUPT | B_KILL_CAN_INTERRUPT | B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+        && (flags & (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT)) != (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+    {
+        if (sem_state_try_acquire(state, count))
+        {
+            return B_OK;
+        }
+
+        if ((flags & B_RELATIVE_TIMEOUT) && timeout <= 0)
+        {
+            uint64_t currentState = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+            if ((currentState & SEM_STATE_VALID) && sem_state_count(currentState) < (int32_t)count)
+            {
+                return B_WOULD_BLOCK;
+            }
+        }
+    }
+
+    return loader_hserver_call_acquire_sem_etc(id, count, flags, timeout);
+}
+
+int loader_release_sem_etc(int id, uint32_t count, uint32_t flags)
+{
+    uint64_t* state = loader_get_sem_state(id);
+
+    if (state != NULL && count >= 1 && count <= INT32_MAX && !(flags & ~B_DO_NOT_RESCHEDULE))
+    {
+        if (sem_state_try_release(state, count))
+        {
+            return B_OK;
+        }
+    }
+
+    return loader_hserver_call_release_sem_etc(id, count, flags);
+}
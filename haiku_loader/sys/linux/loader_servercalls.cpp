@@ -1,31 +1,57 @@
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
+#include <linux/futex.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdexcept>
 #include <string>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "haiku_area.h"
 #include "haiku_errors.h"
+#include "haiku_fs_info.h"
+#include "haiku_port.h"
+#include "haiku_stat.h"
+#include "haiku_team.h"
+#include "haiku_thread.h"
 #include "loader_protectedfd.h"
 #include "loader_servercalls.h"
 #include "loader_vchroot.h"
+#include "servercall_channel.h"
 #include "servercalls.h"
 
 static std::atomic<int> sMinProtectedFd = sysconf(_SC_OPEN_MAX);
+static const bool sUseServercallChannel = getenv("HYCLONE_NO_SERVERCALL_CHANNEL") == NULL;
+
+// How long to wait for a channel servercall before checking
+// whether the server is still alive.
+static const long kChannelLivenessIntervalSeconds = 1;
 
 class ServerConnection
 {
 private:
+    // Keep these two first. loader_requests.cpp temporarily swaps them
+    // while serving a server request.
     int _socket;
+    servercall_channel* _channel;
     struct sockaddr_un _addr;
-
+    // A file descriptor sent by the server, not taken yet.
+    int _receivedFd = -1;
+
+    void _AttachChannel();
+    // Unless abandoned, waits for an outstanding one-way call to complete first.
+    void _DetachChannel(bool abandon = false);
+    // If interruptible, signals that interrupt the wait are passed on to the server.
+    uint32_t _WaitChannel(bool interruptible = false);
 public:
     ServerConnection();
     ~ServerConnection();
@@ -36,11 +62,69 @@ public:
     bool IsConnected() const { return _socket != -1; }
     bool Send(const void* data, size_t size);
     bool Receive(void* data, size_t size);
+    // Takes the file descriptor the server sent along with the last call. Returns -1 if there is none.
+    int ReceiveFd();
+
+    // Performs a servercall, through the shared memory channel if there is one.
+    // frame holds the call id, arguments and payload size. The reply payload is
+    // stored in reply, which must hold HYCLONE_SERVERCALL_MAX_PAYLOAD bytes.
+    // One-way calls return as soon as they have been submitted, with a result of 0.
+    // Returns false if the connection has been lost.
+    bool Call(const intptr_t* frame, const void* payload, intptr_t& result,
+        void* reply, size_t& replySize);
+private:
+    bool _SocketCall(const intptr_t* frame, const void* payload, intptr_t& result,
+        void* reply, size_t& replySize);
+    bool _ChannelCall(const intptr_t* frame, const void* payload, intptr_t& result,
+        void* reply, size_t& replySize);
 };
 
+// Reads from a socket like read, also returning a file descriptor sent along, or -1.
+static ssize_t loader_receive_with_fd(int socket, void* data, size_t size, int& fd)
+{
+    struct iovec iov = { data, size };
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    fd = -1;
+
+    ssize_t ret = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+        && header->cmsg_len == CMSG_LEN(sizeof(int)))
+    {
+        memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    }
+
+    return ret;
+}
+
+// Calls that do not carry any payload.
+static bool loader_simple_call(ServerConnection& connection, const intptr_t* args, intptr_t& result)
+{
+    intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] = { };
+    memcpy(frame, args, sizeof(intptr_t) * (HYCLONE_SERVERCALL_MAX_ARGS + 1));
+
+    char reply[HYCLONE_SERVERCALL_MAX_PAYLOAD];
+    size_t replySize;
+    return connection.Call(frame, NULL, result, reply, replySize);
+}
+
 ServerConnection::ServerConnection()
 {
     _socket = -1;
+    _channel = NULL;
     memset(&_addr, 0, sizeof(struct sockaddr_un));
     _addr.sun_family = AF_UNIX;
     auto hycloneSocketPath = std::filesystem::path(gHaikuPrefix) / HYCLONE_SOCKET_NAME;
@@ -58,6 +142,8 @@ bool ServerConnection::Connect(bool forceReconnect)
     {
         if (!forceReconnect)
             return true;
+        // After a fork, the inherited channel still belongs to the parent.
+        _DetachChannel(/* abandon: */true);
         int expected = _socket;
         sMinProtectedFd.compare_exchange_strong(expected, _socket + 1);
         close(_socket);
@@ -102,10 +188,14 @@ bool ServerConnection::Connect(bool forceReconnect)
         { SERVERCALL_ID_connect, getpid(), syscall(SYS_gettid), getuid(), getgid(), geteuid(), getegid() };
     intptr_t returnCode = -1;
 
-    if (!Send(args, sizeof(args))) goto fail;
-    if (!Receive(&returnCode, sizeof(returnCode))) goto fail;
+    if (!loader_simple_call(*this, args, returnCode)) goto fail;
     if (returnCode != 0) goto fail;
 
+    if (sUseServercallChannel)
+    {
+        _AttachChannel();
+    }
+
     return true;
 fail:
     int expected = _socket;
@@ -117,12 +207,19 @@ fail:
 
 void ServerConnection::Disconnect()
 {
+    _DetachChannel();
+
+    if (_receivedFd != -1)
+    {
+        close(_receivedFd);
+        _receivedFd = -1;
+    }
+
     if (IsConnected())
     {
         intptr_t args[HYCLONE_SERVERCALL_MAX_ARGS + 1] = { SERVERCALL_ID_disconnect, 0, 0, 0, 0, 0, 0 };
         intptr_t returnCode = -1;
-        Send(args, sizeof(args));
-        Receive(&returnCode, sizeof(returnCode));
+        loader_simple_call(*this, args, returnCode);
         int expected = _socket;
         sMinProtectedFd.compare_exchange_strong(expected, _socket + 1);
         close(_socket);
@@ -150,16 +247,449 @@ bool ServerConnection::Receive(void* data, size_t size)
     size_t received = 0;
     while (received < size)
     {
-        ssize_t ret = read(_socket, (char*)data + received, size - received);
-        if (ret == -1)
+        int fd;
+        ssize_t ret = loader_receive_with_fd(_socket, (char*)data + received, size - received, fd);
+        if (ret <= 0)
         {
             return false;
         }
+        if (fd != -1)
+        {
+            // The server sends descriptors with a single marker byte ahead of the reply.
+            // Reading stops right after that byte, so it is always the last one.
+            if (_receivedFd != -1)
+            {
+                close(_receivedFd);
+            }
+            _receivedFd = fd;
+            --ret;
+        }
         received += ret;
     }
     return true;
 }
 
+int ServerConnection::ReceiveFd()
+{
+    if (_receivedFd == -1 && _channel != NULL)
+    {
+        // The reply came through the channel, so the marker is still waiting on the idle socket.
+        char marker;
+        int fd;
+        if (loader_receive_with_fd(_socket, &marker, sizeof(marker), fd) <= 0)
+        {
+            return -1;
+        }
+        _receivedFd = fd;
+    }
+
+    int fd = _receivedFd;
+    _receivedFd = -1;
+    return fd;
+}
+
+void ServerConnection::_AttachChannel()
+{
+    int fd = memfd_create("hyclone_servercall", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    servercall_channel* channel = NULL;
+
+    if (ftruncate(fd, sizeof(servercall_channel)) == 0)
+    {
+        void* address = mmap(NULL, sizeof(servercall_channel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            channel = (servercall_channel*)address;
+        }
+    }
+
+    if (channel != NULL)
+    {
+        // The server maps the same memory through our file descriptor.
+        intptr_t args[HYCLONE_SERVERCALL_MAX_ARGS + 1] = { SERVERCALL_ID_attach_channel, fd };
+        intptr_t returnCode = -1;
+
+        if (loader_simple_call(*this, args, returnCode) && returnCode == 0)
+        {
+            _channel = channel;
+        }
+        else
+        {
+            munmap(channel, sizeof(servercall_channel));
+        }
+    }
+
+    close(fd);
+}
+
+void ServerConnection::_DetachChannel(bool abandon)
+{
+    if (_channel != NULL)
+    {
+        if (!abandon)
+        {
+            // Let the server finish any one-way call before the connection goes away.
+            _WaitChannel();
+        }
+        munmap(_channel, sizeof(servercall_channel));
+        _channel = NULL;
+    }
+}
+
+bool ServerConnection::Call(const intptr_t* frame, const void* payload, intptr_t& result,
+    void* reply, size_t& replySize)
+{
+    if (_channel != NULL)
+    {
+        return _ChannelCall(frame, payload, result, reply, replySize);
+    }
+    return _SocketCall(frame, payload, result, reply, replySize);
+}
+
+bool ServerConnection::_SocketCall(const intptr_t* frame, const void* payload, intptr_t& result,
+    void* reply, size_t& replySize)
+{
+    size_t payloadSize = frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_PAYLOAD_SIZE_MASK;
+
+    if (payloadSize == 0)
+    {
+        if (!Send(frame, sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Send everything with a single write.
+        char buffer[sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH + HYCLONE_SERVERCALL_MAX_PAYLOAD];
+        memcpy(buffer, frame, sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH);
+        memcpy(buffer + sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH, payload, payloadSize);
+        if (!Send(buffer, sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH + payloadSize))
+        {
+            return false;
+        }
+    }
+
+    if (frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_FLAG_ONEWAY)
+    {
+        result = 0;
+        replySize = 0;
+        return true;
+    }
+
+    intptr_t replyHeader[HYCLONE_SERVERCALL_REPLY_LENGTH];
+    if (!Receive(replyHeader, sizeof(replyHeader)))
+    {
+        return false;
+    }
+
+    result = replyHeader[0];
+    replySize = replyHeader[1];
+
+    if (replySize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    return replySize == 0 || Receive(reply, replySize);
+}
+
+bool ServerConnection::_ChannelCall(const intptr_t* frame, const void* payload, intptr_t& result,
+    void* reply, size_t& replySize)
+{
+    size_t payloadSize = frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_PAYLOAD_SIZE_MASK;
+
+    // A one-way call may still be in progress.
+    uint32_t state = _WaitChannel();
+    if (state == SERVERCALL_CHANNEL_COMPLETED)
+    {
+        __atomic_store_n(&_channel->state, SERVERCALL_CHANNEL_IDLE, __ATOMIC_RELEASE);
+    }
+    else if (state != SERVERCALL_CHANNEL_IDLE)
+    {
+        return false;
+    }
+
+    memcpy(_channel->args, frame, sizeof(_channel->args));
+    memcpy(_channel->payload, payload, payloadSize);
+    _channel->payloadSize = payloadSize;
+    _channel->interrupted = 0;
+
+    uint32_t expected = SERVERCALL_CHANNEL_IDLE;
+    if (!__atomic_compare_exchange_n(&_channel->state, &expected, SERVERCALL_CHANNEL_SUBMITTED,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    syscall(SYS_futex, &_channel->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+
+    if (frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_FLAG_ONEWAY)
+    {
+        // Collected by the next call.
+        result = 0;
+        replySize = 0;
+        return true;
+    }
+
+    if (_WaitChannel(/* interruptible: */true) != SERVERCALL_CHANNEL_COMPLETED)
+    {
+        return false;
+    }
+
+    result = _channel->result;
+    replySize = std::min((size_t)_channel->payloadSize, (size_t)HYCLONE_SERVERCALL_MAX_PAYLOAD);
+    memcpy(reply, _channel->payload, replySize);
+    __atomic_store_n(&_channel->state, SERVERCALL_CHANNEL_IDLE, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Waits for the server to pick up and finish any submitted call.
+// Returns the resulting state of the channel.
+uint32_t ServerConnection::_WaitChannel(bool interruptible)
+{
+    while (true)
+    {
+        uint32_t state = __atomic_load_n(&_channel->state, __ATOMIC_ACQUIRE);
+        if (state != SERVERCALL_CHANNEL_SUBMITTED)
+        {
+            return state;
+        }
+
+        struct timespec timeout = { kChannelLivenessIntervalSeconds, 0 };
+        if (syscall(SYS_futex, &_channel->state, FUTEX_WAIT, SERVERCALL_CHANNEL_SUBMITTED,
+            &timeout, NULL, 0) == -1)
+        {
+            if (errno == ETIMEDOUT)
+            {
+                // Apart from a descriptor ahead of the reply, nothing is ever sent over
+                // the socket while a channel call is in progress. Only a hangup is polled for.
+                struct pollfd pfd = { _socket, POLLRDHUP, 0 };
+                if (poll(&pfd, 1, 0) > 0)
+                {
+                    return SERVERCALL_CHANNEL_CLOSED;
+                }
+            }
+            else if (errno == EINTR && interruptible
+                && !__atomic_exchange_n(&_channel->interrupted, 1, __ATOMIC_ACQ_REL))
+            {
+                // A signal handler has run. The flag tells the server about it,
+                // the call through the idle socket wakes up the interrupted wait.
+                intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] = { SERVERCALL_ID_interrupt };
+                frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] = HYCLONE_SERVERCALL_FLAG_ONEWAY;
+                Send(frame, sizeof(frame));
+            }
+        }
+    }
+}
+
+struct InlineRegion
+{
+    uintptr_t address;
+    size_t size;
+    uint32_t flags;
+};
+
+// Describes the caller's memory that a servercall is known to access,
+// so that it can be shipped along with the call.
+static size_t loader_get_inline_regions(const intptr_t* args, InlineRegion* regions)
+{
+    size_t count = 0;
+
+    const auto in = [&](intptr_t address, size_t size)
+    {
+        regions[count++] = { (uintptr_t)address, size, SERVERCALL_INLINE_IN };
+    };
+    const auto out = [&](intptr_t address, size_t size)
+    {
+        regions[count++] = { (uintptr_t)address, size, SERVERCALL_INLINE_OUT };
+    };
+
+    switch (args[0])
+    {
+        case SERVERCALL_ID_debug_output:
+        case SERVERCALL_ID_find_port:
+        case SERVERCALL_ID_unmount:
+            in(args[1], args[2]);
+        break;
+        case SERVERCALL_ID_create_port:
+        case SERVERCALL_ID_create_sem:
+        case SERVERCALL_ID_rename_thread:
+        case SERVERCALL_ID_remove_attr:
+        case SERVERCALL_ID_setcwd:
+            in(args[2], args[3]);
+        break;
+        case SERVERCALL_ID_change_root:
+            in(args[1], args[2]);
+        break;
+        case SERVERCALL_ID_register_fd:
+            in(args[3], args[4]);
+        break;
+        case SERVERCALL_ID_register_fd1:
+            in(args[4], args[5]);
+        break;
+        case SERVERCALL_ID_normalize_path:
+            in(args[1], args[2]);
+            out(args[4], args[5]);
+        break;
+        case SERVERCALL_ID_vchroot_expandat:
+        case SERVERCALL_ID_read_stat:
+            in(args[2], args[3]);
+            out(args[5], args[6]);
+        break;
+        case SERVERCALL_ID_write_stat:
+            in(args[2], args[3]);
+            in(args[5], sizeof(haiku_stat));
+        break;
+        case SERVERCALL_ID_getcwd:
+        case SERVERCALL_ID_get_root:
+            out(args[1], args[2]);
+        break;
+        case SERVERCALL_ID_get_port_info:
+            out(args[2], sizeof(haiku_port_info));
+        break;
+        case SERVERCALL_ID_get_port_message_info_etc:
+            out(args[2], args[3]);
+        break;
+        case SERVERCALL_ID_read_port_etc:
+            out(args[2], sizeof(int));
+            out(args[3], args[4]);
+        break;
+        case SERVERCALL_ID_write_port_etc:
+            in(args[3], args[4]);
+        break;
+        case SERVERCALL_ID_read_port_multiple_etc:
+        case SERVERCALL_ID_read_port_sized_etc:
+            out(args[2], args[3]);
+        break;
+        case SERVERCALL_ID_send_data:
+            in(args[3], args[4]);
+        break;
+        case SERVERCALL_ID_receive_data:
+            out(args[1], sizeof(int));
+            out(args[2], args[3]);
+        break;
+        case SERVERCALL_ID_get_sem_count:
+            out(args[2], sizeof(int));
+        break;
+        case SERVERCALL_ID_read_fs_info:
+            out(args[2], sizeof(haiku_fs_info));
+        break;
+        case SERVERCALL_ID_get_thread_info:
+            out(args[2], sizeof(haiku_thread_info));
+        break;
+        case SERVERCALL_ID_get_team_info:
+            out(args[2], sizeof(haiku_team_info));
+        break;
+        case SERVERCALL_ID_register_area:
+            in(args[1], sizeof(haiku_area_info));
+        break;
+        case SERVERCALL_ID_register_image:
+            in(args[1], args[2]);
+        break;
+        case SERVERCALL_ID_register_team_info:
+            in(args[1], sizeof(haiku_team_info));
+        break;
+        case SERVERCALL_ID_register_thread_info:
+            in(args[1], sizeof(haiku_thread_info));
+        break;
+        case SERVERCALL_ID_setgroups:
+            in(args[2], args[1] * sizeof(int));
+        break;
+        case SERVERCALL_ID_get_servercall_stats:
+            out(args[2], args[3]);
+        break;
+    }
+
+    return count;
+}
+
+// Builds the payload for a servercall. Regions that do not fit are left out,
+// and the server falls back to accessing them directly. isComplete is set to
+// false if the server still needs to read any memory of the caller.
+static size_t loader_build_payload(const InlineRegion* regions, size_t regionCount, char* payload,
+    bool& isComplete)
+{
+    size_t size = 0;
+    isComplete = true;
+
+    for (size_t i = 0; i < regionCount; ++i)
+    {
+        const auto& region = regions[i];
+
+        if (region.address == 0 || region.size == 0)
+        {
+            continue;
+        }
+
+        if (region.size > UINT32_MAX)
+        {
+            isComplete = false;
+            continue;
+        }
+
+        size_t recordSize = sizeof(servercall_inline_record);
+        if (region.flags & SERVERCALL_INLINE_IN)
+        {
+            recordSize += SERVERCALL_INLINE_ALIGN(region.size);
+        }
+
+        if (size + recordSize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+        {
+            isComplete = false;
+            continue;
+        }
+
+        servercall_inline_record record = { region.address, (uint32_t)region.size, region.flags };
+        memcpy(payload + size, &record, sizeof(record));
+
+        if (region.flags & SERVERCALL_INLINE_IN)
+        {
+            memcpy(payload + size + sizeof(record), (const void*)region.address, region.size);
+        }
+
+        size += recordSize;
+    }
+
+    return size;
+}
+
+// Copies the server's writes to output regions back to where they belong.
+static void loader_apply_reply(const InlineRegion* regions, size_t regionCount, const char* reply, size_t replySize)
+{
+    size_t offset = 0;
+
+    while (offset + sizeof(servercall_inline_record) <= replySize)
+    {
+        servercall_inline_record record;
+        memcpy(&record, reply + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (offset + record.size > replySize)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < regionCount; ++i)
+        {
+            const auto& region = regions[i];
+            if ((region.flags & SERVERCALL_INLINE_OUT)
+                && record.address >= region.address
+                && record.address + record.size <= region.address + region.size)
+            {
+                memcpy((void*)record.address, reply + offset, record.size);
+                break;
+            }
+        }
+
+        offset += SERVERCALL_INLINE_ALIGN(record.size);
+    }
+}
+
 static intptr_t loader_hserver_call(servercall_id id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6);
 
 #define HYCLONE_SERVERCALL0(name) \
@@ -215,35 +745,158 @@ thread_local bool gServerThreadInit = false;
 
 static bool loader_hserver_thread_init();
 
-intptr_t loader_hserver_call(servercall_id id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6)
+// Performs a servercall, shipping as much of the given regions as possible inline.
+static intptr_t loader_hserver_call_inline(intptr_t* frame, const InlineRegion* regions, size_t regionCount)
 {
     if (!gServerThreadInit)
     {
         gServerThreadInit = loader_hserver_thread_init();
     }
 
-    intptr_t args[HYCLONE_SERVERCALL_MAX_ARGS + 1] = { id, a1, a2, a3, a4, a5, a6 };
     if (!gServerConnection.Connect())
     {
         return HAIKU_POSIX_ENOSYS;
     }
 
-    if (!gServerConnection.Send(args, sizeof(args)))
+    char payload[HYCLONE_SERVERCALL_MAX_PAYLOAD];
+    char reply[HYCLONE_SERVERCALL_MAX_PAYLOAD];
+
+    bool isComplete;
+    frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] = loader_build_payload(regions, regionCount, payload, isComplete);
+
+    // Notifications do not have to wait for the server, unless
+    // it still has to read their arguments from our memory.
+    if (isComplete && servercall_is_oneway(frame[0]))
     {
-        gServerConnection.Disconnect();
-        return HAIKU_POSIX_ENOSYS;
+        frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] |= HYCLONE_SERVERCALL_FLAG_ONEWAY;
     }
 
     intptr_t result;
-    if (!gServerConnection.Receive(&result, sizeof(result)))
+    size_t replySize = 0;
+
+    if (!gServerConnection.Call(frame, payload, result, reply, replySize))
     {
         gServerConnection.Disconnect();
         return HAIKU_POSIX_ENOSYS;
     }
 
+    loader_apply_reply(regions, regionCount, reply, replySize);
+
     return result;
 }
 
+intptr_t loader_hserver_call(servercall_id id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6)
+{
+    InlineRegion regions[2];
+    intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] = { id, a1, a2, a3, a4, a5, a6, 0 };
+    size_t regionCount = loader_get_inline_regions(frame, regions);
+
+    return loader_hserver_call_inline(frame, regions, regionCount);
+}
+
+size_t ServercallBatch::Add(servercall_id id, intptr_t a1, intptr_t a2, intptr_t a3,
+    intptr_t a4, intptr_t a5, intptr_t a6)
+{
+    size_t index = GetCount();
+    _calls.insert(_calls.end(), { id, a1, a2, a3, a4, a5, a6 });
+    return index;
+}
+
+const void* ServercallBatch::Store(const void* data, size_t size)
+{
+    auto& buffer = _storage.emplace_back((const char*)data, (const char*)data + size);
+    return buffer.data();
+}
+
+bool ServercallBatch::Submit()
+{
+    size_t count = GetCount();
+
+    _results.assign(count, HAIKU_POSIX_ENOSYS);
+
+    for (size_t start = 0; start < count; start += HYCLONE_SERVERCALL_MAX_BATCH_SIZE)
+    {
+        size_t chunkCount = std::min(count - start, (size_t)HYCLONE_SERVERCALL_MAX_BATCH_SIZE);
+        intptr_t* calls = _calls.data() + start * HYCLONE_SERVERCALL_BATCH_CALL_LENGTH;
+        intptr_t* results = _results.data() + start;
+
+        // The call list and results go first, then whatever the calls
+        // themselves access, for as long as the payload has room.
+        std::vector<InlineRegion> regions(2 + 2 * chunkCount);
+        regions[0] = { (uintptr_t)calls, chunkCount * HYCLONE_SERVERCALL_BATCH_CALL_LENGTH * sizeof(intptr_t),
+            SERVERCALL_INLINE_IN };
+        regions[1] = { (uintptr_t)results, chunkCount * sizeof(intptr_t), SERVERCALL_INLINE_OUT };
+
+        size_t regionCount = 2;
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            regionCount += loader_get_inline_regions(calls + i * HYCLONE_SERVERCALL_BATCH_CALL_LENGTH,
+                regions.data() + regionCount);
+        }
+
+        intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] =
+            { SERVERCALL_ID_batch, (intptr_t)calls, (intptr_t)chunkCount, (intptr_t)results };
+
+        if (loader_hserver_call_inline(frame, regions.data(), regionCount) != B_OK)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define HYCLONE_SERVERCALL0(name) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name); \
+    }
+#define HYCLONE_SERVERCALL1(name, arg1) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1); \
+    }
+#define HYCLONE_SERVERCALL2(name, arg1, arg2) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1, (intptr_t)a2); \
+    }
+#define HYCLONE_SERVERCALL3(name, arg1, arg2, arg3) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1, (intptr_t)a2, (intptr_t)a3); \
+    }
+#define HYCLONE_SERVERCALL4(name, arg1, arg2, arg3, arg4) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1, (intptr_t)a2, (intptr_t)a3, (intptr_t)a4); \
+    }
+#define HYCLONE_SERVERCALL5(name, arg1, arg2, arg3, arg4, arg5) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4, arg5 a5) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1, (intptr_t)a2, (intptr_t)a3, (intptr_t)a4, (intptr_t)a5); \
+    }
+#define HYCLONE_SERVERCALL6(name, arg1, arg2, arg3, arg4, arg5, arg6) \
+    size_t loader_hserver_batch_##name(ServercallBatch& batch, arg1 a1, arg2 a2, arg3 a3, arg4 a4, arg5 a5, arg6 a6) \
+    { \
+        return batch.Add(SERVERCALL_ID_##name, (intptr_t)a1, (intptr_t)a2, (intptr_t)a3, (intptr_t)a4, (intptr_t)a5, (intptr_t)a6); \
+    }
+
+#include "servercall_defs.h"
+
+#undef HYCLONE_SERVERCALL0
+#undef HYCLONE_SERVERCALL1
+#undef HYCLONE_SERVERCALL2
+#undef HYCLONE_SERVERCALL3
+#undef HYCLONE_SERVERCALL4
+#undef HYCLONE_SERVERCALL5
+#undef HYCLONE_SERVERCALL6
+
+int loader_hserver_receive_fd()
+{
+    return gServerConnection.ReceiveFd();
+}
+
 bool loader_hserver_child_atfork()
 {
     if (!gServerConnection.Connect(/* forceReconnect: */true))
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <bit>
+#include <cstdlib>
 #include <fstream>
 #include <filesystem>
 #include <numeric>
@@ -439,6 +440,23 @@ int64_t get_max_procs()
     return pid_max;
 }
 
+// The NUMA node new areas should be placed on, or -1 for no preference.
+int get_memory_node()
+{
+    static const int sMemoryNode = []()
+    {
+        const char* value = getenv("HYCLONE_NUMA_NODE");
+        if (value == NULL || *value == '\0')
+            return -1;
+        char* end;
+        long node = strtol(value, &end, 10);
+        if (*end != '\0' || node < 0 || node > INT32_MAX)
+            return -1;
+        return (int)node;
+    }();
+    return sMemoryNode;
+}
+
 int get_process_usage(int pid, int who, team_usage_info* info)
 {
     if (pid == B_CURRENT_TEAM)
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <linux/futex.h>
+#include <mutex>
+#include <shared_mutex>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "BeDefs.h"
+#include "haiku_errors.h"
+#include "haiku_sem.h"
+#include "loader_ids.h"
+#include "loader_servercalls.h"
+#include "loader_systemtime.h"
+#include "loader_thread_block.h"
+#include "loader_vchroot.h"
+#include "servercalls.h"
+#include "thread_wait_table.h"
+#include "user_thread_defs.h"
+
+struct ThreadWaitEntry
+{
+    user_thread* userThread;
+    thread_wait_slot* slot;
+};
+
+// Removes the thread from sThreads when it exits, before its user_thread goes away.
+struct ThreadWaitRegistration
+{
+    int tid = -1;
+    ~ThreadWaitRegistration();
+};
+
+// Replaced in a forked child, where it might have been left locked.
+static std::shared_mutex* sThreadsLock = new std::shared_mutex();
+static std::unordered_map<int, ThreadWaitEntry> sThreads;
+
+static thread_local ThreadWaitEntry sCurrentThread = { NULL, NULL };
+static thread_local ThreadWaitRegistration sRegistration;
+
+ThreadWaitRegistration::~ThreadWaitRegistration()
+{
+    if (tid != -1)
+    {
+        auto lock = std::unique_lock(*sThreadsLock);
+        sThreads.erase(tid);
+    }
+}
+
+static thread_wait_slot* loader_get_thread_wait_table()
+{
+    static thread_wait_slot* sTable = []() -> thread_wait_slot*
+    {
+        auto path = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME / HYCLONE_THREAD_WAIT_TABLE_NAME;
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return NULL;
+        }
+
+        void* address = mmap(NULL, sizeof(thread_wait_slot) * HYCLONE_THREAD_WAIT_TABLE_SIZE,
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        return address == MAP_FAILED ? NULL : (thread_wait_slot*)address;
+    }();
+
+    return sTable;
+}
+
+void loader_init_thread_block(user_thread* userThread, intptr_t waitSlot)
+{
+    thread_wait_slot* table = loader_get_thread_wait_table();
+    if (table == NULL || waitSlot < 0 || waitSlot >= HYCLONE_THREAD_WAIT_TABLE_SIZE)
+    {
+        sCurrentThread = { NULL, NULL };
+        return;
+    }
+
+    sCurrentThread = { userThread, table + waitSlot };
+
+    int tid = loader_get_tid();
+    {
+        auto lock = std::unique_lock(*sThreadsLock);
+        sThreads[tid] = sCurrentThread;
+    }
+    sRegistration.tid = tid;
+}
+
+void loader_thread_block_child_atfork()
+{
+    user_thread* userThread = sCurrentThread.userThread;
+
+    sThreadsLock = new std::shared_mutex();
+    sThreads.clear();
+    sCurrentThread = { NULL, NULL };
+    sRegistration.tid = -1;
+
+    // The parent's slot has been inherited, but it still belongs to the parent.
+    if (userThread != NULL)
+    {
+        loader_init_thread_block(userThread, loader_hserver_call_register_user_thread(userThread));
+    }
+}
+
+// Bumps the slot's sequence, also dropping the server's status if clearStatus is set.
+static void loader_thread_wait_bump(thread_wait_slot* slot, bool clearStatus)
+{
+    thread_wait_slot current;
+    __atomic_load(slot, &current, __ATOMIC_ACQUIRE);
+
+    thread_wait_slot next;
+    do
+    {
+        next = { current.sequence + 1, clearStatus ? HYCLONE_THREAD_WAIT_NO_STATUS : current.status };
+    }
+    while (!__atomic_compare_exchange(slot, &current, &next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+// The table is shared with the server, so FUTEX_PRIVATE_FLAG must not be used.
+// Returns 0 or the errno of the wait.
+static int loader_thread_block_sleep(uint32_t* word, uint32_t value, uint32_t flags, int64_t deadline)
+{
+    struct timespec timeout;
+    struct timespec* timeoutPtr = NULL;
+    int op = FUTEX_WAIT_BITSET;
+
+    if (deadline != B_INFINITE_TIMEOUT)
+    {
+        if ((flags & B_ABSOLUTE_TIMEOUT) && (flags & B_TIMEOUT_REAL_TIME_BASE))
+        {
+            op |= FUTEX_CLOCK_REALTIME;
+        }
+        timeout.tv_sec = deadline / 1000000;
+        timeout.tv_nsec = (deadline % 1000000) * 1000;
+        timeoutPtr = &timeout;
+    }
+
+    if (syscall(SYS_futex, word, op, value, timeoutPtr, NULL, FUTEX_BITSET_MATCH_ANY) == -1)
+    {
+        return errno;
+    }
+
+    return 0;
+}
+
+int loader_block_thread(uint32_t flags, int64_t timeout)
+{
+    if (sCurrentThread.slot == NULL)
+    {
+        return loader_hserver_call_block_thread(flags, timeout);
+    }
+
+    int64_t deadline = B_INFINITE_TIMEOUT;
+    if (timeout != B_INFINITE_TIMEOUT)
+    {
+        if (flags & B_RELATIVE_TIMEOUT)
+        {
+            int64_t now = loader_system_time();
+            deadline = timeout > B_INFINITE_TIMEOUT - now ? B_INFINITE_TIMEOUT : now + std::max<int64_t>(timeout, 0);
+        }
+        else if (flags & B_ABSOLUTE_TIMEOUT)
+        {
+            deadline = std::max<int64_t>(timeout, 0);
+        }
+    }
+
+    status_t* waitStatus = &sCurrentThread.userThread->wait_status;
+    thread_wait_slot* slot = sCurrentThread.slot;
+    status_t failure = B_OK;
+    status_t result;
+
+    while (true)
+    {
+        thread_wait_slot current;
+        __atomic_load(slot, &current, __ATOMIC_ACQUIRE);
+        status_t status = __atomic_load_n(waitStatus, __ATOMIC_ACQUIRE);
+
+        // check, if already done
+        if (status <= 0)
+        {
+            result = status;
+            break;
+        }
+
+        // Unblocked by the server.
+        if (current.status <= 0)
+        {
+            if (__atomic_compare_exchange_n(waitStatus, &status, current.status, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                result = current.status;
+                break;
+            }
+            continue;
+        }
+
+        if (failure != B_OK)
+        {
+            // Favor a wake-up by another thread, i.e. if someone
+            // changed the wait status, use that.
+            if (__atomic_compare_exchange_n(waitStatus, &status, failure, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                result = failure;
+                break;
+            }
+            continue;
+        }
+
+        int error = loader_thread_block_sleep(&slot->sequence, current.sequence, flags, deadline);
+        if (error == ETIMEDOUT)
+        {
+            failure = B_TIMED_OUT;
+        }
+        else if (error == EINTR && (flags & B_CAN_INTERRUPT))
+        {
+            failure = B_INTERRUPTED;
+        }
+    }
+
+    // Drops a status the server stored too late, and fails its pending stores.
+    loader_thread_wait_bump(slot, true);
+
+    return result;
+}
+
+int loader_unblock_thread(int thread, int status)
+{
+    {
+        auto lock = std::shared_lock(*sThreadsLock);
+        auto it = sThreads.find(thread);
+        if (it != sThreads.end())
+        {
+            status_t* waitStatus = &it->second.userThread->wait_status;
+            status_t oldStatus = __atomic_load_n(waitStatus, __ATOMIC_ACQUIRE);
+
+            while (oldStatus > 0)
+            {
+                if (__atomic_compare_exchange_n(waitStatus, &oldStatus, status, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    thread_wait_slot* slot = it->second.slot;
+                    loader_thread_wait_bump(slot, false);
+                    syscall(SYS_futex, &slot->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+                    break;
+                }
+            }
+
+            return B_OK;
+        }
+    }
+
+    return loader_hserver_call_unblock_thread(thread, status);
+}
@@ -0,0 +1,720 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "BeDefs.h"
+#include "haiku_area.h"
+#include "servercalls.h"
+
+// Drives a private hyclone_server instance with synthetic clients that speak
+// the servercall protocol directly, and prints one JSON object per result.
+
+struct BenchRegion
+{
+    const void* address;
+    size_t size;
+    uint32_t flags;
+};
+
+class BenchClient
+{
+private:
+    int _socket = -1;
+public:
+    BenchClient() = default;
+    BenchClient(const BenchClient&) = delete;
+    ~BenchClient() { Close(); }
+
+    bool Open(const std::string& socketPath);
+    void Close();
+
+    // Registers the calling thread with the server.
+    bool Connect();
+    void Disconnect();
+
+    // Performs a servercall, shipping the given regions inline.
+    // Returns false if the connection has been lost.
+    bool Call(intptr_t& result, intptr_t id, intptr_t a1 = 0, intptr_t a2 = 0, intptr_t a3 = 0,
+        intptr_t a4 = 0, intptr_t a5 = 0, intptr_t a6 = 0,
+        std::initializer_list<BenchRegion> regions = {});
+private:
+    bool _Send(const void* data, size_t size);
+    bool _Receive(void* data, size_t size);
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t threads;
+    uint64_t operations;
+    double seconds;
+    // Per operation latencies in nanoseconds, if measured.
+    std::vector<uint64_t> latencies;
+};
+
+static std::string sSocketPath;
+static size_t sIterations = 20000;
+
+static int64_t bench_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool BenchClient::Open(const std::string& socketPath)
+{
+    _socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_socket == -1)
+    {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(_socket, (const struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void BenchClient::Close()
+{
+    if (_socket != -1)
+    {
+        close(_socket);
+        _socket = -1;
+    }
+}
+
+bool BenchClient::Connect()
+{
+    intptr_t result;
+    return Call(result, SERVERCALL_ID_connect, getpid(), syscall(SYS_gettid),
+        getuid(), getgid(), geteuid(), getegid()) && result == 0;
+}
+
+void BenchClient::Disconnect()
+{
+    intptr_t result;
+    Call(result, SERVERCALL_ID_disconnect);
+}
+
+bool BenchClient::Call(intptr_t& result, intptr_t id, intptr_t a1, intptr_t a2, intptr_t a3,
+    intptr_t a4, intptr_t a5, intptr_t a6, std::initializer_list<BenchRegion> regions)
+{
+    char request[sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH + HYCLONE_SERVERCALL_MAX_PAYLOAD];
+    intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] = { id, a1, a2, a3, a4, a5, a6, 0 };
+    size_t payloadSize = 0;
+    char* payload = request + sizeof(frame);
+
+    for (const auto& region : regions)
+    {
+        size_t recordSize = sizeof(servercall_inline_record);
+        if (region.flags & SERVERCALL_INLINE_IN)
+        {
+            recordSize += SERVERCALL_INLINE_ALIGN(region.size);
+        }
+        if (payloadSize + recordSize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+        {
+            return false;
+        }
+
+        servercall_inline_record record = { (uint64_t)(uintptr_t)region.address, (uint32_t)region.size, region.flags };
+        memcpy(payload + payloadSize, &record, sizeof(record));
+        if (region.flags & SERVERCALL_INLINE_IN)
+        {
+            memcpy(payload + payloadSize + sizeof(record), region.address, region.size);
+        }
+        payloadSize += recordSize;
+    }
+
+    frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] = payloadSize;
+    memcpy(request, frame, sizeof(frame));
+
+    if (!_Send(request, sizeof(frame) + payloadSize))
+    {
+        return false;
+    }
+
+    intptr_t replyHeader[HYCLONE_SERVERCALL_REPLY_LENGTH];
+    if (!_Receive(replyHeader, sizeof(replyHeader)))
+    {
+        return false;
+    }
+
+    result = replyHeader[0];
+    size_t replySize = replyHeader[1];
+    if (replySize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    char reply[HYCLONE_SERVERCALL_MAX_PAYLOAD];
+    if (!_Receive(reply, replySize))
+    {
+        return false;
+    }
+
+    size_t offset = 0;
+    while (offset + sizeof(servercall_inline_record) <= replySize)
+    {
+        servercall_inline_record record;
+        memcpy(&record, reply + offset, sizeof(record));
+        offset += sizeof(record);
+
+        for (const auto& region : regions)
+        {
+            uintptr_t start = (uintptr_t)region.address;
+            if ((region.flags & SERVERCALL_INLINE_OUT) && record.address >= start
+                && record.address + record.size <= start + region.size
+                && offset + record.size <= replySize)
+            {
+                memcpy((void*)(uintptr_t)record.address, reply + offset, record.size);
+                break;
+            }
+        }
+
+        offset += SERVERCALL_INLINE_ALIGN(record.size);
+    }
+
+    return true;
+}
+
+bool BenchClient::_Send(const void* data, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t ret = write(_socket, (const char*)data + sent, size - sent);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+bool BenchClient::_Receive(void* data, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t ret = read(_socket, (char*)data + received, size - received);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+static void bench_fail(const std::string& message)
+{
+    std::cerr << "hyclone_bench: " << message << std::endl;
+    std::exit(1);
+}
+
+// Opens and registers a client for the calling thread.
+static void bench_open_client(BenchClient& client)
+{
+    if (!client.Open(sSocketPath) || !client.Connect())
+    {
+        bench_fail("failed to connect to the server");
+    }
+}
+
+static void bench_call(BenchClient& client, intptr_t& result, intptr_t id, intptr_t a1 = 0, intptr_t a2 = 0,
+    intptr_t a3 = 0, intptr_t a4 = 0, intptr_t a5 = 0, intptr_t a6 = 0,
+    std::initializer_list<BenchRegion> regions = {})
+{
+    if (!client.Call(result, id, a1, a2, a3, a4, a5, a6, regions))
+    {
+        bench_fail("lost the connection to the server");
+    }
+}
+
+// Runs body on the given number of threads, each getting its index,
+// and returns the wall time of the whole run in seconds.
+static double bench_run_threads(size_t threads, const std::function<void(size_t)>& body)
+{
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> start = false;
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i]()
+        {
+            ++ready;
+            while (!start)
+            {
+                std::this_thread::yield();
+            }
+            body(i);
+        });
+    }
+
+    while (ready < threads)
+    {
+        std::this_thread::yield();
+    }
+
+    int64_t begin = bench_now();
+    start = true;
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    return (bench_now() - begin) / 1e9;
+}
+
+static BenchResult bench_connect(size_t threads)
+{
+    size_t iterations = std::max(sIterations / 20, (size_t)1);
+    std::vector<std::vector<uint64_t>> latencies(threads);
+
+    double seconds = bench_run_threads(threads, [&](size_t index)
+    {
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            int64_t begin = bench_now();
+            BenchClient client;
+            bench_open_client(client);
+            client.Disconnect();
+            client.Close();
+            latencies[index].push_back(bench_now() - begin);
+        }
+    });
+
+    BenchResult result = { "connect", threads, iterations * threads, seconds, { } };
+    for (auto& list : latencies)
+    {
+        result.latencies.insert(result.latencies.end(), list.begin(), list.end());
+    }
+    return result;
+}
+
+static BenchResult bench_null_call(size_t threads)
+{
+    std::vector<std::vector<uint64_t>> latencies(threads);
+
+    double seconds = bench_run_threads(threads, [&](size_t index)
+    {
+        BenchClient client;
+        bench_open_client(client);
+
+        latencies[index].reserve(sIterations);
+        for (size_t i = 0; i < sIterations; ++i)
+        {
+            intptr_t result;
+            int64_t begin = bench_now();
+            bench_call(client, result, SERVERCALL_ID_get_system_sem_count);
+            latencies[index].push_back(bench_now() - begin);
+        }
+
+        client.Disconnect();
+    });
+
+    BenchResult result = { "null_call", threads, sIterations * threads, seconds, { } };
+    for (auto& list : latencies)
+    {
+        result.latencies.insert(result.latencies.end(), list.begin(), list.end());
+    }
+    return result;
+}
+
+// Each pair of threads shares a port, one writing and one reading.
+static BenchResult bench_port(BenchClient& owner, size_t pairs, size_t messageSize)
+{
+    std::vector<intptr_t> ports(pairs, -1);
+
+    {
+        for (size_t i = 0; i < pairs; ++i)
+        {
+            std::string name = "bench port " + std::to_string(i);
+            bench_call(owner, ports[i], SERVERCALL_ID_create_port, 64, (intptr_t)name.c_str(), name.size(), 0, 0, 0,
+                { { name.c_str(), name.size(), SERVERCALL_INLINE_IN } });
+            if (ports[i] < 0)
+            {
+                bench_fail("failed to create a port");
+            }
+        }
+    }
+
+    double seconds = bench_run_threads(pairs * 2, [&](size_t index)
+    {
+        BenchClient client;
+        bench_open_client(client);
+
+        intptr_t port = ports[index / 2];
+        std::vector<char> buffer(messageSize, 'x');
+        int32_t code = 0;
+
+        for (size_t i = 0; i < sIterations; ++i)
+        {
+            intptr_t result;
+            if (index % 2 == 0)
+            {
+                bench_call(client, result, SERVERCALL_ID_write_port_etc, port, (intptr_t)i,
+                    (intptr_t)buffer.data(), buffer.size(), 0, 0,
+                    { { buffer.data(), buffer.size(), SERVERCALL_INLINE_IN } });
+            }
+            else
+            {
+                bench_call(client, result, SERVERCALL_ID_read_port_etc, port, (intptr_t)&code,
+                    (intptr_t)buffer.data(), buffer.size(), 0, 0,
+                    { { &code, sizeof(code), SERVERCALL_INLINE_OUT },
+                      { buffer.data(), buffer.size(), SERVERCALL_INLINE_OUT } });
+            }
+            if (result < 0)
+            {
+                bench_fail("port operation failed: " + std::to_string(result));
+            }
+        }
+
+        client.Disconnect();
+    });
+
+    {
+        for (intptr_t port : ports)
+        {
+            intptr_t result;
+            bench_call(owner, result, SERVERCALL_ID_delete_port, port);
+        }
+    }
+
+    return { "port_" + std::to_string(messageSize), pairs, sIterations * pairs, seconds, { } };
+}
+
+// Each pair of threads bounces between two semaphores.
+static BenchResult bench_semaphore(BenchClient& owner, size_t pairs)
+{
+    std::vector<intptr_t> semaphores(pairs * 2, -1);
+
+    {
+        static const char kName[] = "bench sem";
+        for (auto& sem : semaphores)
+        {
+            bench_call(owner, sem, SERVERCALL_ID_create_sem, 0, (intptr_t)kName, sizeof(kName) - 1, 0, 0, 0,
+                { { kName, sizeof(kName) - 1, SERVERCALL_INLINE_IN } });
+            if (sem < 0)
+            {
+                bench_fail("failed to create a semaphore");
+            }
+        }
+    }
+
+    std::vector<std::vector<uint64_t>> latencies(pairs);
+
+    double seconds = bench_run_threads(pairs * 2, [&](size_t index)
+    {
+        BenchClient client;
+        bench_open_client(client);
+
+        intptr_t ping = semaphores[(index / 2) * 2];
+        intptr_t pong = semaphores[(index / 2) * 2 + 1];
+        bool isInitiator = index % 2 == 0;
+
+        for (size_t i = 0; i < sIterations; ++i)
+        {
+            intptr_t result;
+            if (isInitiator)
+            {
+                int64_t begin = bench_now();
+                bench_call(client, result, SERVERCALL_ID_release_sem, ping);
+                bench_call(client, result, SERVERCALL_ID_acquire_sem, pong);
+                latencies[index / 2].push_back(bench_now() - begin);
+            }
+            else
+            {
+                bench_call(client, result, SERVERCALL_ID_acquire_sem, ping);
+                bench_call(client, result, SERVERCALL_ID_release_sem, pong);
+            }
+        }
+
+        client.Disconnect();
+    });
+
+    {
+        for (intptr_t sem : semaphores)
+        {
+            intptr_t result;
+            bench_call(owner, result, SERVERCALL_ID_delete_sem, sem);
+        }
+    }
+
+    BenchResult result = { "sem_ping_pong", pairs, sIterations * pairs, seconds, { } };
+    for (auto& list : latencies)
+    {
+        result.latencies.insert(result.latencies.end(), list.begin(), list.end());
+    }
+    return result;
+}
+
+static BenchResult bench_area(size_t threads)
+{
+    double seconds = bench_run_threads(threads, [&](size_t index)
+    {
+        BenchClient client;
+        bench_open_client(client);
+
+        haiku_area_info info;
+        memset(&info, 0, sizeof(info));
+        strncpy(info.name, "bench area", sizeof(info.name) - 1);
+        info.size = B_PAGE_SIZE;
+        info.protection = B_READ_AREA | B_WRITE_AREA;
+        // Never mapped, the server only keeps track of it.
+        info.address = (void*)((uintptr_t)(index + 1) << 32);
+
+        for (size_t i = 0; i < sIterations; ++i)
+        {
+            intptr_t id;
+            bench_call(client, id, SERVERCALL_ID_register_area, (intptr_t)&info, 0, 0, 0, 0, 0,
+                { { &info, sizeof(info), SERVERCALL_INLINE_IN } });
+            if (id < 0)
+            {
+                bench_fail("failed to register an area");
+            }
+            intptr_t result;
+            bench_call(client, result, SERVERCALL_ID_unregister_area, id);
+        }
+
+        client.Disconnect();
+    });
+
+    return { "area_register", threads, sIterations * threads, seconds, { } };
+}
+
+static void bench_print(const BenchResult& result)
+{
+    std::cout << "{\"benchmark\":\"" << result.name << "\""
+        << ",\"threads\":" << result.threads
+        << ",\"operations\":" << result.operations
+        << ",\"seconds\":" << result.seconds
+        << ",\"ops_per_sec\":" << (result.seconds > 0 ? result.operations / result.seconds : 0);
+
+    if (!result.latencies.empty())
+    {
+        auto latencies = result.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&](double p)
+        {
+            return latencies[std::min((size_t)(latencies.size() * p), latencies.size() - 1)];
+        };
+        std::cout << ",\"p50_ns\":" << percentile(0.5)
+            << ",\"p99_ns\":" << percentile(0.99)
+            << ",\"max_ns\":" << latencies.back();
+    }
+
+    std::cout << "}" << std::endl;
+}
+
+// Starts a server on a fresh prefix and returns its pid once it accepts connections.
+static pid_t bench_start_server(const std::string& serverPath, const std::string& prefix)
+{
+    setenv("HPREFIX", prefix.c_str(), 1);
+    sSocketPath = (std::filesystem::path(prefix) / HYCLONE_SOCKET_NAME).string();
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        const char* argv[] = { serverPath.c_str(), NULL };
+        execv(argv[0], (char* const*)argv);
+        _exit(1);
+    }
+
+    if (pid == -1)
+    {
+        return -1;
+    }
+
+    // The server daemonizes, so this returns once it is listening.
+    waitpid(pid, NULL, 0);
+
+    // The daemonized server is the only process logging to our prefix.
+    auto logPath = std::filesystem::canonical(prefix) / ".hyclone.log";
+
+    for (int i = 0; i < 100; ++i)
+    {
+        BenchClient client;
+        if (client.Open(sSocketPath))
+        {
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator("/proc", error))
+            {
+                pid_t serverPid = atoi(entry.path().filename().c_str());
+                if (serverPid > 0 && std::filesystem::read_symlink(entry.path() / "fd" / "2", error) == logPath)
+                {
+                    return serverPid;
+                }
+            }
+        }
+        usleep(100 * 1000);
+    }
+
+    return -1;
+}
+
+// Stops the server and removes the prefix, including the shm mount the server leaves behind.
+static void bench_stop_server(pid_t serverPid, const std::string& prefix)
+{
+    if (serverPid > 0)
+    {
+        // The server has daemonized and is not our child, so wait on a pidfd instead of waitpid.
+        int pidfd = syscall(SYS_pidfd_open, serverPid, 0);
+        kill(serverPid, SIGTERM);
+        if (pidfd >= 0)
+        {
+            struct pollfd pfd = { pidfd, POLLIN, 0 };
+            if (poll(&pfd, 1, 5000) == 0)
+            {
+                kill(serverPid, SIGKILL);
+                poll(&pfd, 1, -1);
+            }
+            close(pidfd);
+        }
+    }
+
+    auto shmPath = std::filesystem::path(prefix) / HYCLONE_SHM_NAME;
+    umount2(shmPath.c_str(), MNT_DETACH);
+
+    std::error_code error;
+    std::filesystem::remove_all(prefix, error);
+    if (error)
+    {
+        std::cerr << "hyclone_bench: failed to remove " << prefix << ": " << error.message() << std::endl;
+    }
+}
+
+static void bench_usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [--server PATH] [--threads N] [--iterations N] [--filter NAME]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string serverPath = HYCLONE_BENCH_SERVER_PATH;
+    size_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::string filter;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            bench_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--server")
+        {
+            serverPath = argv[++i];
+        }
+        else if (arg == "--threads")
+        {
+            maxThreads = std::max(strtoul(argv[++i], NULL, 10), 1ul);
+        }
+        else if (arg == "--iterations")
+        {
+            sIterations = std::max(strtoul(argv[++i], NULL, 10), 1ul);
+        }
+        else if (arg == "--filter")
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // The server may still have to reach our memory for anything
+    // that does not fit in a servercall payload.
+    prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+
+    char prefixTemplate[] = "/tmp/hyclone_bench.XXXXXX";
+    if (mkdtemp(prefixTemplate) == NULL)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string prefix = prefixTemplate;
+
+    pid_t serverPid = bench_start_server(serverPath, prefix);
+    if (serverPid == -1)
+    {
+        std::cerr << "hyclone_bench: failed to start " << serverPath << std::endl;
+        bench_stop_server(-1, prefix);
+        return 1;
+    }
+
+    {
+        // Keeps the benchmark's team registered between runs, and owns
+        // the ports and semaphores. Every other client runs on its own thread.
+        BenchClient anchor;
+        bench_open_client(anchor);
+
+        std::vector<size_t> threadCounts;
+        for (size_t threads = 1; threads < maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+
+        const auto selected = [&](const char* name)
+        {
+            return filter.empty() || filter == name;
+        };
+
+        for (size_t threads : threadCounts)
+        {
+            if (selected("connect"))
+                bench_print(bench_connect(threads));
+            if (selected("null_call"))
+                bench_print(bench_null_call(threads));
+            if (selected("port"))
+            {
+                bench_print(bench_port(anchor, threads, 64));
+                bench_print(bench_port(anchor, threads, 2048));
+            }
+            if (selected("sem_ping_pong"))
+                bench_print(bench_semaphore(anchor, threads));
+            if (selected("area_register"))
+                bench_print(bench_area(threads));
+        }
+
+        anchor.Disconnect();
+    }
+
+    bench_stop_server(serverPid, prefix);
+
+    return 0;
+}
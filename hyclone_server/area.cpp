@@ -10,6 +10,7 @@
 #include "haiku_area.h"
 #include "haiku_errors.h"
 #include "process.h"
+#include "server_main.h"
 #include "server_memory.h"
 #include "server_requests.h"
 #include "server_servercalls.h"
@@ -89,7 +90,6 @@ intptr_t server_hserver_call_share_area(hserver_context& context, int areaId, in
     auto& system = System::GetInstance();
 
     {
-        auto lock = system.Lock();
         if (system.IsValidAreaId(areaId))
         {
             area = system.GetArea(areaId).lock();
@@ -166,13 +166,12 @@ intptr_t server_hserver_call_share_area(hserver_context& context, int areaId, in
     }
 }
 
-intptr_t server_hserver_call_get_shared_area_path(hserver_context& context, int areaId, char* user_path, size_t pathLen)
+intptr_t server_hserver_call_send_shared_area_fd(hserver_context& context, int areaId, bool writable)
 {
     std::shared_ptr<Area> area;
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         if (system.IsValidAreaId(areaId))
         {
             area = system.GetArea(areaId).lock();
@@ -190,27 +189,30 @@ intptr_t server_hserver_call_get_shared_area_path(hserver_context& context, int
     }
 
     auto& memService = System::GetInstance().GetMemoryService();
-    auto lock = memService.Lock();
+    intptr_t handle;
 
-    std::string path;
-    if (!memService.GetSharedFilePath(area->GetEntryRef(), path))
     {
-        return B_ENTRY_NOT_FOUND;
-    }
+        auto lock = memService.Lock();
 
-    size_t writeSize = path.size() + 1;
+        // The path is only used by the server itself. Teams may not be able to open it.
+        std::string path;
+        if (!memService.GetSharedFilePath(area->GetEntryRef(), path))
+        {
+            return B_ENTRY_NOT_FOUND;
+        }
 
-    if (writeSize > pathLen)
-    {
-        return B_BUFFER_OVERFLOW;
+        handle = server_open_file(path.c_str(), writable);
     }
 
-    if (context.process->WriteMemory(user_path, path.c_str(), writeSize) != writeSize)
+    if (handle < 0)
     {
-        return B_BAD_ADDRESS;
+        return B_PERMISSION_DENIED;
     }
 
-    return B_OK;
+    bool sent = server_send_connection_fd(context.conn_id, handle);
+    server_close_file(handle);
+
+    return sent ? B_OK : B_ERROR;
 }
 
 intptr_t server_hserver_call_transfer_area(hserver_context& context, int areaId, void** userAddress,
@@ -254,7 +256,6 @@ intptr_t server_hserver_call_transfer_area(hserver_context& context, int areaId,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         targetThread = system.GetThread(target).lock();
     }
 
@@ -299,7 +300,6 @@ intptr_t server_hserver_call_transfer_area(hserver_context& context, int areaId,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         newArea = system.GetArea(status).lock();
     }
 
@@ -327,7 +327,6 @@ intptr_t server_hserver_call_get_area_info(hserver_context& context, int areaId,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         if (system.IsValidAreaId(areaId))
         {
             area = system.GetArea(areaId).lock();
@@ -357,7 +356,6 @@ intptr_t server_hserver_call_get_next_area_info(hserver_context& context, int ta
     std::shared_ptr<Process> targetProcess;
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         targetProcess = system.GetProcess(target_pid).lock();
     }
 
@@ -450,6 +448,7 @@ intptr_t server_hserver_call_resize_area(hserver_context& context, int areaId, s
             return B_BAD_VALUE;
         }
         area->GetInfo().size = size;
+        context.process->UpdateArea(areaId);
     }
 
     return B_OK;
@@ -465,6 +464,7 @@ intptr_t server_hserver_call_set_area_protection(hserver_context& context, int a
             return B_BAD_VALUE;
         }
         area->GetInfo().protection = protection;
+        context.process->UpdateArea(areaId);
     }
 
     return B_OK;
@@ -478,12 +478,27 @@ intptr_t server_hserver_call_area_for(hserver_context& context, void* address)
     }
 }
 
+intptr_t server_hserver_call_get_area_table(hserver_context& context)
+{
+    int64_t tableId;
+    {
+        // The table is filled from the process's areas.
+        auto lock = context.process->Lock();
+        tableId = context.process->GetAreaTableId();
+    }
+    if (tableId < 0)
+    {
+        return B_NO_MEMORY;
+    }
+
+    return tableId;
+}
+
 intptr_t server_hserver_call_set_memory_protection(hserver_context& context, void* address, size_t size, unsigned int protection)
 {
     {
         auto lock = context.process->Lock();
-        int id = -1;
-        while ((id = context.process->NextAreaId(id)) != -1)
+        for (int id: context.process->GetAreaIdsIn(address, size))
         {
             auto area = context.process->GetArea(id).lock();
 
@@ -533,12 +548,14 @@ intptr_t server_hserver_call_set_memory_protection(hserver_context& context, voi
             {
                 // Everything has changed.
                 area->GetInfo().protection = protection;
+                context.process->UpdateArea(id);
             }
             else
             {
                 std::vector<std::pair<uint8_t*, uint8_t*>> newRanges = unchangedRanges;
                 newRanges.insert(newRanges.end(), changedRanges.begin(), changedRanges.end());
                 std::vector<std::shared_ptr<Area>> newAreas = area->Split(newRanges);
+                context.process->UpdateArea(id);
 
                 assert(newAreas.size() == unchangedRanges.size() + changedRanges.size() - 1);
 
@@ -579,8 +596,7 @@ intptr_t server_hserver_call_set_memory_lock(hserver_context& context, void* add
 
     {
         auto lock = context.process->Lock();
-        int id = -1;
-        while ((id = context.process->NextAreaId(id)) != -1)
+        for (int id: context.process->GetAreaIdsIn(address, size))
         {
             auto area = context.process->GetArea(id).lock();
 
@@ -592,6 +608,7 @@ intptr_t server_hserver_call_set_memory_lock(hserver_context& context, void* add
 
             // TODO: Does this lock affect the whole area or does it split the area into two like set_memory_protection?
             area->GetInfo().lock = type;
+            context.process->UpdateArea(id);
         }
     }
 
@@ -602,9 +619,8 @@ intptr_t server_hserver_call_unmap_memory(hserver_context& context, void* addres
 {
     {
         auto lock = context.process->Lock();
-        int id = -1;
         std::vector<int> idsToUnregister;
-        while ((id = context.process->NextAreaId(id)) != -1)
+        for (int id: context.process->GetAreaIdsIn(address, size))
         {
             auto area = context.process->GetArea(id).lock();
 
@@ -647,6 +663,7 @@ intptr_t server_hserver_call_unmap_memory(hserver_context& context, void* addres
             else
             {
                 std::vector<std::shared_ptr<Area>> newAreas = area->Split(survivingRanges);
+                context.process->UpdateArea(id);
 
                 assert(newAreas.size() == survivingRanges.size() - 1);
 
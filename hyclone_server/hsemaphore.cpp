@@ -1,18 +1,40 @@
+#include <algorithm>
 #include <cstring>
+#include <functional>
 
 #include "haiku_errors.h"
 #include "hsemaphore.h"
 #include "process.h"
+#include "server_channel.h"
+#include "server_memory.h"
 #include "server_servercalls.h"
 #include "server_systemtime.h"
 #include "server_time.h"
 #include "server_workers.h"
 #include "system.h"
+#include "thread.h"
 
-const int kIntervalMicroseconds = 100 * 1000;
+static uint64_t* server_get_sem_table()
+{
+    static uint64_t* sTable = []() -> uint64_t*
+    {
+        size_t size = sizeof(uint64_t) * HYCLONE_SEM_TABLE_SIZE;
+        intptr_t handle = server_open_shared_file(HYCLONE_SEM_TABLE_NAME, size, true);
+        if (handle < 0)
+        {
+            return NULL;
+        }
+
+        void* address = server_map_memory(handle, size, 0, true);
+        server_close_file(handle);
+        return (uint64_t*)address;
+    }();
+
+    return sTable;
+}
 
 Semaphore::Semaphore(int pid, int count, const char* name)
-    : _count(count)
+    : _state(&_privateState), _privateState(sem_state_make(count, 0))
 {
     _info.count = count;
     strncpy(_info.name, name, sizeof(_info.name));
@@ -20,134 +42,324 @@ Semaphore::Semaphore(int pid, int count, const char* name)
     _info.team = pid;
 }
 
-int Semaphore::Acquire(int tid, int count)
+void Semaphore::_Register(int id)
+{
+    _info.sem = id;
+
+    uint64_t* table = server_get_sem_table();
+    if (table != NULL && id < HYCLONE_SEM_TABLE_SIZE)
+    {
+        __atomic_store_n(&table[id], _privateState, __ATOMIC_RELEASE);
+        _state = &table[id];
+    }
+
+    _registered = true;
+}
+
+void Semaphore::_Unregister()
 {
     std::unique_lock<std::mutex> lock(_countLock);
-    if (_count >= count)
+    _registered = false;
+
+    if (_state != &_privateState)
     {
-        _count -= count;
-        return B_OK;
+        // Takes the entry away from the teams, which now go to the server
+        // and find the ID invalid.
+        _privateState = __atomic_exchange_n(_state, 0, __ATOMIC_ACQ_REL);
+        _state = &_privateState;
     }
 
-    ++_waitCount;
+    for (Waiter* waiter : _waiters)
+    {
+        waiter->done = true;
+        waiter->status = B_BAD_SEM_ID;
+        waiter->condition.notify_one();
+    }
+    _waiters.clear();
+    _privateState = sem_state_make(sem_state_count(_privateState), 0);
+}
 
-    server_worker_run_wait([&]()
+template <typename Function>
+bool Semaphore::_UpdateState(Function&& update)
+{
+    uint64_t oldState = __atomic_load_n(_state, __ATOMIC_ACQUIRE);
+    uint64_t newState;
+
+    do
     {
-        _countCondVar.wait(lock, [&]()
+        int32_t count = sem_state_count(oldState);
+        uint32_t waiters = sem_state_waiters(oldState);
+
+        if (!update(count, waiters))
         {
-            return !_registered || _count >= count;
-        });
-    });
+            return false;
+        }
+
+        newState = (sem_state_make(count, waiters) & ~SEM_STATE_VALID) | (oldState & SEM_STATE_VALID);
+    }
+    while (!__atomic_compare_exchange_n(_state, &oldState, newState, true,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
 
-    --_waitCount;
+    return true;
+}
 
+int Semaphore::_Acquire(std::unique_lock<std::mutex>& lock, int tid, int count,
+    std::chrono::steady_clock::time_point deadline, uint32 flags,
+    const std::function<void()>& queued, const std::function<bool()>& interrupted)
+{
     if (!_registered)
     {
         return B_BAD_SEM_ID;
     }
 
-    _count -= count;
-
-    return B_OK;
-}
+    bool taken = false;
 
-int Semaphore::TryAcquire(int tid, int count)
-{
-    std::unique_lock<std::mutex> lock(_countLock);
+    // Both happen in one step, so that a release by a team in between cannot be missed.
+    _UpdateState([&](int32_t& available, uint32_t& waiters)
+    {
+        taken = waiters == 0 && available >= count;
+        if (taken)
+        {
+            available -= count;
+        }
+        else
+        {
+            ++waiters;
+        }
+        return true;
+    });
 
-    if (_count >= count)
+    if (taken)
     {
-        _count -= count;
+        if (queued)
+        {
+            lock.unlock();
+            queued();
+            lock.lock();
+        }
         return B_OK;
     }
 
-    return B_WOULD_BLOCK;
-}
+    Waiter waiter;
+    waiter.tid = tid;
+    waiter.count = count;
+    waiter.flags = flags & (B_CAN_INTERRUPT | B_KILL_CAN_INTERRUPT);
+    auto it = _waiters.insert(_waiters.end(), &waiter);
 
-int Semaphore::TryAcquireFor(int tid, int count, int64_t timeout)
-{
-    std::unique_lock<std::mutex> lock(_countLock);
+    if (queued)
+    {
+        // Whatever queued wakes up can only act once we are in line.
+        lock.unlock();
+        queued();
+        lock.lock();
+    }
 
-    ++_waitCount;
+    // Interrupts that came in before we got in line have found nobody to interrupt.
+    if (!waiter.done && (flags & B_CAN_INTERRUPT) && interrupted && interrupted())
+    {
+        _FailWaiter(it, B_INTERRUPTED);
+    }
 
     server_worker_run_wait([&]()
     {
-        _countCondVar.wait_for(lock, std::chrono::microseconds(timeout), [&]()
+        if (deadline == std::chrono::steady_clock::time_point::max())
         {
-            return !_registered || _count >= count;
-        });
+            waiter.condition.wait(lock, [&]() { return waiter.done; });
+        }
+        else
+        {
+            waiter.condition.wait_until(lock, deadline, [&]() { return waiter.done; });
+        }
     });
 
-    --_waitCount;
+    if (!waiter.done)
+    {
+        _FailWaiter(it, B_TIMED_OUT);
+    }
 
-    if (!_registered)
+    return waiter.status;
+}
+
+void Semaphore::_FailWaiter(std::list<Waiter*>::iterator it, int status)
+{
+    Waiter* waiter = *it;
+
+    bool wasFirst = it == _waiters.begin();
+    _waiters.erase(it);
+    _UpdateState([&](int32_t& available, uint32_t& waiters)
     {
-        return B_BAD_SEM_ID;
+        --waiters;
+        return true;
+    });
+
+    waiter->done = true;
+    waiter->status = status;
+    waiter->condition.notify_one();
+
+    // Whoever waited behind it might be satisfied now.
+    if (wasFirst)
+    {
+        _GrantWaiters();
     }
+}
 
-    if (_count < count)
+void Semaphore::_GrantWaiters()
+{
+    while (!_waiters.empty())
     {
-        return timeout == 0 ? B_WOULD_BLOCK : B_TIMED_OUT;
+        Waiter* waiter = _waiters.front();
+
+        bool granted = _UpdateState([&](int32_t& available, uint32_t& waiters)
+        {
+            if (available < waiter->count)
+            {
+                return false;
+            }
+            available -= waiter->count;
+            --waiters;
+            return true;
+        });
+
+        if (!granted)
+        {
+            break;
+        }
+
+        _waiters.pop_front();
+        waiter->done = true;
+        waiter->status = B_OK;
+        waiter->condition.notify_one();
     }
+}
 
-    _count -= count;
-    return B_OK;
+int Semaphore::Acquire(int tid, int count)
+{
+    std::unique_lock<std::mutex> lock(_countLock);
+    return _Acquire(lock, tid, count, std::chrono::steady_clock::time_point::max());
 }
 
-int Semaphore::TryAcquireUntil(int tid, int count, int64_t timestamp)
+int Semaphore::TryAcquire(int tid, int count)
 {
     std::unique_lock<std::mutex> lock(_countLock);
 
-    if (_count >= count)
+    bool taken = _UpdateState([&](int32_t& available, uint32_t& waiters)
     {
-        _count -= count;
-        return B_OK;
-    }
+        if (waiters > 0 || available < count)
+        {
+            return false;
+        }
+        available -= count;
+        return true;
+    });
 
-    ++_waitCount;
+    return taken ? B_OK : B_WOULD_BLOCK;
+}
 
-    server_worker_run_wait([&]()
+int Semaphore::AcquireEtc(int tid, int count, uint32 flags, int64_t timeout,
+    const std::function<void()>& queued, const std::function<bool()>& interrupted)
+{
+    std::unique_lock<std::mutex> lock(_countLock);
+
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    if ((flags & B_RELATIVE_TIMEOUT) && !server_is_infinite_timeout(timeout, flags))
     {
-        _countCondVar.wait_until(lock,
-            std::chrono::steady_clock::time_point(std::chrono::microseconds(timestamp)), [&]()
+        if (timeout <= 0)
         {
-            return !_registered || _count >= count;
-        });
-    });
-
-    --_waitCount;
+            bool taken = _UpdateState([&](int32_t& available, uint32_t& waiters)
+            {
+                if (waiters > 0 || available < count)
+                {
+                    return false;
+                }
+                available -= count;
+                return true;
+            });
+
+            if (!taken)
+            {
+                return _registered ? B_WOULD_BLOCK : B_BAD_SEM_ID;
+            }
+
+            if (queued)
+            {
+                lock.unlock();
+                queued();
+            }
+            return B_OK;
+        }
 
-    if (!_registered)
+        deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout);
+    }
+    else if ((flags & B_ABSOLUTE_TIMEOUT) && !server_is_infinite_timeout(timeout, flags))
     {
-        return B_BAD_SEM_ID;
+        deadline = std::chrono::steady_clock::time_point(std::chrono::microseconds(timeout));
     }
 
-    if (_count < count)
+    return _Acquire(lock, tid, count, deadline, flags, queued, interrupted);
+}
+
+void Semaphore::Interrupt(int tid, bool kill)
+{
+    std::unique_lock<std::mutex> lock(_countLock);
+
+    for (auto it = _waiters.begin(); it != _waiters.end(); ++it)
     {
-        return B_TIMED_OUT;
-    }
+        Waiter* waiter = *it;
+        if (waiter->tid != tid)
+        {
+            continue;
+        }
 
-    _count -= count;
-    return B_OK;
+        if ((waiter->flags & B_CAN_INTERRUPT) || (kill && (waiter->flags & B_KILL_CAN_INTERRUPT)))
+        {
+            _FailWaiter(it, B_INTERRUPTED);
+        }
+        return;
+    }
 }
 
-void Semaphore::Release(int count)
+void Semaphore::Release(int count, uint32 flags)
 {
     std::unique_lock<std::mutex> lock(_countLock);
-    _count += count;
-    _countCondVar.notify_all();
+
+    if ((flags & B_RELEASE_IF_WAITING_ONLY) && _waiters.empty())
+    {
+        return;
+    }
+
+    if (flags & B_RELEASE_ALL)
+    {
+        // Just enough for everyone in line, which leaves the count at zero.
+        int64_t needed = 0;
+        for (const Waiter* waiter : _waiters)
+        {
+            needed += waiter->count;
+        }
+        count = (int)std::min<int64_t>(std::max<int64_t>(needed - GetCount(), 0), INT32_MAX);
+    }
+
+    _UpdateState([&](int32_t& available, uint32_t& waiters)
+    {
+        available = (int32_t)std::min<int64_t>((int64_t)available + count, INT32_MAX);
+        return true;
+    });
+
+    _GrantWaiters();
 }
 
 int Semaphore::GetSemCount()
 {
     std::unique_lock<std::mutex> lock(_countLock);
 
-    if (_count >= 0)
+    uint64_t state = __atomic_load_n(_state, __ATOMIC_ACQUIRE);
+
+    if (sem_state_waiters(state) == 0)
     {
-        return _count;
+        return sem_state_count(state);
     }
 
-    return -_waitCount;
+    return -(int)sem_state_waiters(state);
 }
 
 intptr_t server_hserver_call_create_sem(hserver_context& context, int count, const char* userName, size_t nameLength)
@@ -218,8 +430,6 @@ intptr_t server_hserver_call_acquire_sem(hserver_context& context, int id)
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         sem = system.GetSemaphore(id).lock();
     }
 
@@ -231,6 +441,45 @@ intptr_t server_hserver_call_acquire_sem(hserver_context& context, int id)
     return sem->Acquire(context.tid, 1);
 }
 
+static bool server_is_valid_acquire_flags(unsigned int flags)
+{
+    if (flags & ~(B_CAN_INTERRUPT | B_KILL_CAN_INTERRUPT | B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+    {
+        return false;
+    }
+
+    return (flags & (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+        != (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT);
+}
+
+static intptr_t server_acquire_sem(hserver_context& context, const std::shared_ptr<Semaphore>& sem,
+    unsigned int count, unsigned int flags, unsigned long long timeout,
+    const std::function<void()>& queued = NULL)
+{
+    std::function<bool()> interrupted;
+
+    if (flags & (B_CAN_INTERRUPT | B_KILL_CAN_INTERRUPT))
+    {
+        interrupted = [&]()
+        {
+            return server_is_channel_interrupted(context.conn_id);
+        };
+        context.thread->SetInterruptHandler([sem, tid = context.tid](bool kill)
+        {
+            sem->Interrupt(tid, kill);
+        });
+    }
+
+    int status = sem->AcquireEtc(context.tid, count, flags, timeout, queued, interrupted);
+
+    if (interrupted)
+    {
+        context.thread->SetInterruptHandler(NULL);
+    }
+
+    return status;
+}
+
 intptr_t server_hserver_call_acquire_sem_etc(hserver_context& context, int id, unsigned int count,
     unsigned int flags, unsigned long long timeout)
 {
@@ -238,8 +487,6 @@ intptr_t server_hserver_call_acquire_sem_etc(hserver_context& context, int id, u
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         sem = system.GetSemaphore(id).lock();
     }
 
@@ -253,30 +500,54 @@ intptr_t server_hserver_call_acquire_sem_etc(hserver_context& context, int id, u
         return B_BAD_VALUE;
     }
 
-    if (flags & ~(B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+    if (!server_is_valid_acquire_flags(flags))
     {
         return B_BAD_VALUE;
     }
 
-    if ((flags & (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
-        == (B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT))
+    return server_acquire_sem(context, sem, count, flags, timeout);
+}
+
+intptr_t server_hserver_call_switch_sem_etc(hserver_context& context, int releaseId, int id,
+    unsigned int count, unsigned int flags, unsigned long long timeout)
+{
+    std::shared_ptr<Semaphore> sem;
+    std::shared_ptr<Semaphore> releaseSem;
+
     {
-        return B_BAD_VALUE;
+        auto& system = System::GetInstance();
+        sem = system.GetSemaphore(id).lock();
+        if (releaseId >= 0)
+        {
+            releaseSem = system.GetSemaphore(releaseId).lock();
+        }
     }
 
-    // TODO: Handle this in the Semaphore class.
-    if (flags & B_RELATIVE_TIMEOUT && !server_is_infinite_timeout(timeout, flags))
+    if (!sem)
     {
-        return sem->TryAcquireFor(context.tid, count, timeout);
+        return B_BAD_SEM_ID;
     }
-    else if (flags & B_ABSOLUTE_TIMEOUT && !server_is_infinite_timeout(timeout, flags))
+
+    if (count < 1)
     {
-        return sem->TryAcquireUntil(context.tid, count, timeout);
+        return B_BAD_VALUE;
     }
-    else
+
+    if (!server_is_valid_acquire_flags(flags))
     {
-        return sem->Acquire(context.tid, count);
+        return B_BAD_VALUE;
     }
+
+    // Released only once we hold the count or are in line for it, so that
+    // whoever the release wakes up cannot signal us before we wait.
+    // As on Haiku, failing to release does not fail the call.
+    return server_acquire_sem(context, sem, count, flags, timeout, [&]()
+    {
+        if (releaseSem)
+        {
+            releaseSem->Release(1, B_DO_NOT_RESCHEDULE);
+        }
+    });
 }
 
 intptr_t server_hserver_call_release_sem(hserver_context& context, int id)
@@ -285,8 +556,6 @@ intptr_t server_hserver_call_release_sem(hserver_context& context, int id)
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         sem = system.GetSemaphore(id).lock();
     }
 
@@ -307,8 +576,6 @@ intptr_t server_hserver_call_release_sem_etc(hserver_context& context, int id, u
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         sem = system.GetSemaphore(id).lock();
     }
 
@@ -317,12 +584,19 @@ intptr_t server_hserver_call_release_sem_etc(hserver_context& context, int id, u
         return B_BAD_SEM_ID;
     }
 
-    if (flags & ~(B_DO_NOT_RESCHEDULE))
+    if (flags & ~(B_DO_NOT_RESCHEDULE | B_RELEASE_ALL | B_RELEASE_IF_WAITING_ONLY))
     {
         return B_BAD_VALUE;
     }
 
-    sem->Release(count);
+    if ((int)count < 1 && !(flags & B_RELEASE_ALL))
+    {
+        return B_BAD_VALUE;
+    }
+
+    // Waiters are woken by the server, the caller is never rescheduled
+    // in their favor, so B_DO_NOT_RESCHEDULE needs no extra work.
+    sem->Release(count, flags);
 
     return B_OK;
 }
@@ -333,8 +607,6 @@ intptr_t server_hserver_call_get_sem_count(hserver_context& context, int id, int
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         sem = system.GetSemaphore(id).lock();
     }
 
@@ -356,7 +628,5 @@ intptr_t server_hserver_call_get_sem_count(hserver_context& context, int id, int
 intptr_t server_hserver_call_get_system_sem_count(hserver_context& context)
 {
     auto& system = System::GetInstance();
-    auto lock = system.Lock();
-
     return system.GetSemaphoreCount();
 }
\ No newline at end of file
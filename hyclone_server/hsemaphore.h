@@ -5,35 +5,84 @@
 // conflicts with the system "semaphore.h" header.
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <list>
 #include <mutex>
 
+#include "haiku_errors.h"
 #include "haiku_sem.h"
+#include "sem_table.h"
 
 class Semaphore
 {
     friend class System;
 private:
+    // A thread waiting in line. Lives on the waiting thread's stack.
+    struct Waiter
+    {
+        int tid;
+        int count;
+        // B_CAN_INTERRUPT and B_KILL_CAN_INTERRUPT.
+        uint32 flags;
+        // Set once the waiter leaves the queue.
+        bool done = false;
+        int status = B_OK;
+        std::condition_variable condition;
+    };
+
     haiku_sem_info _info;
-    std::condition_variable _countCondVar;
     std::mutex _countLock;
-    std::atomic<int> _count = 0;
+    // Served in FIFO order. Guarded by _countLock.
+    std::list<Waiter*> _waiters;
+    // The count and the number of waiters, packed as in the shared
+    // semaphore table. Points into the table while registered, if the
+    // ID fits. Teams may change it directly while nobody is waiting.
+    uint64_t* _state;
+    uint64_t _privateState;
     std::atomic<bool> _registered = false;
-    int _waitCount = 0;
+
+    void _Register(int id);
+    void _Unregister();
+
+    // Calls update with the count and waiter count until the state could be
+    // replaced, or until update returns false. Called with _countLock held.
+    template <typename Function>
+    bool _UpdateState(Function&& update);
+    // Takes count if nobody is waiting, otherwise gets in line and waits
+    // until the deadline. Called with _countLock held.
+    // Once the count has been taken or the thread is in line, queued is called
+    // without the lock. A wait that may be interrupted by signals ends as soon
+    // as interrupted returns true.
+    int _Acquire(std::unique_lock<std::mutex>& lock, int tid, int count,
+        std::chrono::steady_clock::time_point deadline, uint32 flags = 0,
+        const std::function<void()>& queued = NULL,
+        const std::function<bool()>& interrupted = NULL);
+    // Takes a waiter out of line and wakes it with status.
+    void _FailWaiter(std::list<Waiter*>::iterator it, int status);
+    // Hands counts to the waiters at the front of the queue, for as long as
+    // there are enough of them, and wakes those waiters.
+    void _GrantWaiters();
 public:
     Semaphore(int pid, int count, const char* name);
     ~Semaphore() = default;
 
-    int GetCount() const { return _info.count; }
+    int GetCount() const { return sem_state_count(__atomic_load_n(_state, __ATOMIC_RELAXED)); }
     int GetId() const { return _info.sem; }
     const char* GetName() const { return _info.name; }
     int GetOwningTeam() const { return _info.team; }
 
     int Acquire(int tid, int count);
     int TryAcquire(int tid, int count);
-    int TryAcquireFor(int tid, int count, int64_t timeout);
-    int TryAcquireUntil(int tid, int count, int64_t timestamp);
-    void Release(int count);
+    // Acquires with the flags and timeout of acquire_sem_etc.
+    int AcquireEtc(int tid, int count, uint32 flags, int64_t timeout,
+        const std::function<void()>& queued = NULL,
+        const std::function<bool()>& interrupted = NULL);
+    // Interrupts the acquisition tid is waiting for, if it may be interrupted.
+    // kill is set when the thread is going away.
+    void Interrupt(int tid, bool kill);
+    void Release(int count, uint32 flags = 0);
 
     int GetSemCount();
 };
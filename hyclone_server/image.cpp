@@ -67,7 +67,6 @@ intptr_t server_hserver_call_get_next_image_info(hserver_context& context,
     std::shared_ptr<Process> targetProcess;
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         targetProcess = system.GetProcess(target_pid).lock();
     }
 
@@ -0,0 +1,242 @@
+#ifndef __HYCLONE_INTERVAL_INDEX_H__
+#define __HYCLONE_INTERVAL_INDEX_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Address ranges [start, end) ordered by start, each node augmented with the
+// largest end in its subtree, so that point and range queries are O(log n).
+// Ranges may overlap.
+template <typename id_t = int>
+class IntervalIndex
+{
+private:
+    struct Node
+    {
+        uintptr_t start;
+        uintptr_t end;
+        id_t id;
+        uintptr_t maxEnd;
+        int height = 1;
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+
+        Node(uintptr_t start_, uintptr_t end_, id_t id_)
+            : start(start_), end(end_), id(id_), maxEnd(end_) { }
+
+        bool Less(uintptr_t otherStart, id_t otherId) const
+        {
+            return start < otherStart || (start == otherStart && id < otherId);
+        }
+    };
+
+    std::unique_ptr<Node> _root;
+    std::unordered_map<id_t, std::pair<uintptr_t, uintptr_t>> _ranges;
+
+    static int _Height(const std::unique_ptr<Node>& node) { return node ? node->height : 0; }
+
+    static void _Update(Node* node)
+    {
+        node->height = 1 + std::max(_Height(node->left), _Height(node->right));
+        node->maxEnd = node->end;
+        if (node->left)
+            node->maxEnd = std::max(node->maxEnd, node->left->maxEnd);
+        if (node->right)
+            node->maxEnd = std::max(node->maxEnd, node->right->maxEnd);
+    }
+
+    static void _RotateLeft(std::unique_ptr<Node>& node)
+    {
+        std::unique_ptr<Node> right = std::move(node->right);
+        node->right = std::move(right->left);
+        _Update(node.get());
+        right->left = std::move(node);
+        node = std::move(right);
+        _Update(node.get());
+    }
+
+    static void _RotateRight(std::unique_ptr<Node>& node)
+    {
+        std::unique_ptr<Node> left = std::move(node->left);
+        node->left = std::move(left->right);
+        _Update(node.get());
+        left->right = std::move(node);
+        node = std::move(left);
+        _Update(node.get());
+    }
+
+    static void _Balance(std::unique_ptr<Node>& node)
+    {
+        _Update(node.get());
+        int balance = _Height(node->left) - _Height(node->right);
+        if (balance > 1)
+        {
+            if (_Height(node->left->left) < _Height(node->left->right))
+                _RotateLeft(node->left);
+            _RotateRight(node);
+        }
+        else if (balance < -1)
+        {
+            if (_Height(node->right->right) < _Height(node->right->left))
+                _RotateRight(node->right);
+            _RotateLeft(node);
+        }
+    }
+
+    static void _Insert(std::unique_ptr<Node>& node, std::unique_ptr<Node>&& newNode)
+    {
+        if (!node)
+        {
+            node = std::move(newNode);
+            return;
+        }
+        if (newNode->Less(node->start, node->id))
+            _Insert(node->left, std::move(newNode));
+        else
+            _Insert(node->right, std::move(newNode));
+        _Balance(node);
+    }
+
+    static std::unique_ptr<Node> _TakeMin(std::unique_ptr<Node>& node)
+    {
+        if (!node->left)
+        {
+            std::unique_ptr<Node> min = std::move(node);
+            node = std::move(min->right);
+            return min;
+        }
+        std::unique_ptr<Node> min = _TakeMin(node->left);
+        _Balance(node);
+        return min;
+    }
+
+    static void _Remove(std::unique_ptr<Node>& node, uintptr_t start, id_t id)
+    {
+        if (!node)
+            return;
+        if (node->start == start && node->id == id)
+        {
+            if (!node->left || !node->right)
+            {
+                node = std::move(node->left ? node->left : node->right);
+                return;
+            }
+            std::unique_ptr<Node> successor = _TakeMin(node->right);
+            successor->left = std::move(node->left);
+            successor->right = std::move(node->right);
+            node = std::move(successor);
+        }
+        else if (node->Less(start, id))
+        {
+            _Remove(node->right, start, id);
+        }
+        else
+        {
+            _Remove(node->left, start, id);
+        }
+        _Balance(node);
+    }
+
+    static void _FindOverlapping(const Node* node, uintptr_t start, uintptr_t end, std::vector<id_t>& result)
+    {
+        // Nothing below ends after start.
+        if (node == NULL || node->maxEnd <= start)
+            return;
+        _FindOverlapping(node->left.get(), start, end, result);
+        // Nodes to the right start even later.
+        if (node->start >= end)
+            return;
+        if (node->end > start)
+            result.push_back(node->id);
+        _FindOverlapping(node->right.get(), start, end, result);
+    }
+public:
+    IntervalIndex() = default;
+    IntervalIndex(IntervalIndex&&) = default;
+    IntervalIndex& operator=(IntervalIndex&&) = default;
+    ~IntervalIndex() = default;
+
+    // Adds the range, or moves it if id is already known.
+    void Set(id_t id, uintptr_t start, size_t size)
+    {
+        Remove(id);
+        _Insert(_root, std::make_unique<Node>(start, start + size, id));
+        _ranges[id] = { start, start + size };
+    }
+
+    void Remove(id_t id)
+    {
+        auto it = _ranges.find(id);
+        if (it == _ranges.end())
+            return;
+        _Remove(_root, it->second.first, id);
+        _ranges.erase(it);
+    }
+
+    void Clear()
+    {
+        _root.reset();
+        _ranges.clear();
+    }
+
+    size_t Size() const { return _ranges.size(); }
+
+    // Returns a range containing address.
+    bool Find(uintptr_t address, id_t& id) const
+    {
+        const Node* node = _root.get();
+        while (node != NULL)
+        {
+            if (node->start <= address && address < node->end)
+            {
+                id = node->id;
+                return true;
+            }
+            if (node->left && node->left->maxEnd > address)
+                node = node->left.get();
+            else if (node->start <= address)
+                node = node->right.get();
+            else
+                break;
+        }
+        return false;
+    }
+
+    // Returns the range that starts first after address.
+    bool FindNext(uintptr_t address, id_t& id) const
+    {
+        const Node* node = _root.get();
+        const Node* found = NULL;
+        while (node != NULL)
+        {
+            if (node->start > address)
+            {
+                found = node;
+                node = node->left.get();
+            }
+            else
+            {
+                node = node->right.get();
+            }
+        }
+        if (found == NULL)
+            return false;
+        id = found->id;
+        return true;
+    }
+
+    // Returns the ranges overlapping [start, start + size), ordered by start.
+    std::vector<id_t> FindOverlapping(uintptr_t start, size_t size) const
+    {
+        std::vector<id_t> result;
+        _FindOverlapping(_root.get(), start, start + size, result);
+        return result;
+    }
+};
+
+#endif // __HYCLONE_INTERVAL_INDEX_H__
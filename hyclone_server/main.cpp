@@ -1,20 +1,16 @@
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
-#include <thread>
 
 #include "server_filesystem.h"
 #include "server_main.h"
 #include "server_memory.h"
 #include "server_prefix.h"
 #include "server_usermap.h"
-#include "server_workers.h"
 #include "system.h"
 
 int main(int argc, char** argv)
 {
-    // Just in case.
-    server_remaining_workers = std::thread::hardware_concurrency();
     if (!server_init_prefix())
     {
         std::cerr << "failed to initialize hyclone prefix." << std::endl;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
@@ -8,14 +9,14 @@
 #include "haiku_errors.h"
 #include "port.h"
 #include "process.h"
+#include "server_memory.h"
 #include "server_native.h"
 #include "server_servercalls.h"
+#include "server_systemtime.h"
 #include "server_time.h"
 #include "server_workers.h"
 #include "system.h"
 
-const int kSleepTimeMicroseconds = 100 * 1000; // 100ms, in microseconds.
-
 Port::Port(int pid, int capacity, const char* name)
 {
     _info.capacity = capacity;
@@ -25,153 +26,526 @@ Port::Port(int pid, int capacity, const char* name)
     _info.queue_count = 0;
     _info.total_count = 0;
     _info.port = 0;
+
+    _CreateRing();
 }
 
-status_t Port::Write(Message&& message, bigtime_t timeout)
+Port::~Port()
 {
-    message.info.size = message.data.size();
+    if (_ring != NULL)
+    {
+        server_unmap_memory(_ring, _ringSize);
+    }
+    int64_t ringId = _ringId.exchange(-1);
+    if (ringId != -1)
+    {
+        server_remove_shared_file(GetRingName(ringId).c_str());
+    }
+}
+
+std::string Port::GetRingName(int64_t ringId)
+{
+    return PORT_RING_FILE_PREFIX + std::to_string(ringId);
+}
 
-    std::unique_lock<std::mutex> lock(_messagesLock);
+bool Port::_CreateRing()
+{
+    static std::atomic<int64_t> sNextRingId = 0;
 
-    if (_info.queue_count == _info.capacity)
+    int64_t ringId = sNextRingId.fetch_add(1, std::memory_order_relaxed);
+    auto name = GetRingName(ringId);
+    size_t size = port_ring_size(_info.capacity);
+
+    intptr_t handle = server_open_shared_file(name.c_str(), size, true);
+    if (handle < 0)
     {
-        if (timeout == 0)
+        return false;
+    }
+
+    _ring = (port_ring*)server_map_memory(handle, size, 0, true);
+    server_close_file(handle);
+
+    if (_ring == NULL)
+    {
+        server_remove_shared_file(name.c_str());
+        return false;
+    }
+
+    _ringSize = size;
+    _ringId = ringId;
+    port_ring_init(_ring, _info.capacity);
+
+    return true;
+}
+
+void Port::_Unregister()
+{
+    {
+        PortRingLock ringLock = _RingLock();
+        std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+        // The port goes away even if a team keeps the ring locked.
+        _LockRing(lock, B_INFINITE_TIMEOUT);
+
+        _registered = false;
+        __atomic_or_fetch(&_ring->flags, PORT_RING_DELETED, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&_ring->readSequence, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&_ring->writeSequence, 1, __ATOMIC_RELEASE);
+    }
+
+    server_futex_wake(&_ring->readSequence, INT32_MAX);
+    server_futex_wake(&_ring->writeSequence, INT32_MAX);
+
+    // Teams that already mapped the ring keep it until they notice the flag.
+    int64_t ringId = _ringId.exchange(-1);
+    if (ringId != -1)
+    {
+        server_remove_shared_file(GetRingName(ringId).c_str());
+    }
+}
+
+// Teams only hold the ring lock while copying a message. One that holds it
+// for longer is stopped or misbehaving, so the server does not wait for it forever.
+static const bigtime_t kRingLockTimeout = 1000000;
+
+status_t Port::_LockRing(std::unique_lock<PortRingLock>& lock, bigtime_t deadline)
+{
+    if (!lock.try_lock())
+    {
+        bigtime_t now = server_system_time();
+        bool useDeadline = deadline != B_INFINITE_TIMEOUT && deadline < now + kRingLockTimeout;
+        bigtime_t timeout = useDeadline ? deadline - now : kRingLockTimeout;
+
+        if (timeout <= 0)
         {
             return B_WOULD_BLOCK;
         }
 
+        bool locked = false;
         server_worker_run_wait([&]()
         {
-            const auto writableOrDead = [&]()
-            {
-                return !_registered || _closed || _info.queue_count < _info.capacity;
-            };
-
-            if (!server_is_infinite_timeout(timeout))
-            {
-                _writeCondVar.wait_for(lock, std::chrono::microseconds(timeout), writableOrDead);
-                return;
-            }
-            else
-            {
-                _writeCondVar.wait(lock, writableOrDead);
-            }
+            locked = lock.try_lock_for(std::chrono::microseconds(timeout));
         });
+
+        if (!locked)
+        {
+            return useDeadline ? B_TIMED_OUT : B_ERROR;
+        }
     }
 
-    if (!_registered || _closed)
+    // A team that died holding the lock may have dropped the queue.
+    if (_ring->generation != _ringGeneration)
     {
-        return B_BAD_PORT_ID;
+        _ringGeneration = _ring->generation;
+        _externalMessages = {};
     }
 
-    if (_info.queue_count == _info.capacity)
+    return B_OK;
+}
+
+status_t Port::_Wait(std::unique_lock<PortRingLock>& lock, uint32_t* sequence, uint32_t* waiters,
+    bigtime_t deadline)
+{
+    int64_t timeout = -1;
+    if (deadline != B_INFINITE_TIMEOUT)
     {
-        return B_TIMED_OUT;
+        timeout = deadline - server_system_time();
+        if (timeout <= 0)
+        {
+            return B_TIMED_OUT;
+        }
     }
 
-    _messages.emplace(std::move(message));
-    ++_info.queue_count;
+    uint32_t value = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+    ++*waiters;
+    lock.unlock();
+
+    server_worker_run_wait([&]()
+    {
+        server_futex_wait(sequence, value, timeout);
+    });
+
+    status_t status = _LockRing(lock, B_INFINITE_TIMEOUT);
+    if (status != B_OK)
+    {
+        __atomic_sub_fetch(waiters, 1, __ATOMIC_RELAXED);
+        return status;
+    }
 
-    _readCondVar.notify_one();
+    --*waiters;
 
     return B_OK;
 }
 
-status_t Port::Read(Message& message, bigtime_t timeout)
+status_t Port::_WaitForMessage(std::unique_lock<PortRingLock>& lock, bigtime_t timeout,
+    port_ring_slot*& slot, Handoff* handoff)
 {
-    std::unique_lock<std::mutex> lock(_messagesLock);
+    bigtime_t deadline = server_is_infinite_timeout(timeout) ?
+        B_INFINITE_TIMEOUT : server_system_time() + timeout;
+    bool queued = false;
 
-    if (_info.queue_count == 0)
+    status_t status = _LockRing(lock, deadline);
+
+    while (status == B_OK)
     {
-        if (timeout == 0)
+        if (queued && handoff->claimed)
         {
-            return B_WOULD_BLOCK;
+            break;
         }
 
-        server_worker_run_wait([&]()
+        if (!_registered)
+        {
+            status = B_BAD_PORT_ID;
+        }
+        else if (!port_ring_is_valid(_ring, _info.capacity))
+        {
+            status = B_ERROR;
+        }
+        else if (_ring->count > 0)
+        {
+            break;
+        }
+        else if (timeout == 0)
         {
-            const auto readableOrDead = [&]()
+            status = B_WOULD_BLOCK;
+        }
+        else
+        {
+            if (handoff != NULL && !queued)
             {
-                return !_registered || _info.queue_count > 0;
-            };
+                auto handoffLock = std::unique_lock(_handoffLock);
+                _handoffs.push_back(handoff);
+                queued = true;
+            }
+
+            status = _Wait(lock, &_ring->readSequence, &_ring->readWaiters, deadline);
+        }
+    }
 
-            if (!server_is_infinite_timeout(timeout))
+    if (queued)
+    {
+        auto handoffLock = std::unique_lock(_handoffLock);
+        if (handoff->claimed)
+        {
+            handoffLock.unlock();
+            if (lock.owns_lock())
             {
-                _readCondVar.wait_for(lock, std::chrono::microseconds(timeout), readableOrDead);
-                return;
+                lock.unlock();
             }
-            else
+
+            // A writer is copying the message, the call cannot fail anymore.
+            server_worker_run_wait([&]()
             {
-                _readCondVar.wait(lock, readableOrDead);
-            }
-        });
+                while (true)
+                {
+                    uint32_t value = __atomic_load_n(&_ring->readSequence, __ATOMIC_ACQUIRE);
+                    if (handoff->done)
+                    {
+                        break;
+                    }
+                    server_futex_wait(&_ring->readSequence, value, -1);
+                }
+            });
+
+            slot = NULL;
+            return B_OK;
+        }
+        _handoffs.remove(handoff);
     }
 
-    if (!_registered)
+    if (status != B_OK)
     {
-        return B_BAD_PORT_ID;
+        return status;
+    }
+
+    slot = port_ring_slot_at(_ring, _info.capacity, _ring->head);
+
+    if (!port_ring_slot_is_valid(slot))
+    {
+        return B_ERROR;
+    }
+
+    return B_OK;
+}
+
+status_t Port::Write(Message&& message, bigtime_t timeout)
+{
+    message.info.size = message.data.size();
+
+    bigtime_t deadline = server_is_infinite_timeout(timeout) ?
+        B_INFINITE_TIMEOUT : server_system_time() + timeout;
+
+    PortRingLock ringLock = _RingLock();
+    std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+
+    status_t status = _LockRing(lock, deadline);
+    if (status != B_OK)
+    {
+        return status;
+    }
+
+    while (true)
+    {
+        if (!_registered || _closed)
+        {
+            return B_BAD_PORT_ID;
+        }
+
+        if (!port_ring_is_valid(_ring, _info.capacity))
+        {
+            return B_ERROR;
+        }
+
+        if (_ring->count < _info.capacity)
+        {
+            break;
+        }
+
+        if (timeout == 0)
+        {
+            return B_WOULD_BLOCK;
+        }
+
+        status = _Wait(lock, &_ring->writeSequence, &_ring->writeWaiters, deadline);
+        if (status != B_OK)
+        {
+            return status;
+        }
     }
 
-    if (_info.queue_count == 0)
+    port_ring_slot slot;
+    memset(&slot, 0, sizeof(slot));
+    slot.code = message.code;
+    slot.info = message.info;
+
+    if (port_ring_find_space(_ring, message.data.size(), slot.offset, slot.reserved))
+    {
+        memcpy(port_ring_data(_ring, _info.capacity) + slot.offset,
+            message.data.data(), message.data.size());
+    }
+    else
     {
-        return B_TIMED_OUT;
+        slot.flags = PORT_RING_SLOT_EXTERNAL;
+        _externalMessages.emplace(std::move(message));
     }
 
-    --_info.queue_count;
-    ++_info.total_count;
+    port_ring_commit_push(_ring, _info.capacity, slot);
 
-    message = std::move(_messages.front());
-    _messages.pop();
+    bool wakeReaders = _ring->readWaiters > 0;
+    lock.unlock();
 
-    _writeCondVar.notify_one();
+    if (wakeReaders)
+    {
+        // Peeking readers do not consume the message, so wake everyone.
+        server_futex_wake(&_ring->readSequence, INT32_MAX);
+    }
 
     return B_OK;
 }
 
-status_t Port::GetMessageInfo(haiku_port_message_info& info, bigtime_t timeout)
+status_t Port::Read(Message& message, bigtime_t timeout, Handoff* handoff)
 {
-    std::unique_lock<std::mutex> lock(_messagesLock);
+    PortRingLock ringLock = _RingLock();
+    std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+
+    port_ring_slot* slot;
+    status_t status = _WaitForMessage(lock, timeout, slot, handoff);
 
-    if (_info.queue_count == 0)
+    if (status != B_OK || slot == NULL)
     {
-        if (timeout == 0)
+        return status;
+    }
+
+    if (slot->flags & PORT_RING_SLOT_EXTERNAL)
+    {
+        if (_externalMessages.empty())
         {
-            return B_WOULD_BLOCK;
+            return B_ERROR;
         }
+        message = std::move(_externalMessages.front());
+        _externalMessages.pop();
+    }
+    else
+    {
+        const char* data = port_ring_data(_ring, _info.capacity) + slot->offset;
+        message.data.assign(data, slot->info.size);
+        message.info = slot->info;
+        message.code = slot->code;
+    }
 
-        server_worker_run_wait([&]()
+    port_ring_commit_pop(_ring, _info.capacity);
+
+    bool wakeWriter = _ring->writeWaiters > 0;
+    lock.unlock();
+
+    if (wakeWriter)
+    {
+        server_futex_wake(&_ring->writeSequence, 1);
+    }
+
+    return B_OK;
+}
+
+status_t Port::ReadMultiple(PortMessageData& output, size_t bufferSize, int maxCount,
+    bigtime_t timeout, int& count)
+{
+    PortRingLock ringLock = _RingLock();
+    std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+
+    port_ring_slot* slot;
+    status_t status = _WaitForMessage(lock, timeout, slot);
+
+    if (status != B_OK)
+    {
+        return status;
+    }
+
+    size_t size = 0;
+    size_t end = 0;
+    count = 0;
+
+    while (count < maxCount && count < _ring->count)
+    {
+        slot = port_ring_slot_at(_ring, _info.capacity, _ring->head + count);
+        if (!port_ring_slot_is_valid(slot))
         {
-            const auto readableOrDead = [&]()
-            {
-                return !_registered || _info.queue_count > 0;
-            };
+            return B_ERROR;
+        }
 
-            if (!server_is_infinite_timeout(timeout))
-            {
-                _readCondVar.wait_for(lock, std::chrono::microseconds(timeout), readableOrDead);
-                return;
-            }
-            else
+        if (port_ring_record_end(size, slot->info.size) > bufferSize)
+        {
+            break;
+        }
+
+        end = port_ring_record_end(size, slot->info.size);
+        size = port_ring_next_record(size, slot->info.size);
+        ++count;
+    }
+
+    if (count == 0)
+    {
+        slot = port_ring_slot_at(_ring, _info.capacity, _ring->head);
+        output.resize(sizeof(haiku_port_message_header));
+
+        auto& header = *(haiku_port_message_header*)output.data();
+        header.code = slot->code;
+        header.sender_team = slot->info.sender_team;
+        header.size = slot->info.size;
+
+        return B_BUFFER_OVERFLOW;
+    }
+
+    // The buffers are recycled, so clear the padding.
+    output.resize(end);
+    memset(output.data(), 0, end);
+
+    size_t offset = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        slot = port_ring_slot_at(_ring, _info.capacity, _ring->head);
+
+        auto& header = *(haiku_port_message_header*)(output.data() + offset);
+        header.code = slot->code;
+        header.sender_team = slot->info.sender_team;
+        header.size = slot->info.size;
+
+        char* data = output.data() + offset + sizeof(haiku_port_message_header);
+
+        if (slot->flags & PORT_RING_SLOT_EXTERNAL)
+        {
+            if (_externalMessages.empty())
             {
-                _readCondVar.wait(lock, readableOrDead);
+                return B_ERROR;
             }
-        });
+            const auto& message = _externalMessages.front();
+            memcpy(data, message.data.data(), std::min(message.data.size(), header.size));
+            _externalMessages.pop();
+        }
+        else
+        {
+            memcpy(data, port_ring_data(_ring, _info.capacity) + slot->offset, header.size);
+        }
+
+        offset = port_ring_next_record(offset, header.size);
+        port_ring_commit_pop(_ring, _info.capacity);
     }
 
-    if (!_registered)
+    bool wakeWriters = _ring->writeWaiters > 0;
+    lock.unlock();
+
+    if (wakeWriters)
     {
-        return B_BAD_PORT_ID;
+        server_futex_wake(&_ring->writeSequence, count);
+    }
+
+    return B_OK;
+}
+
+bool Port::HandOff(int code, const haiku_port_message_info& info, const void* data, size_t size)
+{
+    Handoff* handoff;
+
+    {
+        PortRingLock ringLock = _RingLock();
+        std::unique_lock<PortRingLock> lock(ringLock, std::try_to_lock);
+
+        // If the ring is busy, the message is simply queued.
+        if (!lock.owns_lock())
+        {
+            return false;
+        }
+
+        auto handoffLock = std::unique_lock(_handoffLock);
+
+        // Messages already in the queue must be read first.
+        if (_handoffs.empty() || !_registered || _closed
+            || !port_ring_is_valid(_ring, _info.capacity) || _ring->count > 0)
+        {
+            return false;
+        }
+
+        handoff = _handoffs.front();
+        _handoffs.pop_front();
+        handoff->claimed = true;
     }
 
-    if (_info.queue_count == 0)
+    // The reader stays blocked until done is set, so its buffer can be filled
+    // without holding the ring lock.
+    size_t writeSize = std::min(size, handoff->bufferSize);
+    bool delivered = server_write_process_memory_direct(handoff->pid, handoff->buffer, data, writeSize)
+        == writeSize;
+
+    if (delivered)
     {
-        return B_TIMED_OUT;
+        __atomic_add_fetch(&_ring->totalCount, 1, __ATOMIC_RELAXED);
     }
 
-    info = _messages.front().info;
+    handoff->code = code;
+    handoff->size = writeSize;
+    handoff->status = delivered ? B_OK : B_BAD_ADDRESS;
+    // The reader may return as soon as this is set, so handoff must not be touched afterwards.
+    handoff->done = true;
+
+    // Readers sleep on the sequence shared with every reader, so wake them all to reach ours.
+    __atomic_add_fetch(&_ring->readSequence, 1, __ATOMIC_RELEASE);
+    server_futex_wake(&_ring->readSequence, INT32_MAX);
+
+    return delivered;
+}
+
+status_t Port::GetMessageInfo(haiku_port_message_info& info, bigtime_t timeout)
+{
+    PortRingLock ringLock = _RingLock();
+    std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+
+    port_ring_slot* slot;
+    status_t status = _WaitForMessage(lock, timeout, slot);
+
+    if (status != B_OK)
+    {
+        return status;
+    }
 
-    // We haven't read anything, let someone else read it.
-    _readCondVar.notify_one();
+    info = slot->info;
 
     return B_OK;
 }
@@ -183,11 +557,29 @@ status_t Port::Close()
         return B_BAD_PORT_ID;
     }
 
-    _closed = true;
-    _writeCondVar.notify_all();
+    {
+        PortRingLock ringLock = _RingLock();
+        std::unique_lock<PortRingLock> lock(ringLock, std::defer_lock);
+        // The port is closed even if a team keeps the ring locked.
+        _LockRing(lock, B_INFINITE_TIMEOUT);
+
+        _closed = true;
+        __atomic_or_fetch(&_ring->flags, PORT_RING_CLOSED, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&_ring->writeSequence, 1, __ATOMIC_RELEASE);
+    }
+
+    server_futex_wake(&_ring->writeSequence, INT32_MAX);
     return B_OK;
 }
 
+haiku_port_info Port::GetInfo() const
+{
+    haiku_port_info info = _info;
+    info.queue_count = __atomic_load_n(&_ring->count, __ATOMIC_RELAXED);
+    info.total_count = __atomic_load_n(&_ring->totalCount, __ATOMIC_RELAXED);
+    return info;
+}
+
 intptr_t server_hserver_call_create_port(hserver_context& context, int32 queue_length, const char *name, size_t portNameLength)
 {
     if (queue_length < 1 || queue_length > HAIKU_PORT_MAX_QUEUE_LENGTH)
@@ -201,6 +593,10 @@ intptr_t server_hserver_call_create_port(hserver_context& context, int32 queue_l
         return B_BAD_ADDRESS;
     }
     auto newPort = std::make_shared<Port>(context.pid, queue_length, buffer.c_str());
+    if (!newPort->IsValid())
+    {
+        return B_NO_MEMORY;
+    }
 
     int id;
 
@@ -226,8 +622,6 @@ intptr_t server_hserver_call_close_port(hserver_context& context, int portId)
     std::shared_ptr<Port> port;
 
     {
-        auto lock = system.Lock();
-
         port = system.GetPort(portId).lock();
         if (!port)
         {
@@ -249,8 +643,6 @@ intptr_t server_hserver_call_delete_port(hserver_context& context, int portId)
     std::shared_ptr<Process> owner;
 
     {
-        auto lock = system.Lock();
-
         port = system.GetPort(portId).lock();
         if (!port)
         {
@@ -271,7 +663,6 @@ intptr_t server_hserver_call_delete_port(hserver_context& context, int portId)
     }
 
     {
-        auto lock = system.Lock();
         system.UnregisterPort(portId);
     }
     return B_OK;
@@ -287,8 +678,6 @@ intptr_t server_hserver_call_find_port(hserver_context& context, const char *por
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         int result = system.FindPort(buffer);
 
         if (result < 0)
@@ -306,8 +695,6 @@ intptr_t server_hserver_call_get_port_info(hserver_context& context, port_id id,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         port = system.GetPort(id).lock();
     }
 
@@ -316,9 +703,11 @@ intptr_t server_hserver_call_get_port_info(hserver_context& context, port_id id,
         return B_BAD_PORT_ID;
     }
 
+    haiku_port_info portInfo = port->GetInfo();
+
     {
         auto lock = context.process->Lock();
-        if (server_write_process_memory(context.pid, info, &port->GetInfo(), sizeof(haiku_port_info))
+        if (server_write_process_memory(context.pid, info, &portInfo, sizeof(haiku_port_info))
             != sizeof(haiku_port_info))
         {
             return B_BAD_ADDRESS;
@@ -328,14 +717,35 @@ intptr_t server_hserver_call_get_port_info(hserver_context& context, port_id id,
     }
 }
 
+intptr_t server_hserver_call_get_port_ring(hserver_context& context, port_id id)
+{
+    std::shared_ptr<Port> port;
+
+    {
+        auto& system = System::GetInstance();
+        port = system.GetPort(id).lock();
+    }
+
+    if (!port)
+    {
+        return B_BAD_PORT_ID;
+    }
+
+    int64_t ringId = port->GetRingId();
+    if (ringId < 0)
+    {
+        return B_BAD_PORT_ID;
+    }
+
+    return ringId;
+}
+
 intptr_t server_hserver_call_get_next_port_info(hserver_context& context, int team, int* userCookie, void* info)
 {
     std::shared_ptr<Process> targetProcess;
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         targetProcess = system.GetProcess(team).lock();
     }
 
@@ -381,8 +791,6 @@ intptr_t server_hserver_call_get_next_port_info(hserver_context& context, int te
 
             {
                 auto& system = System::GetInstance();
-                auto sysLock = system.Lock();
-
                 port = system.GetPort(*it).lock();
             }
 
@@ -422,8 +830,6 @@ intptr_t server_hserver_call_port_count(hserver_context& context, port_id id)
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         port = system.GetPort(id).lock();
     }
 
@@ -442,7 +848,6 @@ intptr_t server_hserver_call_port_buffer_size_etc(hserver_context& context, port
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         port = system.GetPort(id).lock();
     }
 
@@ -471,8 +876,6 @@ intptr_t server_hserver_call_set_port_owner(hserver_context& context, port_id id
     std::shared_ptr<Process> newOwner;
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         port = system.GetPort(id).lock();
 
         if (!port)
@@ -517,7 +920,6 @@ intptr_t server_hserver_call_write_port_etc(hserver_context& context, port_id id
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         port = system.GetPort(id).lock();
     }
 
@@ -545,6 +947,11 @@ intptr_t server_hserver_call_write_port_etc(hserver_context& context, port_id id
         return B_BAD_ADDRESS;
     }
 
+    if (port->HandOff(messageCode, message.info, message.data.data(), bufferSize))
+    {
+        return B_OK;
+    }
+
     bool useTimeout = flags & B_TIMEOUT;
 
     return port->Write(std::move(message), useTimeout ? timeout : B_INFINITE_TIMEOUT);
@@ -558,7 +965,6 @@ intptr_t server_hserver_call_read_port_etc(hserver_context& context,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         port = system.GetPort(id).lock();
     }
 
@@ -568,16 +974,33 @@ intptr_t server_hserver_call_read_port_etc(hserver_context& context,
     }
 
     Port::Message message;
+    Port::Handoff handoff = { context.pid, msgBuffer, bufferSize };
 
     bool useTimeout = flags & B_TIMEOUT;
 
-    status_t status = port->Read(message, useTimeout ? timeout : B_INFINITE_TIMEOUT);
+    status_t status = port->Read(message, useTimeout ? timeout : B_INFINITE_TIMEOUT, &handoff);
 
     if (status != B_OK)
     {
         return status;
     }
 
+    if (handoff.done)
+    {
+        if (handoff.status != B_OK)
+        {
+            return handoff.status;
+        }
+
+        if (context.process->WriteMemory(userMessageCode, &handoff.code, sizeof(handoff.code))
+            != sizeof(handoff.code))
+        {
+            return B_BAD_ADDRESS;
+        }
+
+        return handoff.size;
+    }
+
     if (context.process->WriteMemory(userMessageCode, &message.code, sizeof(message.code)) != sizeof(message.code))
     {
         return B_BAD_ADDRESS;
@@ -592,6 +1015,74 @@ intptr_t server_hserver_call_read_port_etc(hserver_context& context,
     return writeSize;
 }
 
+// Returns the number of messages read. firstSize is set to the size of the first message.
+static intptr_t server_read_port_messages(hserver_context& context, port_id id, void* msgBuffer,
+    size_t bufferSize, int maxCount, uint32 flags, unsigned long long timeout, size_t& firstSize)
+{
+    if (maxCount < 1 || bufferSize < sizeof(haiku_port_message_header))
+    {
+        return B_BAD_VALUE;
+    }
+
+    std::shared_ptr<Port> port;
+
+    {
+        auto& system = System::GetInstance();
+        port = system.GetPort(id).lock();
+    }
+
+    if (!port)
+    {
+        return B_BAD_PORT_ID;
+    }
+
+    PortMessageData output;
+    int count;
+
+    bool useTimeout = flags & B_TIMEOUT;
+
+    status_t status = port->ReadMultiple(output, bufferSize, maxCount,
+        useTimeout ? timeout : B_INFINITE_TIMEOUT, count);
+
+    if (status != B_OK && status != B_BUFFER_OVERFLOW)
+    {
+        return status;
+    }
+
+    firstSize = ((const haiku_port_message_header*)output.data())->size;
+
+    if (context.process->WriteMemory(msgBuffer, output.data(), output.size()) != output.size())
+    {
+        return B_BAD_ADDRESS;
+    }
+
+    return status == B_OK ? count : status;
+}
+
+intptr_t server_hserver_call_read_port_multiple_etc(hserver_context& context,
+    port_id id, void* msgBuffer, size_t bufferSize, int maxCount, uint32 flags,
+    unsigned long long timeout)
+{
+    size_t firstSize;
+    return server_read_port_messages(context, id, msgBuffer, bufferSize, maxCount,
+        flags, timeout, firstSize);
+}
+
+intptr_t server_hserver_call_read_port_sized_etc(hserver_context& context,
+    port_id id, void* msgBuffer, size_t bufferSize, uint32 flags, unsigned long long timeout)
+{
+    size_t firstSize;
+    intptr_t result = server_read_port_messages(context, id, msgBuffer, bufferSize, 1,
+        flags, timeout, firstSize);
+
+    if (result < 0)
+    {
+        return result;
+    }
+
+    return firstSize;
+}
+
 intptr_t server_hserver_call_get_port_message_info_etc(hserver_context& context, int id,
     void* userPortMessageInfo, size_t infoSize, unsigned int flags, unsigned long long timeout)
 {
@@ -604,7 +1095,6 @@ intptr_t server_hserver_call_get_port_message_info_etc(hserver_context& context,
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         port = system.GetPort(id).lock();
     }
 
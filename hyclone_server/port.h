@@ -2,12 +2,15 @@
 #define __HYCLONE_PORT_H__
 
 #include <atomic>
-#include <condition_variable>
+#include <list>
 #include <mutex>
 #include <queue>
 #include <string>
 
+#include "haiku_errors.h"
 #include "haiku_port.h"
+#include "port_message.h"
+#include "port_ring.h"
 
 class System;
 
@@ -18,31 +21,87 @@ class Port
 public:
     struct Message
     {
-        std::vector<char> data;
+        PortMessageData data;
         haiku_port_message_info info;
         int code;
     };
+    // A reader blocked in the server. A writer arriving while the queue is empty
+    // copies the message straight into the reader's buffer.
+    // This only covers the servercall fallback used when a team cannot map the ring.
+    // Readers blocked in the loader wait on the ring itself and never take this path.
+    struct Handoff
+    {
+        int pid;
+        void* buffer;
+        size_t bufferSize;
+        int code = 0;
+        size_t size = 0;
+        status_t status = B_OK;
+        // Set when a writer takes the reader off the list.
+        std::atomic<bool> claimed = false;
+        // Set once the fields above are filled in.
+        std::atomic<bool> done = false;
+    };
 private:
     haiku_port_info _info;
-    std::queue<Message> _messages;
-    std::mutex _messagesLock;
-    std::condition_variable _writeCondVar;
-    std::condition_variable _readCondVar;
+    // The message queue, shared with the teams using the port.
+    port_ring* _ring = NULL;
+    size_t _ringSize = 0;
+    // Identifies the ring's shared file. -1 if the ring is private to the server.
+    std::atomic<int64_t> _ringId = -1;
+    // Messages that did not fit into the ring's data space.
+    // Guarded by the ring lock.
+    std::queue<Message> _externalMessages;
+    // The ring's generation the external messages belong to.
+    uint32_t _ringGeneration = 0;
+    // Readers waiting for a handoff, oldest first.
+    // Guarded by _handoffLock. Readers are only added with the ring locked too.
+    std::list<Handoff*> _handoffs;
+    std::mutex _handoffLock;
     std::mutex _lock;
     std::atomic<bool> _registered = false;
     bool _closed = false;
+
+    bool _CreateRing();
+    void _Unregister();
+    PortRingLock _RingLock() { return PortRingLock(_ring, _info.capacity); }
+    // Locks the ring, giving up at the deadline or when a team holds the lock for too long.
+    status_t _LockRing(std::unique_lock<PortRingLock>& lock, bigtime_t deadline);
+    // Waits for sequence to change. Returns B_TIMED_OUT once the deadline has passed.
+    // Leaves the ring unlocked if relocking it fails.
+    status_t _Wait(std::unique_lock<PortRingLock>& lock, uint32_t* sequence, uint32_t* waiters,
+        bigtime_t deadline);
+    // Locks the ring and waits for a message. Returns the first slot with the ring locked.
+    // If handoff is given, the reader may instead be served directly by a writer,
+    // in which case slot is NULL.
+    status_t _WaitForMessage(std::unique_lock<PortRingLock>& lock, bigtime_t timeout,
+        port_ring_slot*& slot, Handoff* handoff = NULL);
 public:
     Port(int pid, int capacity, const char* name);
-    ~Port() = default;
+    ~Port();
+
+    bool IsValid() const { return _ring != NULL; }
 
     status_t Write(Message&& message, bigtime_t timeout);
-    status_t Read(Message& message, bigtime_t timeout);
+    status_t Read(Message& message, bigtime_t timeout, Handoff* handoff = NULL);
+    // Reads up to maxCount queued messages that fit whole into bufferSize bytes,
+    // laid out as read_port_multiple_etc returns them.
+    // If not even the first message fits, only its header is stored and
+    // B_BUFFER_OVERFLOW is returned.
+    status_t ReadMultiple(PortMessageData& output, size_t bufferSize, int maxCount,
+        bigtime_t timeout, int& count);
+    // Passes the message to a reader blocked in the server, if the queue is empty.
+    // Writers and readers using the shared ring directly do not go through here.
+    // Returns false if the message still has to be written to the queue.
+    bool HandOff(int code, const haiku_port_message_info& info, const void* data, size_t size);
     status_t GetMessageInfo(haiku_port_message_info& info, bigtime_t timeout);
     status_t Close();
 
     std::string GetName() const { return _info.name; }
-    const haiku_port_info& GetInfo() const { return _info; }
-    size_t GetBufferSize() const { return _messages.front().data.size(); }
+    haiku_port_info GetInfo() const;
+    int64_t GetRingId() const { return _ringId; }
+    // The name of the ring's file in the shared memory directory.
+    static std::string GetRingName(int64_t ringId);
     int GetOwner() const { return _info.team; }
     int GetId() const { return _info.port; }
 
@@ -0,0 +1,147 @@
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "port_message.h"
+
+static constexpr size_t kSmallestClassSize = 512;
+static constexpr int kSizeClassCount = 10;
+// Each class keeps at most this many bytes of idle buffers.
+static constexpr size_t kPoolBytesPerClass = 4 * 1024 * 1024;
+
+struct SizeClassPool
+{
+    std::mutex lock;
+    std::vector<char*> buffers;
+};
+
+static SizeClassPool sPools[kSizeClassCount];
+
+static constexpr size_t port_message_class_size(int sizeClass)
+{
+    return kSmallestClassSize << sizeClass;
+}
+
+static int port_message_find_class(size_t size)
+{
+    for (int sizeClass = 0; sizeClass < kSizeClassCount; ++sizeClass)
+    {
+        if (size <= port_message_class_size(sizeClass))
+        {
+            return sizeClass;
+        }
+    }
+    return -1;
+}
+
+static char* port_message_allocate(int sizeClass)
+{
+    auto& pool = sPools[sizeClass];
+    {
+        std::unique_lock<std::mutex> lock(pool.lock);
+        if (!pool.buffers.empty())
+        {
+            char* buffer = pool.buffers.back();
+            pool.buffers.pop_back();
+            return buffer;
+        }
+    }
+    return new char[port_message_class_size(sizeClass)];
+}
+
+static void port_message_free(int sizeClass, char* buffer)
+{
+    size_t classSize = port_message_class_size(sizeClass);
+    auto& pool = sPools[sizeClass];
+    {
+        std::unique_lock<std::mutex> lock(pool.lock);
+        if ((pool.buffers.size() + 1) * classSize <= kPoolBytesPerClass || pool.buffers.empty())
+        {
+            pool.buffers.push_back(buffer);
+            return;
+        }
+    }
+    delete[] buffer;
+}
+
+PortMessageData::PortMessageData(PortMessageData&& other)
+{
+    *this = std::move(other);
+}
+
+PortMessageData& PortMessageData::operator=(PortMessageData&& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    _Release();
+
+    if (other._buffer != NULL)
+    {
+        _buffer = other._buffer;
+        _sizeClass = other._sizeClass;
+        other._buffer = NULL;
+        other._sizeClass = -1;
+    }
+    else
+    {
+        memcpy(_inline, other._inline, other._size);
+    }
+
+    _size = other._size;
+    other._size = 0;
+
+    return *this;
+}
+
+void PortMessageData::_Release()
+{
+    if (_buffer != NULL)
+    {
+        if (_sizeClass >= 0)
+        {
+            port_message_free(_sizeClass, _buffer);
+        }
+        else
+        {
+            delete[] _buffer;
+        }
+    }
+
+    _buffer = NULL;
+    _sizeClass = -1;
+    _size = 0;
+}
+
+void PortMessageData::resize(size_t size)
+{
+    if (size <= kInlineSize)
+    {
+        _Release();
+        _size = size;
+        return;
+    }
+
+    if (_buffer != NULL && _sizeClass >= 0 && size <= port_message_class_size(_sizeClass))
+    {
+        _size = size;
+        return;
+    }
+
+    _Release();
+
+    // Messages larger than every class are rare, they skip the pools.
+    int sizeClass = port_message_find_class(size);
+    _buffer = sizeClass >= 0 ? port_message_allocate(sizeClass) : new char[size];
+    _sizeClass = sizeClass;
+    _size = size;
+}
+
+void PortMessageData::assign(const void* data, size_t size)
+{
+    resize(size);
+    memcpy(this->data(), data, size);
+}
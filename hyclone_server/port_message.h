@@ -0,0 +1,38 @@
+#ifndef __HYCLONE_PORT_MESSAGE_H__
+#define __HYCLONE_PORT_MESSAGE_H__
+
+#include <cstddef>
+
+// Contents of a port message.
+// Small messages are stored inline, larger ones in buffers recycled through
+// size-classed pools shared by all ports.
+class PortMessageData
+{
+public:
+    static constexpr size_t kInlineSize = 256;
+private:
+    char* _buffer = NULL;
+    size_t _size = 0;
+    int _sizeClass = -1;
+    alignas(8) char _inline[kInlineSize];
+
+    void _Release();
+public:
+    PortMessageData() = default;
+    PortMessageData(PortMessageData&& other);
+    PortMessageData(const PortMessageData&) = delete;
+    ~PortMessageData() { _Release(); }
+
+    PortMessageData& operator=(PortMessageData&& other);
+    PortMessageData& operator=(const PortMessageData&) = delete;
+
+    // Does not preserve the previous contents.
+    void resize(size_t size);
+    void assign(const void* data, size_t size);
+
+    char* data() { return _buffer != NULL ? _buffer : _inline; }
+    const char* data() const { return _buffer != NULL ? _buffer : _inline; }
+    size_t size() const { return _size; }
+};
+
+#endif // __HYCLONE_PORT_MESSAGE_H__
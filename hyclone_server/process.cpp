@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <utility>
@@ -36,6 +37,15 @@ Process::Process(int pid, int uid, int gid, int euid, int egid)
     _ioContext = std::make_shared<IoContext>();
 }
 
+Process::~Process()
+{
+    if (_areaTable != NULL)
+    {
+        server_unmap_memory(_areaTable, sizeof(area_table));
+        server_remove_shared_file(GetAreaTableName(_areaTableId).c_str());
+    }
+}
+
 std::weak_ptr<Thread> Process::RegisterThread(int tid)
 {
     auto ptr = std::make_shared<Thread>(_pid, tid);
@@ -106,7 +116,10 @@ size_t Process::UnregisterImage(int imageId)
 
 std::weak_ptr<Area> Process::RegisterArea(const std::shared_ptr<Area>& area)
 {
-    return _areas[area->GetAreaId()] = area;
+    _areaIndex.Set(area->GetAreaId(), (uintptr_t)area->GetAddress(), area->GetSize());
+    _areas[area->GetAreaId()] = area;
+    _PublishArea(*area);
+    return area;
 }
 
 std::weak_ptr<Area> Process::GetArea(int areaId)
@@ -119,32 +132,230 @@ std::weak_ptr<Area> Process::GetArea(int areaId)
 
 int Process::GetAreaIdFor(void* address)
 {
-    for (const auto& [areaId, area] : _areas)
+    int id;
+    if (!_areaIndex.Find((uintptr_t)address, id))
+        return -1;
+    return id;
+}
+
+int Process::GetNextAreaIdFor(void* address)
+{
+    int id;
+    if (!_areaIndex.FindNext((uintptr_t)address, id))
+        return -1;
+    return id;
+}
+
+std::vector<int> Process::GetAreaIdsIn(void* address, size_t size)
+{
+    return _areaIndex.FindOverlapping((uintptr_t)address, size);
+}
+
+void Process::UpdateArea(int areaId)
+{
+    auto it = _areas.find(areaId);
+    if (it != _areas.end())
     {
-        if ((uint8_t*)area->GetInfo().address <= address &&
-            address < (uint8_t*)area->GetInfo().address + area->GetInfo().size)
-            return area->GetAreaId();
+        _areaIndex.Set(areaId, (uintptr_t)it->second->GetAddress(), it->second->GetSize());
+        _PublishArea(*it->second);
     }
-    return -1;
 }
 
-int Process::GetNextAreaIdFor(void* address)
+std::map<int, std::shared_ptr<Area>> Process::TakeAreas()
 {
-    int id = -1;
-    uintptr_t min = (uintptr_t)-1;
+    _areaIndex.Clear();
+    _ClearAreaTable();
+    return std::exchange(_areas, {});
+}
+
+std::string Process::GetAreaTableName(int64_t tableId)
+{
+    return AREA_TABLE_FILE_PREFIX + std::to_string(tableId);
+}
+
+int64_t Process::GetAreaTableId()
+{
+    static std::atomic<int64_t> sNextAreaTableId = 0;
+
+    auto lock = std::unique_lock(_areaTableLock);
+
+    if (_areaTable != NULL)
+    {
+        return _areaTableId;
+    }
+
+    int64_t tableId = sNextAreaTableId.fetch_add(1, std::memory_order_relaxed);
+    auto name = GetAreaTableName(tableId);
+
+    intptr_t handle = server_open_shared_file(name.c_str(), sizeof(area_table), true);
+    if (handle < 0)
+    {
+        return -1;
+    }
+
+    area_table* table = (area_table*)server_map_memory(handle, sizeof(area_table), 0, true);
+    server_close_file(handle);
+
+    if (table == NULL)
+    {
+        server_remove_shared_file(name.c_str());
+        return -1;
+    }
+
+    _areaTable = table;
+    _areaTableId = tableId;
+    _areaTableSlots.clear();
+    _freeAreaTableSlots.clear();
 
+    area_table_begin_write(_areaTable);
     for (const auto& [areaId, area] : _areas)
     {
-        if ((uintptr_t)area->GetInfo().address > (uintptr_t)address)
+        _StoreArea(*area);
+    }
+    area_table_end_write(_areaTable);
+
+    return _areaTableId;
+}
+
+void Process::_PublishArea(const Area& area)
+{
+    auto lock = std::unique_lock(_areaTableLock);
+
+    if (_areaTable == NULL)
+    {
+        return;
+    }
+
+    area_table_begin_write(_areaTable);
+    _StoreArea(area);
+    area_table_end_write(_areaTable);
+}
+
+static uintptr_t area_table_address_key(const haiku_area_info& info)
+{
+    return (uintptr_t)info.address;
+}
+
+static area_id area_table_id_key(const haiku_area_info& info)
+{
+    return info.area;
+}
+
+// Adds slot to the sorted indices. The caller updates count afterwards.
+template <typename Key>
+static void area_table_insert_index(area_table* table, uint16_t* indices, uint16_t slot, Key key)
+{
+    uint16_t* end = indices + table->count;
+    uint16_t* position = std::upper_bound(indices, end, slot, [&](uint16_t a, uint16_t b)
+    {
+        return key(table->entries[a]) < key(table->entries[b]);
+    });
+    std::copy_backward(position, end, end + 1);
+    *position = slot;
+}
+
+// Removes slot from the sorted indices, while its entry still holds the old key.
+// The caller updates count afterwards.
+template <typename Key>
+static void area_table_remove_index(area_table* table, uint16_t* indices, uint16_t slot, Key key)
+{
+    uint16_t* end = indices + table->count;
+    uint16_t* position = std::lower_bound(indices, end, slot, [&](uint16_t a, uint16_t b)
+    {
+        return key(table->entries[a]) < key(table->entries[b]);
+    });
+    while (position != end && *position != slot)
+    {
+        ++position;
+    }
+    if (position != end)
+    {
+        std::copy(position + 1, end, position);
+    }
+}
+
+void Process::_StoreArea(const Area& area)
+{
+    auto it = _areaTableSlots.find(area.GetAreaId());
+    if (it != _areaTableSlots.end())
+    {
+        uint16_t slot = it->second;
+        // Only the address can move the entry.
+        if (_areaTable->entries[slot].address != area.GetInfo().address)
         {
-            if ((uintptr_t)area->GetInfo().address < min)
-            {
-                min = (uintptr_t)area->GetInfo().address;
-                id = area->GetAreaId();
-            }
+            area_table_remove_index(_areaTable, _areaTable->byAddress, slot, area_table_address_key);
+            --_areaTable->count;
+            _areaTable->entries[slot] = area.GetInfo();
+            area_table_insert_index(_areaTable, _areaTable->byAddress, slot, area_table_address_key);
+            ++_areaTable->count;
+        }
+        else
+        {
+            _areaTable->entries[slot] = area.GetInfo();
         }
+        return;
     }
-    return id;
+
+    uint16_t slot;
+    if (!_freeAreaTableSlots.empty())
+    {
+        slot = _freeAreaTableSlots.back();
+        _freeAreaTableSlots.pop_back();
+    }
+    else if (_areaTable->count < AREA_TABLE_CAPACITY)
+    {
+        // Without free slots, the used ones are exactly those below count.
+        slot = _areaTable->count;
+    }
+    else
+    {
+        // The team will ask the server about this one.
+        return;
+    }
+
+    _areaTableSlots[area.GetAreaId()] = slot;
+    _areaTable->entries[slot] = area.GetInfo();
+    area_table_insert_index(_areaTable, _areaTable->byId, slot, area_table_id_key);
+    area_table_insert_index(_areaTable, _areaTable->byAddress, slot, area_table_address_key);
+    ++_areaTable->count;
+}
+
+void Process::_UnpublishArea(int areaId)
+{
+    auto lock = std::unique_lock(_areaTableLock);
+
+    auto it = _areaTableSlots.find(areaId);
+    if (it == _areaTableSlots.end())
+    {
+        return;
+    }
+
+    uint16_t slot = it->second;
+    _areaTableSlots.erase(it);
+    _freeAreaTableSlots.push_back(slot);
+
+    area_table_begin_write(_areaTable);
+    area_table_remove_index(_areaTable, _areaTable->byId, slot, area_table_id_key);
+    area_table_remove_index(_areaTable, _areaTable->byAddress, slot, area_table_address_key);
+    --_areaTable->count;
+    area_table_end_write(_areaTable);
+}
+
+void Process::_ClearAreaTable()
+{
+    auto lock = std::unique_lock(_areaTableLock);
+
+    if (_areaTable == NULL)
+    {
+        return;
+    }
+
+    _areaTableSlots.clear();
+    _freeAreaTableSlots.clear();
+
+    area_table_begin_write(_areaTable);
+    _areaTable->count = 0;
+    area_table_end_write(_areaTable);
 }
 
 int Process::NextAreaId(int areaId)
@@ -163,6 +374,8 @@ bool Process::IsValidAreaId(int areaId)
 size_t Process::UnregisterArea(int areaId)
 {
     _areas.erase(areaId);
+    _areaIndex.Remove(areaId);
+    _UnpublishArea(areaId);
     _info.area_count = _areas.size();
     return _areas.size();
 }
@@ -256,21 +469,13 @@ void Process::Fork(Process& child)
         registeredArea->Unshare();
         registeredArea->GetInfo().team = child._pid;
         registeredArea = system.RegisterArea(registeredArea).lock();
-        child._areas[registeredArea->GetInfo().area] = registeredArea;
+        child.RegisterArea(registeredArea);
         if (area->IsShared() && area->GetMapping() == REGION_PRIVATE_MAP)
         {
-            auto& memService = system.GetMemoryService();
-            auto lock = memService.Lock();
-            std::string hostPath;
-            if (memService.CloneSharedFile(std::to_string(registeredArea->GetAreaId()),
-                area->GetEntryRef(), hostPath))
-            {
-                EntryRef ref;
-                if (memService.OpenSharedFile(hostPath, registeredArea->IsWritable(), ref))
-                {
-                    registeredArea->Share(ref, area->GetOffset());
-                }
-            }
+            // Copying the backing file is slow, FinishFork does it outside the system lock.
+            // The copy is still done in full before the child runs.
+            child._pendingAreaCopies.push_back({ registeredArea->GetAreaId(),
+                area->GetEntryRef(), area->GetOffset(), registeredArea->IsWritable() });
         }
     }
 
@@ -283,9 +488,53 @@ void Process::Fork(Process& child)
 
     // No, semaphores don't seem to be inherited.
     // child._owningSemaphores = _owningSemaphores;
+}
+
+void Process::FinishFork()
+{
+    auto& system = System::GetInstance();
+    auto& memService = system.GetMemoryService();
 
-    child._forkUnlocked = true;
-    child._forkUnlocked.notify_all();
+    std::vector<PendingAreaCopy> copies;
+    {
+        auto lock = Lock();
+        copies = std::exchange(_pendingAreaCopies, {});
+    }
+
+    // The child is still waiting for the fork unlock, so nothing maps these areas yet.
+    for (const auto& copy : copies)
+    {
+        std::string hostPath;
+        if (!memService.CloneSharedFile(std::to_string(copy.areaId), copy.ref, hostPath))
+        {
+            continue;
+        }
+
+        EntryRef ref;
+        {
+            auto memLock = memService.Lock();
+            if (!memService.OpenSharedFile(hostPath, copy.writable, ref))
+            {
+                continue;
+            }
+        }
+
+        auto systemLock = system.Lock();
+        auto lock = Lock();
+        auto it = _areas.find(copy.areaId);
+        if (it != _areas.end())
+        {
+            it->second->Share(ref, copy.offset);
+        }
+        else
+        {
+            auto memLock = memService.Lock();
+            memService.ReleaseSharedFile(ref);
+        }
+    }
+
+    _forkUnlocked = true;
+    _forkUnlocked.notify_all();
 }
 
 void Process::WaitForForkUnlock()
@@ -788,7 +1037,6 @@ intptr_t server_hserver_call_get_team_info(hserver_context& context, int teamId,
         else
         {
             auto& system = System::GetInstance();
-            auto lock = system.Lock();
             process = system.GetProcess(teamId).lock();
         }
 
@@ -895,7 +1143,6 @@ intptr_t server_hserver_call_get_extended_team_info(hserver_context& context, in
     else
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         process = system.GetProcess(teamID).lock();
     }
 
@@ -8,12 +8,16 @@
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
+#include "area_table.h"
 #include "associateddata.h"
+#include "entry_ref.h"
 #include "haiku_area.h"
 #include "haiku_image.h"
 #include "haiku_team.h"
 #include "id_map.h"
+#include "interval_index.h"
 #include "io_context.h"
 
 class Area;
@@ -28,6 +32,15 @@ private:
     int _uid, _gid, _euid, _egid;
     int _debuggerPid, _debuggerPort, _debuggerWriteLock;
     std::atomic<bool> _forkUnlocked;
+    // Shared areas of a forked child whose backing files still need a copy.
+    struct PendingAreaCopy
+    {
+        int areaId;
+        EntryRef ref;
+        size_t offset;
+        bool writable;
+    };
+    std::vector<PendingAreaCopy> _pendingAreaCopies;
     std::atomic<bool> _isExecutingExec;
 
     std::shared_ptr<IoContext> _ioContext;
@@ -40,13 +53,28 @@ private:
     std::map<int, std::shared_ptr<Thread>> _threads;
     IdMap<haiku_extended_image_info, int> _images;
     std::map<int, std::shared_ptr<Area>> _areas;
+    // The areas by address. Guarded by the process lock like _areas.
+    IntervalIndex<int> _areaIndex;
+    // Copies of the area information the team reads without a servercall.
+    // Created when the team first asks for it.
+    area_table* _areaTable = NULL;
+    int64_t _areaTableId = -1;
+    std::unordered_map<int, uint16_t> _areaTableSlots;
+    std::vector<uint16_t> _freeAreaTableSlots;
+    std::mutex _areaTableLock;
+
+    void _PublishArea(const Area& area);
+    // Called with _areaTableLock held, inside a write section.
+    void _StoreArea(const Area& area);
+    void _UnpublishArea(int areaId);
+    void _ClearAreaTable();
     std::unordered_map<int, std::filesystem::path> _fds;
     std::mutex _lock;
     std::unordered_set<int> _owningSemaphores;
     std::set<int> _owningPorts;
 public:
     Process(int pid, int uid, int gid, int euid, int egid);
-    ~Process() = default;
+    ~Process();
 
     std::unique_lock<std::mutex> Lock() { return std::unique_lock(_lock); }
 
@@ -67,10 +95,19 @@ public:
     std::weak_ptr<Area> GetArea(int areaId);
     int GetAreaIdFor(void* address);
     int GetNextAreaIdFor(void* address);
+    // Returns the areas overlapping the range, ordered by address.
+    std::vector<int> GetAreaIdsIn(void* address, size_t size);
+    // Must be called after the information of an area has changed.
+    void UpdateArea(int areaId);
     int NextAreaId(int areaId);
     bool IsValidAreaId(int areaId);
     size_t UnregisterArea(int areaId);
-    void ClearAreas() { _areas.clear(); }
+    // Detaches all areas, for the caller to release them.
+    std::map<int, std::shared_ptr<Area>> TakeAreas();
+    // Returns the ID of the team's area table, creating it if needed. -1 on failure.
+    // Must be called with the process lock held.
+    int64_t GetAreaTableId();
+    static std::string GetAreaTableName(int64_t tableId);
 
     const std::shared_ptr<IoContext>& GetIoContext() const { return _ioContext; }
     void ClearIoContext();
@@ -116,6 +153,9 @@ public:
 
     // Copies managed information to child.
     void Fork(Process& child);
+    // Copies the shared areas left by Fork and unlocks the child.
+    // Must be called without the system lock or the child's lock.
+    void FinishFork();
     // Checks whether this child process has been unlocked by fork yet.
     bool IsForkUnlocked() const { return _forkUnlocked; }
     void WaitForForkUnlock();
@@ -128,13 +168,13 @@ public:
     void AddOwningSemaphore(int id) { _owningSemaphores.insert(id); }
     void RemoveOwningSemaphore(int id) { _owningSemaphores.erase(id); }
     bool IsOwningSemaphore(int id) const { return _owningSemaphores.contains(id); }
-    void ClearOwningSemaphores() { _owningSemaphores.clear(); }
+    std::unordered_set<int> TakeOwningSemaphores() { return std::exchange(_owningSemaphores, {}); }
 
     const std::set<int>& GetOwningPorts() const { return _owningPorts; }
     void AddOwningPort(int id) { _owningPorts.insert(id); }
     void RemoveOwningPort(int id) { _owningPorts.erase(id); }
     bool IsOwningPort(int id) const { return _owningPorts.contains(id); }
-    void ClearOwningPorts() { _owningPorts.clear(); }
+    std::set<int> TakeOwningPorts() { return std::exchange(_owningPorts, {}); }
 
     size_t ReadMemory(void* address, void* buffer, size_t size);
     size_t WriteMemory(void* address, const void* buffer, size_t size);
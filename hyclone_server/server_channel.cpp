@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "haiku_errors.h"
+#include "server_channel.h"
+#include "server_main.h"
+#include "server_memory.h"
+#include "server_native.h"
+#include "server_payload.h"
+#include "server_servercalls.h"
+#include "server_stats.h"
+#include "server_systemtime.h"
+#include "server_workers.h"
+
+// Waits on the state words of several channels at once,
+// and passes submitted calls on to the worker pool.
+class ChannelDispatcher
+{
+private:
+    std::mutex _lock;
+    std::vector<std::shared_ptr<ServerChannel>> _channels;
+    // Changed whenever the dispatcher should look at its channels again.
+    uint32_t _wakeWord = 0;
+
+    void _Run();
+public:
+    // One word is taken by _wakeWord.
+    static constexpr size_t kMaxChannels = SERVER_FUTEX_WAIT_MULTIPLE_MAX - 1;
+
+    ChannelDispatcher() { std::thread(&ChannelDispatcher::_Run, this).detach(); }
+
+    bool Add(const std::shared_ptr<ServerChannel>& channel);
+    void Wake();
+};
+
+static std::mutex sChannelsLock;
+static std::unordered_map<intptr_t, std::shared_ptr<ServerChannel>> sChannels;
+// Never destroyed, as their threads run until exit.
+static std::vector<ChannelDispatcher*> sDispatchers;
+
+bool ChannelDispatcher::Add(const std::shared_ptr<ServerChannel>& channel)
+{
+    {
+        auto lock = std::unique_lock(_lock);
+        if (_channels.size() >= kMaxChannels)
+        {
+            return false;
+        }
+        channel->_dispatcher = this;
+        _channels.push_back(channel);
+    }
+    Wake();
+    return true;
+}
+
+void ChannelDispatcher::Wake()
+{
+    __atomic_add_fetch(&_wakeWord, 1, __ATOMIC_RELEASE);
+    server_futex_wake(&_wakeWord, 1);
+}
+
+void ChannelDispatcher::_Run()
+{
+    std::vector<std::shared_ptr<ServerChannel>> channels;
+    std::vector<uint32_t*> addresses;
+    std::vector<uint32_t> values;
+
+    while (true)
+    {
+        uint32_t wakeValue = __atomic_load_n(&_wakeWord, __ATOMIC_ACQUIRE);
+
+        {
+            auto lock = std::unique_lock(_lock);
+            std::erase_if(_channels, [](const std::shared_ptr<ServerChannel>& channel)
+            {
+                return channel->_isClosed && !channel->_isBusy;
+            });
+            channels = _channels;
+        }
+
+        addresses.assign(1, &_wakeWord);
+        values.assign(1, wakeValue);
+
+        for (const auto& channel : channels)
+        {
+            if (channel->_isBusy || channel->_isClosed)
+            {
+                continue;
+            }
+
+            uint32_t* state = &channel->_channel->state;
+            uint32_t value = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+            if (value == SERVERCALL_CHANNEL_SUBMITTED)
+            {
+                channel->_isBusy = true;
+                channel->_submitTime = server_system_time_nsecs();
+                server_worker_run([](std::shared_ptr<ServerChannel> servedChannel)
+                {
+                    servedChannel->_Serve();
+                }, channel);
+                continue;
+            }
+
+            addresses.push_back(state);
+            values.push_back(value);
+        }
+
+        // The channels stay referenced, and their slots mapped, until the wait is over.
+        server_futex_wait_multiple(addresses.data(), values.data(), addresses.size());
+        channels.clear();
+    }
+}
+
+ServerChannel::~ServerChannel()
+{
+    server_unmap_memory(_channel, sizeof(servercall_channel));
+}
+
+void ServerChannel::Start()
+{
+    auto lock = std::unique_lock(sChannelsLock);
+    for (auto dispatcher : sDispatchers)
+    {
+        if (dispatcher->Add(shared_from_this()))
+        {
+            return;
+        }
+    }
+    sDispatchers.push_back(new ChannelDispatcher());
+    sDispatchers.back()->Add(shared_from_this());
+}
+
+void ServerChannel::Close()
+{
+    _isClosed = true;
+    __atomic_store_n(&_channel->state, SERVERCALL_CHANNEL_CLOSED, __ATOMIC_RELEASE);
+    server_futex_wake(&_channel->state, INT32_MAX);
+}
+
+void ServerChannel::_Serve()
+{
+    intptr_t args[HYCLONE_SERVERCALL_MAX_ARGS + 1];
+    memcpy(args, _channel->args, sizeof(args));
+
+    server_stats_record_queue(args[0], server_system_time_nsecs() - _submitTime);
+
+    // Take a copy, the reply payload is written to the same place.
+    uint32_t payloadSize = std::min(_channel->payloadSize, (uint32_t)HYCLONE_SERVERCALL_MAX_PAYLOAD);
+    std::vector<char> payload(_channel->payload, _channel->payload + payloadSize);
+    std::vector<char> reply;
+
+    intptr_t result;
+    switch (args[0])
+    {
+        // These manage the connection itself, and must go through the socket.
+        case SERVERCALL_ID_connect:
+        case SERVERCALL_ID_disconnect:
+        case SERVERCALL_ID_attach_channel:
+        case SERVERCALL_ID_request_ack:
+            result = B_NOT_ALLOWED;
+        break;
+        default:
+            result = server_dispatch_with_payload(_connId, args, payload.data(), payload.size(), reply,
+                _connection.get());
+        break;
+    }
+
+    _channel->result = result;
+    memcpy(_channel->payload, reply.data(), reply.size());
+    _channel->payloadSize = reply.size();
+
+    // Fails if the channel has been closed while the call was running.
+    uint32_t expected = SERVERCALL_CHANNEL_SUBMITTED;
+    if (__atomic_compare_exchange_n(&_channel->state, &expected, SERVERCALL_CHANNEL_COMPLETED,
+        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+        server_futex_wake(&_channel->state, 1);
+    }
+
+    _isBusy = false;
+    _dispatcher->Wake();
+}
+
+void server_close_channel(intptr_t conn_id)
+{
+    std::shared_ptr<ServerChannel> channel;
+
+    {
+        auto lock = std::unique_lock(sChannelsLock);
+        auto it = sChannels.find(conn_id);
+        if (it == sChannels.end())
+        {
+            return;
+        }
+        channel = std::move(it->second);
+        sChannels.erase(it);
+    }
+
+    channel->Close();
+}
+
+bool server_is_channel_interrupted(intptr_t conn_id)
+{
+    auto lock = std::unique_lock(sChannelsLock);
+    auto it = sChannels.find(conn_id);
+    return it != sChannels.end() && it->second->IsInterrupted();
+}
+
+intptr_t server_hserver_call_attach_channel(hserver_context& context, int fd)
+{
+    // Without a way to wait on many channels, the client stays on the socket.
+    if (!server_futex_wait_multiple_supported())
+    {
+        return B_NOT_SUPPORTED;
+    }
+
+    intptr_t handle = server_acquire_process_file_handle(context.pid, fd, true);
+    if (handle == -1)
+    {
+        return B_BAD_VALUE;
+    }
+
+    void* address = server_map_memory(handle, sizeof(servercall_channel), 0, true);
+    server_close_file(handle);
+
+    if (address == NULL)
+    {
+        return B_NO_MEMORY;
+    }
+
+    std::shared_ptr<ServerChannel> oldChannel;
+    std::shared_ptr<ServerChannel> channel;
+
+    {
+        auto lock = std::unique_lock(sChannelsLock);
+
+        // Checked under the channel lock, so that a connection
+        // closing concurrently cannot miss the new channel.
+        auto connection = server_get_connection(context.conn_id);
+        if (!connection)
+        {
+            server_unmap_memory(address, sizeof(servercall_channel));
+            return B_BAD_VALUE;
+        }
+
+        channel = std::make_shared<ServerChannel>(context.conn_id, (servercall_channel*)address, connection);
+
+        auto& entry = sChannels[context.conn_id];
+        oldChannel = std::move(entry);
+        entry = channel;
+    }
+
+    if (oldChannel)
+    {
+        oldChannel->Close();
+    }
+
+    channel->Start();
+
+    return B_OK;
+}
@@ -0,0 +1,49 @@
+#ifndef __SERVER_CHANNEL_H__
+#define __SERVER_CHANNEL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "servercall_channel.h"
+
+struct hserver_connection;
+class ChannelDispatcher;
+
+// Serves servercalls submitted through a shared memory slot
+// instead of the connection's socket.
+class ServerChannel : public std::enable_shared_from_this<ServerChannel>
+{
+private:
+    intptr_t _connId;
+    servercall_channel* _channel;
+    // Keeps the underlying connection alive while calls are in flight.
+    std::shared_ptr<hserver_connection> _connection;
+    std::atomic<bool> _isClosed = false;
+    // Set while a worker serves a call. The dispatcher leaves busy channels alone.
+    std::atomic<bool> _isBusy = false;
+    ChannelDispatcher* _dispatcher = NULL;
+    // When the dispatcher saw the current call, for the queue statistics.
+    uint64_t _submitTime = 0;
+
+    void _Serve();
+
+    friend class ChannelDispatcher;
+public:
+    ServerChannel(intptr_t connId, servercall_channel* channel, const std::shared_ptr<hserver_connection>& connection)
+        : _connId(connId), _channel(channel), _connection(connection) { }
+    ~ServerChannel();
+
+    // Hands the channel to a dispatcher, which passes submitted calls to the worker pool.
+    void Start();
+    void Close();
+    bool IsInterrupted() const { return __atomic_load_n(&_channel->interrupted, __ATOMIC_ACQUIRE) != 0; }
+};
+
+// Closes the channel attached to a connection, if any.
+void server_close_channel(intptr_t conn_id);
+// Whether a signal has interrupted the client while waiting for
+// its current channel call. Calls over the socket are never interrupted.
+bool server_is_channel_interrupted(intptr_t conn_id);
+
+#endif // __SERVER_CHANNEL_H__
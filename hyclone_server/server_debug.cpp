@@ -34,11 +34,7 @@ intptr_t server_hserver_call_install_default_debugger(hserver_context& context,
     auto& system = System::GetInstance();
     std::shared_ptr<Port> port;
 
-    {
-        auto lock = system.Lock();
-
-        port = system.GetPort(portId).lock();
-    }
+    port = system.GetPort(portId).lock();
 
     if (!port)
     {
@@ -173,8 +169,6 @@ intptr_t server_hserver_call_register_nub(hserver_context& context, int port, in
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
-
         debuggerProcess = system.GetProcess(debuggerPid).lock();
     }
 
@@ -1,24 +1,65 @@
 #include <cstddef>
+#include <vector>
+
 #include "haiku_errors.h"
 #include "process.h"
 #include "servercalls.h"
 #include "server_servercalls.h"
+#include "server_stats.h"
+#include "server_systemtime.h"
 #include "system.h"
 #include "thread.h"
 
 thread_local hserver_context* gCurrentContext;
 
 intptr_t server_dispatch(intptr_t conn_id, intptr_t call_id,
-    intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6)
+    intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6,
+    ServercallPayload* payload, hserver_connection* connection)
 {
     hserver_context context;
     context.conn_id = conn_id;
+    context.payload = payload;
+
+    // The context lives on this stack frame, make sure it does not
+    // outlive the call on this (pooled) thread.
+    struct ContextScope
+    {
+        ContextScope(hserver_context* current) { gCurrentContext = current; }
+        ~ContextScope() { gCurrentContext = NULL; }
+    } contextScope(&context);
 
-    gCurrentContext = &context;
+    struct StatsScope
+    {
+        intptr_t callId;
+        int64_t startTime;
+        StatsScope(intptr_t id) : callId(id), startTime(server_system_time_nsecs()) { }
+        ~StatsScope() { server_stats_record_exec(callId, server_system_time_nsecs() - startTime); }
+    } statsScope(call_id);
 
+    if (connection != NULL)
     {
+        if (call_id == SERVERCALL_ID_disconnect)
+        {
+            connection->state.store(hserver_connection::DISCONNECTED, std::memory_order_release);
+        }
+        else if (connection->state.load(std::memory_order_acquire) == hserver_connection::RESOLVED)
+        {
+            // Another connection may have torn the thread down.
+            if (!connection->thread->IsRegistered())
+            {
+                return B_BAD_VALUE;
+            }
+            context.pid = connection->pid;
+            context.tid = connection->tid;
+            context.process = connection->process;
+            context.thread = connection->thread;
+            return server_dispatch_call(context, call_id, a1, a2, a3, a4, a5, a6);
+        }
+    }
+
+    {
+        // Only lookups here, the tables synchronize them on their own.
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
 
         switch (call_id)
         {
@@ -34,7 +75,11 @@ intptr_t server_dispatch(intptr_t conn_id, intptr_t call_id,
 
         // For SERVERCALL_ID_connect, the process and thread hasn't been registered
         // in HyClone server yet.
-        if (call_id != SERVERCALL_ID_connect)
+        // The stats calls do not need one either, so that host tools
+        // can query them without registering.
+        if (call_id != SERVERCALL_ID_connect
+            && call_id != SERVERCALL_ID_get_servercall_stats
+            && call_id != SERVERCALL_ID_reset_servercall_stats)
         {
             context.process = system.GetProcess(context.pid).lock();
             if (!context.process)
@@ -53,8 +98,25 @@ intptr_t server_dispatch(intptr_t conn_id, intptr_t call_id,
         {
             return B_BAD_VALUE;
         }
+
+        int expected = hserver_connection::UNRESOLVED;
+        if (connection != NULL && call_id != SERVERCALL_ID_request_ack
+            && connection->state.compare_exchange_strong(expected, hserver_connection::RESOLVING))
+        {
+            connection->pid = context.pid;
+            connection->tid = context.tid;
+            connection->process = context.process;
+            connection->thread = context.thread;
+            connection->state.store(hserver_connection::RESOLVED, std::memory_order_release);
+        }
     }
 
+    return server_dispatch_call(context, call_id, a1, a2, a3, a4, a5, a6);
+}
+
+intptr_t server_dispatch_call(hserver_context& context,
+    intptr_t call_id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6)
+{
     intptr_t result = HAIKU_POSIX_ENOSYS;
 
 #define HYCLONE_SERVERCALL0(name) \
@@ -93,4 +155,57 @@ intptr_t server_dispatch(intptr_t conn_id, intptr_t call_id,
 #undef HYCLONE_SERVERCALL6
 
     return result;
-}
\ No newline at end of file
+}
+
+intptr_t server_hserver_call_batch(hserver_context& context, const void* userCalls, size_t count,
+    intptr_t* userResults)
+{
+    if (count > HYCLONE_SERVERCALL_MAX_BATCH_SIZE)
+    {
+        return B_BAD_VALUE;
+    }
+
+    std::vector<intptr_t> calls(count * HYCLONE_SERVERCALL_BATCH_CALL_LENGTH);
+    std::vector<intptr_t> results(count, B_NOT_ALLOWED);
+
+    {
+        auto lock = context.process->Lock();
+        size_t size = calls.size() * sizeof(intptr_t);
+        if (context.process->ReadMemory((void*)userCalls, calls.data(), size) != size)
+        {
+            return B_BAD_ADDRESS;
+        }
+    }
+
+    // The calls share the context of the batch, which has been resolved only once.
+    for (size_t i = 0; i < count; ++i)
+    {
+        const intptr_t* call = calls.data() + i * HYCLONE_SERVERCALL_BATCH_CALL_LENGTH;
+        switch (call[0])
+        {
+            // These manage the connection itself.
+            case SERVERCALL_ID_connect:
+            case SERVERCALL_ID_disconnect:
+            case SERVERCALL_ID_attach_channel:
+            case SERVERCALL_ID_batch:
+            case SERVERCALL_ID_request_ack:
+            case SERVERCALL_ID_request_read:
+            case SERVERCALL_ID_request_reply:
+            break;
+            default:
+                results[i] = server_dispatch_call(context, call[0], call[1], call[2], call[3], call[4], call[5], call[6]);
+            break;
+        }
+    }
+
+    {
+        auto lock = context.process->Lock();
+        size_t size = results.size() * sizeof(intptr_t);
+        if (context.process->WriteMemory(userResults, results.data(), size) != size)
+        {
+            return B_BAD_ADDRESS;
+        }
+    }
+
+    return B_OK;
+}
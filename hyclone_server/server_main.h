@@ -1,7 +1,20 @@
 #ifndef __SERVER_MAIN_H__
 #define __SERVER_MAIN_H__
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct hserver_connection;
+
 // Platform specific main
 int server_main(int argc, char** argv);
 
+// Returns an owning reference to an open connection,
+// or NULL if the connection has already been closed.
+std::shared_ptr<hserver_connection> server_get_connection(intptr_t conn_id);
+size_t server_get_connection_count();
+// Sends a file descriptor to the team behind a connection, ahead of the reply to its current call.
+bool server_send_connection_fd(intptr_t conn_id, intptr_t handle);
+
 #endif // __SERVER_MAIN_H__
\ No newline at end of file
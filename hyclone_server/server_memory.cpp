@@ -35,18 +35,24 @@ bool MemoryService::CreateSharedFile(const std::string& name, size_t size, std::
 
 bool MemoryService::CloneSharedFile(const std::string& name, const EntryRef& ref, std::string& hostPath)
 {
-    if (!_sharedFiles.contains(ref))
+    std::string path;
     {
-        return false;
+        auto lock = Lock();
+        if (!GetSharedFilePath(ref, path))
+        {
+            return false;
+        }
+        // Keeps the source, and the handle behind a /proc path, alive during the copy.
+        AcquireSharedFile(ref);
     }
 
-    auto& file = _sharedFiles[ref];
-    if (file.HasHandle())
+    intptr_t handle = server_clone_shared_file(name.c_str(), path.c_str(), true);
+
     {
-        return false;
+        auto lock = Lock();
+        ReleaseSharedFile(ref);
     }
 
-    intptr_t handle = server_clone_shared_file(name.c_str(), file.GetName().c_str(), true);
     if (handle == -1)
     {
         return false;
@@ -187,7 +193,7 @@ bool MemoryService::GetSharedFilePath(const EntryRef& ref, std::string& path)
     auto& file = _sharedFiles[ref];
     if (file.HasHandle())
     {
-        return false;
+        path = server_get_file_handle_path(file.GetHandle());
     }
     else
     {
@@ -15,7 +15,10 @@ bool server_setup_memory();
 // Opens a shared file that can be mapped to any process's address space
 // The file should be accessible by monika at gHaikuPrefix / HYCLONE_SHM_NAME / name
 intptr_t server_open_shared_file(const char* name, size_t size, bool writable);
-// Clones the file located at path into a shared file
+// Removes a shared file. Existing mappings stay valid.
+void server_remove_shared_file(const char* name);
+// Clones the file located at path into a shared file.
+// The data is copied eagerly, skipping holes. This is not copy-on-write.
 intptr_t server_clone_shared_file(const char* name, const char* path, bool writable);
 // Opens an existing file
 intptr_t server_open_file(const char* name, bool writable);
@@ -25,6 +28,9 @@ bool server_resize_shared_file(intptr_t handle, size_t size);
 void server_close_file(intptr_t handle);
 // Acquires a file handle for this process based on a file handle from another process
 intptr_t server_acquire_process_file_handle(int pid, intptr_t handle, bool writable);
+// Gets a path the server can open to reach the same file as handle.
+// Teams cannot use it, since the installed server is not dumpable.
+std::string server_get_file_handle_path(intptr_t handle);
 // Get EntryRef from handle
 bool server_get_entry_ref(intptr_t handle, EntryRef& ref);
 // Maps a file into this process's address space
@@ -70,6 +76,7 @@ public:
     ~MemoryService() = default;
 
     bool CreateSharedFile(const std::string& name, size_t size, std::string& hostPath);
+    // Takes the service lock itself, the copy runs without it.
     bool CloneSharedFile(const std::string& name, const EntryRef& ref, std::string& hostPath);
     bool OpenSharedFile(int pid, intptr_t userHandle, bool writable, EntryRef& ref);
     bool OpenSharedFile(const std::string& name, bool writable, EntryRef& ref);
@@ -448,8 +448,6 @@ intptr_t server_hserver_call_register_messaging_service(hserver_context& context
     std::shared_ptr<Semaphore> lockSem, counterSem;
 
     {
-        auto lock = system.Lock();
-
         lockSem = system.GetSemaphore(lockSemId).lock();
         counterSem = system.GetSemaphore(counterSemId).lock();
 
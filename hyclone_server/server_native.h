@@ -2,6 +2,7 @@
 #define __SERVER_NATIVE_H__
 
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
@@ -14,6 +15,8 @@ struct haiku_fs_info;
 
 size_t server_read_process_memory(int pid, void* address, void* buffer, size_t size);
 size_t server_write_process_memory(int pid, void* address, const void* buffer, size_t size);
+// Writes right away, even if the current servercall comes from the same process.
+size_t server_write_process_memory_direct(int pid, void* address, const void* buffer, size_t size);
 
 void server_send_request(int pid, int tid);
 
@@ -34,4 +37,16 @@ status_t server_remove_native_monitor(haiku_dev_t device, haiku_ino_t node);
 
 void server_exit_thread();
 
+// Waits until the 32-bit word shared with a client process no longer holds value.
+// A negative timeout waits forever. Returns false if the wait timed out.
+bool server_futex_wait(uint32_t* address, uint32_t value, int64_t timeoutMicroseconds = -1);
+void server_futex_wake(uint32_t* address, int count);
+
+// The most words server_futex_wait_multiple can wait on at once.
+#define SERVER_FUTEX_WAIT_MULTIPLE_MAX 128
+// Waits until one of the words no longer holds its value, or is woken.
+// Returns the index of a woken word, or a negative error code.
+int server_futex_wait_multiple(uint32_t* const* addresses, const uint32_t* values, size_t count);
+bool server_futex_wait_multiple_supported();
+
 #endif // __SERVER_NATIVE_H__
\ No newline at end of file
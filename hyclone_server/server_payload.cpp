@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstring>
+
+#include "haiku_errors.h"
+#include "server_payload.h"
+#include "server_servercalls.h"
+
+static bool server_ranges_overlap(uintptr_t address1, size_t size1, uintptr_t address2, size_t size2,
+    uintptr_t& start, uintptr_t& end)
+{
+    start = std::max(address1, address2);
+    end = std::min(address1 + size1, address2 + size2);
+    return start < end;
+}
+
+bool ServercallPayload::Parse(const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    size_t offset = 0;
+
+    _regions.clear();
+    _data.clear();
+    _reply.clear();
+
+    while (offset < size)
+    {
+        if (size - offset < sizeof(servercall_inline_record))
+        {
+            return false;
+        }
+
+        servercall_inline_record record;
+        memcpy(&record, bytes + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (record.address + record.size < record.address)
+        {
+            return false;
+        }
+
+        Region region = { (uintptr_t)record.address, record.size, record.flags, _data.size() };
+
+        if (record.flags & SERVERCALL_INLINE_IN)
+        {
+            size_t alignedSize = SERVERCALL_INLINE_ALIGN(record.size);
+            if (size - offset < alignedSize)
+            {
+                return false;
+            }
+            _data.insert(_data.end(), bytes + offset, bytes + offset + record.size);
+            offset += alignedSize;
+        }
+
+        _regions.push_back(region);
+    }
+
+    return true;
+}
+
+const ServercallPayload::Region* ServercallPayload::_FindRegion(uintptr_t address, size_t size, uint32_t flags) const
+{
+    for (const auto& region : _regions)
+    {
+        if ((region.flags & flags) == flags
+            && address >= region.address && address + size <= region.address + region.size)
+        {
+            return &region;
+        }
+    }
+    return NULL;
+}
+
+bool ServercallPayload::Read(uintptr_t address, void* buffer, size_t size) const
+{
+    const Region* region = _FindRegion(address, size, SERVERCALL_INLINE_IN);
+    if (region == NULL)
+    {
+        return false;
+    }
+
+    memcpy(buffer, _data.data() + region->offset + (address - region->address), size);
+    return true;
+}
+
+void ServercallPayload::Overlay(uintptr_t address, void* buffer, size_t size) const
+{
+    ForEachWrite(_reply, [&](uintptr_t writeAddress, const char* data, size_t writeSize)
+    {
+        uintptr_t start, end;
+        if (server_ranges_overlap(address, size, writeAddress, writeSize, start, end))
+        {
+            memcpy((char*)buffer + (start - address), data + (start - writeAddress), end - start);
+        }
+    });
+}
+
+bool ServercallPayload::Write(uintptr_t address, const void* buffer, size_t size)
+{
+    if (_FindRegion(address, size, SERVERCALL_INLINE_OUT) == NULL)
+    {
+        return false;
+    }
+
+    size_t recordSize = sizeof(servercall_inline_record) + SERVERCALL_INLINE_ALIGN(size);
+    if (_reply.size() + recordSize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    servercall_inline_record record = { address, (uint32_t)size, 0 };
+    size_t offset = _reply.size();
+    _reply.resize(offset + recordSize);
+    memcpy(_reply.data() + offset, &record, sizeof(record));
+    memcpy(_reply.data() + offset + sizeof(record), buffer, size);
+
+    Update(address, buffer, size);
+
+    return true;
+}
+
+void ServercallPayload::Update(uintptr_t address, const void* buffer, size_t size)
+{
+    for (const auto& region : _regions)
+    {
+        uintptr_t start, end;
+        if ((region.flags & SERVERCALL_INLINE_IN)
+            && server_ranges_overlap(address, size, region.address, region.size, start, end))
+        {
+            memcpy(_data.data() + region.offset + (start - region.address),
+                (const char*)buffer + (start - address), end - start);
+        }
+    }
+}
+
+intptr_t server_dispatch_with_payload(intptr_t conn_id, const intptr_t* args,
+    const void* payload, size_t payloadSize, std::vector<char>& reply,
+    hserver_connection* connection)
+{
+    reply.clear();
+
+    if (payloadSize == 0)
+    {
+        return server_dispatch(conn_id, args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+            NULL, connection);
+    }
+
+    ServercallPayload inlinePayload;
+    if (!inlinePayload.Parse(payload, payloadSize))
+    {
+        return B_BAD_VALUE;
+    }
+
+    intptr_t result = server_dispatch(conn_id, args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+        &inlinePayload, connection);
+
+    reply = inlinePayload.TakeReply();
+
+    return result;
+}
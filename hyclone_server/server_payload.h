@@ -0,0 +1,74 @@
+#ifndef __SERVER_PAYLOAD_H__
+#define __SERVER_PAYLOAD_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "servercalls.h"
+
+struct hserver_connection;
+
+// Memory of the calling process shipped inline with a servercall.
+class ServercallPayload
+{
+private:
+    struct Region
+    {
+        uintptr_t address;
+        size_t size;
+        uint32_t flags;
+        // Offset of the contents of input regions in _data.
+        size_t offset;
+    };
+
+    std::vector<Region> _regions;
+    std::vector<char> _data;
+    std::vector<char> _reply;
+
+    const Region* _FindRegion(uintptr_t address, size_t size, uint32_t flags) const;
+public:
+    ServercallPayload() = default;
+    ~ServercallPayload() = default;
+
+    bool Parse(const void* data, size_t size);
+    bool IsEmpty() const { return _regions.empty(); }
+
+    // Serves a read entirely from an input region.
+    // Returns false if the caller has to read the process memory instead.
+    bool Read(uintptr_t address, void* buffer, size_t size) const;
+    // Applies pending writes to data that has been read from the process memory.
+    void Overlay(uintptr_t address, void* buffer, size_t size) const;
+    // Queues a write to an output region into the reply.
+    // Returns false if the caller has to write the process memory instead.
+    bool Write(uintptr_t address, const void* buffer, size_t size);
+    // Keeps input regions in sync with a write that went to the process memory.
+    void Update(uintptr_t address, const void* buffer, size_t size);
+
+    bool HasPendingWrites() const { return !_reply.empty(); }
+    // Hands out the pending writes, for the caller to apply them directly.
+    std::vector<char> TakeReply() { return std::move(_reply); }
+    const std::vector<char>& GetReply() const { return _reply; }
+
+    // Iterates through the records of a reply payload.
+    template <typename Function>
+    static void ForEachWrite(const std::vector<char>& reply, Function&& func)
+    {
+        size_t offset = 0;
+        while (offset + sizeof(servercall_inline_record) <= reply.size())
+        {
+            const auto& record = *(const servercall_inline_record*)(reply.data() + offset);
+            offset += sizeof(servercall_inline_record);
+            func((uintptr_t)record.address, reply.data() + offset, (size_t)record.size);
+            offset += SERVERCALL_INLINE_ALIGN(record.size);
+        }
+    }
+};
+
+// Dispatches a servercall frame along with its inline payload.
+// Fills reply with the payload to send back to the client.
+intptr_t server_dispatch_with_payload(intptr_t conn_id, const intptr_t* args,
+    const void* payload, size_t payloadSize, std::vector<char>& reply,
+    hserver_connection* connection = NULL);
+
+#endif // __SERVER_PAYLOAD_H__
@@ -0,0 +1,138 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "area.h"
+#include "hsemaphore.h"
+#include "process.h"
+#include "server_reaper.h"
+#include "server_workers.h"
+#include "system.h"
+
+static std::mutex sReaperLock;
+static std::condition_variable sReaperCondition;
+static std::vector<DeadTeam> sDeadTeams;
+static std::once_flag sReaperInitFlag;
+
+static void server_reaper_notify_debugger(DeadTeam& team)
+{
+    // Written from the worker pool, so that a stalled debugger does not hold up
+    // the teardown of every other team. The waits park the worker.
+    server_worker_run([](std::shared_ptr<Port> port, std::shared_ptr<Semaphore> writeLock, int tid,
+        std::vector<Port::Message> messages)
+    {
+        writeLock->Acquire(tid, 1);
+
+        for (auto& message: messages)
+        {
+            port->Write(std::move(message), B_INFINITE_TIMEOUT);
+        }
+
+        writeLock->Release(1);
+    }, std::move(team.debuggerPort), std::move(team.debuggerWriteLock), team.tid,
+        std::move(team.debuggerMessages));
+}
+
+static void server_reaper_release(DeadTeam& team)
+{
+    auto& system = System::GetInstance();
+
+    // A team that has called exec lives on, and has been prepared by the disconnect already.
+    if (team.event != TEAM_EXEC)
+    {
+        team.process->PrepareForDeletion();
+    }
+
+    // Unregistering wakes up everyone blocked on these objects.
+    for (int id: team.semaphores)
+    {
+        system.UnregisterSemaphore(id);
+    }
+
+    for (int id: team.ports)
+    {
+        system.UnregisterPort(id);
+    }
+
+    if (team.debuggerNubPort != -1)
+    {
+        system.UnregisterPort(team.debuggerNubPort);
+    }
+
+    for (const auto& [id, area]: team.areas)
+    {
+        system.UnregisterArea(id);
+    }
+    team.areas.clear();
+
+    if (!team.debuggerMessages.empty() && team.debuggerPort && team.debuggerWriteLock)
+    {
+        server_reaper_notify_debugger(team);
+    }
+}
+
+static void server_reaper_main()
+{
+    std::vector<DeadTeam> teams;
+
+    while (true)
+    {
+        {
+            auto lock = std::unique_lock(sReaperLock);
+            sReaperCondition.wait(lock, []() { return !sDeadTeams.empty(); });
+            teams.swap(sDeadTeams);
+        }
+
+        for (auto& team: teams)
+        {
+            server_reaper_release(team);
+        }
+
+        auto& system = System::GetInstance();
+
+        {
+            auto& msgService = system.GetMessagingService();
+            auto msgLock = msgService.Lock();
+
+            for (const auto& team: teams)
+            {
+                if (team.event == TEAM_EXEC)
+                {
+                    continue;
+                }
+
+                // Will silently fail if the process is not the registered
+                // message server.
+                msgService.UnregisterService(team.process);
+            }
+        }
+
+        {
+            auto& teamService = system.GetTeamNotificationService();
+            auto notificationLock = teamService.Lock();
+
+            for (const auto& team: teams)
+            {
+                teamService.Notify(team.event, team.process);
+            }
+        }
+
+        teams.clear();
+    }
+}
+
+void server_reap_team(DeadTeam&& team)
+{
+    std::call_once(sReaperInitFlag, []()
+    {
+        std::thread(server_reaper_main).detach();
+    });
+
+    {
+        auto lock = std::unique_lock(sReaperLock);
+        sDeadTeams.emplace_back(std::move(team));
+    }
+
+    sReaperCondition.notify_one();
+}
@@ -0,0 +1,40 @@
+#ifndef __SERVER_REAPER_H__
+#define __SERVER_REAPER_H__
+
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "port.h"
+
+struct Area;
+class Process;
+class Semaphore;
+
+// What is left of a team once it has been detached from the system tables.
+struct DeadTeam
+{
+    std::shared_ptr<Process> process;
+    // The thread that disconnected last.
+    int tid = -1;
+    // TEAM_REMOVED, or TEAM_EXEC if the process lives on in a new image.
+    int event = 0;
+    std::unordered_set<int> semaphores;
+    std::set<int> ports;
+    std::map<int, std::shared_ptr<Area>> areas;
+    int debuggerNubPort = -1;
+    std::shared_ptr<Port> debuggerPort;
+    std::shared_ptr<Semaphore> debuggerWriteLock;
+    std::vector<Port::Message> debuggerMessages;
+};
+
+// Queues a dead team to the reaper thread, which releases the team's objects,
+// wakes whoever waits on them and sends the team notifications.
+// For TEAM_EXEC, the caller must have prepared the process for deletion and
+// unregistered its messaging service before the new image starts.
+// The thread is lazily started on the first submission.
+void server_reap_team(DeadTeam&& team);
+
+#endif // __SERVER_REAPER_H__
@@ -1,10 +1,12 @@
 #ifndef __SERVER_SERVERCALLS_H__
 #define __SERVER_SERVERCALLS_H__
 
+#include <atomic>
 #include <cstddef>
 #include <memory>
 
 class Process;
+class ServercallPayload;
 class Thread;
 
 struct hserver_context
@@ -15,6 +17,28 @@ struct hserver_context
 
     std::shared_ptr<Process> process;
     std::shared_ptr<Thread> thread;
+
+    // Memory of the calling thread shipped along with the call.
+    ServercallPayload* payload = NULL;
+};
+
+// The caller behind a connection. It never changes after connect, so it is
+// resolved by the first call that succeeds and reused until disconnect.
+struct hserver_connection
+{
+    enum : int
+    {
+        UNRESOLVED,
+        RESOLVING,
+        RESOLVED,
+        DISCONNECTED,
+    };
+
+    std::atomic<int> state = UNRESOLVED;
+    int pid = -1;
+    int tid = -1;
+    std::shared_ptr<Process> process;
+    std::shared_ptr<Thread> thread;
 };
 
 #define HYCLONE_SERVERCALL0(name) \
@@ -42,7 +66,13 @@ struct hserver_context
 #undef HYCLONE_SERVERCALL5
 #undef HYCLONE_SERVERCALL6
 
+// connection, if given, caches the caller between calls on the same connection.
 intptr_t server_dispatch(intptr_t conn_id,
+    intptr_t call_id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6,
+    ServercallPayload* payload = NULL, hserver_connection* connection = NULL);
+
+// Runs a servercall with an already resolved context.
+intptr_t server_dispatch_call(hserver_context& context,
     intptr_t call_id, intptr_t a1, intptr_t a2, intptr_t a3, intptr_t a4, intptr_t a5, intptr_t a6);
 
 extern thread_local hserver_context* gCurrentContext;
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+#include "haiku_errors.h"
+#include "servercall_stats.h"
+#include "servercalls.h"
+#include "server_main.h"
+#include "server_native.h"
+#include "server_servercalls.h"
+#include "server_stats.h"
+#include "server_systemtime.h"
+#include "server_workers.h"
+
+struct CallStats
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> queueTime;
+    std::atomic<uint64_t> execTime;
+    std::atomic<uint32_t> queueHistogram[SERVERCALL_STATS_HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> execHistogram[SERVERCALL_STATS_HISTOGRAM_BUCKETS];
+};
+
+// Plain counters, updated without any lock. A reset racing with
+// calls in flight may leave them slightly inconsistent.
+static CallStats sCallStats[SERVERCALL_ID_COUNT];
+static std::atomic<int64_t> sResetTime = server_system_time_nsecs();
+
+static size_t server_stats_bucket(uint64_t nanoseconds)
+{
+    uint64_t microseconds = nanoseconds / 1000;
+    return std::min((size_t)std::bit_width(microseconds), (size_t)SERVERCALL_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void server_stats_record_queue(intptr_t call_id, uint64_t nanoseconds)
+{
+    if (call_id < 0 || call_id >= SERVERCALL_ID_COUNT)
+    {
+        return;
+    }
+
+    auto& stats = sCallStats[call_id];
+    stats.queueTime.fetch_add(nanoseconds, std::memory_order_relaxed);
+    stats.queueHistogram[server_stats_bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void server_stats_record_exec(intptr_t call_id, uint64_t nanoseconds)
+{
+    if (call_id < 0 || call_id >= SERVERCALL_ID_COUNT)
+    {
+        return;
+    }
+
+    auto& stats = sCallStats[call_id];
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.execTime.fetch_add(nanoseconds, std::memory_order_relaxed);
+    stats.execHistogram[server_stats_bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+intptr_t server_hserver_call_get_servercall_stats(hserver_context& context, int firstId,
+    void* userBuffer, size_t bufferSize)
+{
+    if (firstId < 0 || bufferSize < sizeof(servercall_stats_info))
+    {
+        return B_BAD_VALUE;
+    }
+
+    size_t entryCount = 0;
+    if (firstId < SERVERCALL_ID_COUNT)
+    {
+        entryCount = std::min((bufferSize - sizeof(servercall_stats_info)) / sizeof(servercall_stats_entry),
+            (size_t)(SERVERCALL_ID_COUNT - firstId));
+    }
+
+    std::vector<char> buffer(sizeof(servercall_stats_info) + entryCount * sizeof(servercall_stats_entry));
+
+    auto& info = *(servercall_stats_info*)buffer.data();
+    info.callCount = SERVERCALL_ID_COUNT;
+    info.entryCount = entryCount;
+    info.connectionCount = server_get_connection_count();
+    size_t busyWorkers, workerSlots;
+    server_worker_get_usage(busyWorkers, workerSlots);
+    info.busyWorkers = busyWorkers;
+    info.workerSlots = workerSlots;
+    info.elapsedTime = server_system_time_nsecs() - sResetTime.load(std::memory_order_relaxed);
+
+    auto entries = (servercall_stats_entry*)(buffer.data() + sizeof(servercall_stats_info));
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        const auto& stats = sCallStats[firstId + i];
+        auto& entry = entries[i];
+        entry.id = firstId + i;
+        entry.count = stats.count.load(std::memory_order_relaxed);
+        entry.queueTime = stats.queueTime.load(std::memory_order_relaxed);
+        entry.execTime = stats.execTime.load(std::memory_order_relaxed);
+        for (size_t j = 0; j < SERVERCALL_STATS_HISTOGRAM_BUCKETS; ++j)
+        {
+            entry.queueHistogram[j] = stats.queueHistogram[j].load(std::memory_order_relaxed);
+            entry.execHistogram[j] = stats.execHistogram[j].load(std::memory_order_relaxed);
+        }
+    }
+
+    if (server_write_process_memory(context.pid, userBuffer, buffer.data(), buffer.size()) != buffer.size())
+    {
+        return B_BAD_ADDRESS;
+    }
+
+    return entryCount;
+}
+
+intptr_t server_hserver_call_reset_servercall_stats(hserver_context& context)
+{
+    for (auto& stats : sCallStats)
+    {
+        stats.count.store(0, std::memory_order_relaxed);
+        stats.queueTime.store(0, std::memory_order_relaxed);
+        stats.execTime.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < SERVERCALL_STATS_HISTOGRAM_BUCKETS; ++i)
+        {
+            stats.queueHistogram[i].store(0, std::memory_order_relaxed);
+            stats.execHistogram[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    sResetTime.store(server_system_time_nsecs(), std::memory_order_relaxed);
+
+    return B_OK;
+}
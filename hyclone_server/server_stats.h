@@ -0,0 +1,11 @@
+#ifndef __SERVER_STATS_H__
+#define __SERVER_STATS_H__
+
+#include <cstdint>
+
+// Records how long a servercall waited for a worker to pick it up.
+void server_stats_record_queue(intptr_t call_id, uint64_t nanoseconds);
+// Records a finished servercall.
+void server_stats_record_exec(intptr_t call_id, uint64_t nanoseconds);
+
+#endif // __SERVER_STATS_H__
@@ -308,10 +308,7 @@ intptr_t server_hserver_call_start_watching_system(hserver_context& context,
 
     std::shared_ptr<Port> portPtr;
 
-    {
-        auto lock = system.Lock();
-        portPtr = system.GetPort(port).lock();
-    }
+    portPtr = system.GetPort(port).lock();
 
     if (!portPtr)
     {
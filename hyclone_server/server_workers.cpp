@@ -1,15 +1,236 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <thread>
+#include <vector>
+
 #include "server_workers.h"
 
-std::atomic<int> server_remaining_workers = std::thread::hardware_concurrency();
+// How long a worker that has lost its slot waits for
+// another one before exiting.
+const auto kSpareWorkerTimeout = std::chrono::seconds(30);
 
-void server_worker_sleep(uint64_t microseconds_delay)
+class WorkerPool
+{
+private:
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::deque<std::unique_ptr<ServerWorkerTask>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::atomic<size_t> _nextQueue = 0;
+    std::atomic<size_t> _pendingTasks = 0;
+    std::atomic<size_t> _busyWorkers = 0;
+
+    // Guards the sleeping and slot bookkeeping below.
+    std::mutex _lock;
+    // Slot owners with nothing to do wait here.
+    std::condition_variable _workCondVar;
+    // Spare threads waiting for a slot to be handed over wait here.
+    std::condition_variable _slotCondVar;
+    std::vector<size_t> _freeSlots;
+    size_t _sleepingWorkers = 0;
+    size_t _spareWorkers = 0;
+
+    static constexpr size_t kNoSlot = (size_t)-1;
+    static thread_local size_t _currentSlot;
+
+    void WorkerMain(size_t slot);
+    std::unique_ptr<ServerWorkerTask> Pop(size_t slot);
+    bool AcquireSlot();
+public:
+    WorkerPool(size_t count);
+    ~WorkerPool() = default;
+
+    void Submit(std::unique_ptr<ServerWorkerTask>&& task);
+    void Park();
+
+    size_t GetBusyWorkers() const { return _busyWorkers; }
+    size_t GetSlotCount() const { return _queues.size(); }
+};
+
+thread_local size_t WorkerPool::_currentSlot = WorkerPool::kNoSlot;
+
+WorkerPool::WorkerPool(size_t count)
+{
+    count = std::max(count, (size_t)1);
+    _queues.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        _queues.emplace_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::thread(&WorkerPool::WorkerMain, this, i).detach();
+    }
+}
+
+void WorkerPool::Submit(std::unique_ptr<ServerWorkerTask>&& task)
+{
+    auto& queue = *_queues[_nextQueue++ % _queues.size()];
+
+    ++_pendingTasks;
+
+    {
+        auto lock = std::unique_lock(queue.lock);
+        queue.tasks.emplace_back(std::move(task));
+    }
+
+    {
+        auto lock = std::unique_lock(_lock);
+        if (_sleepingWorkers)
+        {
+            _workCondVar.notify_one();
+        }
+    }
+}
+
+void WorkerPool::Park()
 {
-    ++server_remaining_workers;
-    server_remaining_workers.notify_one();
+    if (_currentSlot == kNoSlot)
+    {
+        return;
+    }
+
+    size_t slot = _currentSlot;
+    _currentSlot = kNoSlot;
+
+    auto lock = std::unique_lock(_lock);
+    if (_spareWorkers > _freeSlots.size())
+    {
+        _freeSlots.push_back(slot);
+        _slotCondVar.notify_one();
+    }
+    else
+    {
+        std::thread(&WorkerPool::WorkerMain, this, slot).detach();
+    }
+}
+
+void WorkerPool::WorkerMain(size_t slot)
+{
+    _currentSlot = slot;
+
+    while (true)
+    {
+        if (_currentSlot == kNoSlot && !AcquireSlot())
+        {
+            return;
+        }
+
+        auto task = Pop(_currentSlot);
+        if (task)
+        {
+            --_pendingTasks;
+            ++_busyWorkers;
+            task->Run();
+            --_busyWorkers;
+            continue;
+        }
 
-    std::this_thread::sleep_for(std::chrono::microseconds(microseconds_delay));
+        auto lock = std::unique_lock(_lock);
+        ++_sleepingWorkers;
+        _workCondVar.wait(lock, [&]()
+        {
+            return _pendingTasks > 0;
+        });
+        --_sleepingWorkers;
+    }
+}
 
-    server_remaining_workers.wait(0);
-    --server_remaining_workers;
-}
\ No newline at end of file
+std::unique_ptr<ServerWorkerTask> WorkerPool::Pop(size_t slot)
+{
+    std::unique_ptr<ServerWorkerTask> task;
+
+    // Serve our own queue first, in order.
+    {
+        auto& queue = *_queues[slot];
+        auto lock = std::unique_lock(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return task;
+        }
+    }
+
+    // Then steal from the back of the other queues.
+    for (size_t i = 1; i < _queues.size(); ++i)
+    {
+        auto& queue = *_queues[(slot + i) % _queues.size()];
+        auto lock = std::unique_lock(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return task;
+        }
+    }
+
+    return task;
+}
+
+bool WorkerPool::AcquireSlot()
+{
+    auto lock = std::unique_lock(_lock);
+
+    ++_spareWorkers;
+    _slotCondVar.wait_for(lock, kSpareWorkerTimeout, [&]()
+    {
+        return !_freeSlots.empty();
+    });
+    --_spareWorkers;
+
+    if (_freeSlots.empty())
+    {
+        return false;
+    }
+
+    _currentSlot = _freeSlots.back();
+    _freeSlots.pop_back();
+
+    return true;
+}
+
+static WorkerPool& server_get_worker_pool()
+{
+    // Never destroyed, as detached workers may still be running at exit.
+    static WorkerPool* pool = new WorkerPool(std::thread::hardware_concurrency());
+    return *pool;
+}
+
+void server_worker_submit(std::unique_ptr<ServerWorkerTask>&& task)
+{
+    server_get_worker_pool().Submit(std::move(task));
+}
+
+void server_worker_park()
+{
+    server_get_worker_pool().Park();
+}
+
+void server_worker_unpark()
+{
+    // Nothing to do here. The worker loop reclaims a slot,
+    // or retires the thread, once the current task is done.
+}
+
+void server_worker_get_usage(size_t& busyWorkers, size_t& slots)
+{
+    auto& pool = server_get_worker_pool();
+    busyWorkers = pool.GetBusyWorkers();
+    slots = pool.GetSlotCount();
+}
+
+void server_worker_sleep(uint64_t microseconds_delay)
+{
+    server_worker_run_wait([&]()
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(microseconds_delay));
+    });
+}
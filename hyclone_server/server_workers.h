@@ -1,27 +1,55 @@
 #ifndef __SERVER_WORKERS_H__
 #define __SERVER_WORKERS_H__
 
-#include <atomic>
 #include <cstddef>
-#include <thread>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
-extern std::atomic<int> server_remaining_workers;
+// A unit of work queued to the server worker pool.
+class ServerWorkerTask
+{
+public:
+    virtual ~ServerWorkerTask() = default;
+    virtual void Run() = 0;
+};
 
 template <typename Function, typename... Args>
-void server_worker_run(Function&& func, Args&&... args)
+class ServerWorkerTaskImpl : public ServerWorkerTask
 {
-    std::thread([](Function&& f, Args&&... a)
+private:
+    std::decay_t<Function> _func;
+    std::tuple<std::decay_t<Args>...> _args;
+public:
+    ServerWorkerTaskImpl(Function&& func, Args&&... args)
+        : _func(std::forward<Function>(func)), _args(std::forward<Args>(args)...) { }
+
+    void Run() override
     {
-        // Wait if there aren't any remaning workers.
-        server_remaining_workers.wait(0);
-        --server_remaining_workers;
+        std::apply(std::move(_func), std::move(_args));
+    }
+};
+
+// Queues a task to the persistent worker pool.
+// The pool is lazily started on the first submission, so that
+// it is created after the server has daemonized.
+void server_worker_submit(std::unique_ptr<ServerWorkerTask>&& task);
 
-        f(std::forward<Args&&>(a)...);
+// Gives up the current worker's pool slot before a blocking wait,
+// so that another worker can serve queued calls in the meantime.
+// Has no effect on threads that do not own a slot.
+void server_worker_park();
+// Called after a blocking wait. The thread finishes its current task
+// and then competes for a free slot with the other spare workers.
+void server_worker_unpark();
 
-        ++server_remaining_workers;
-        server_remaining_workers.notify_one();
-    }, std::move(func), std::forward<Args&&>(args)...).detach();
+template <typename Function, typename... Args>
+void server_worker_run(Function&& func, Args&&... args)
+{
+    server_worker_submit(std::make_unique<ServerWorkerTaskImpl<Function, Args...>>(
+        std::forward<Function>(func), std::forward<Args>(args)...));
 }
 
 // Allows other workers to be spawned and run while
@@ -29,27 +57,29 @@ void server_worker_run(Function&& func, Args&&... args)
 template <typename Function, typename... Args>
 auto server_worker_run_wait(Function&& func, Args&&... args)
 {
-    struct Cleaner
+    struct Parker
     {
-        Cleaner()
+        Parker()
         {
-            ++server_remaining_workers;
-            server_remaining_workers.notify_one();
+            server_worker_park();
         }
-        ~Cleaner()
+        ~Parker()
         {
-            server_remaining_workers.wait(0);
-            --server_remaining_workers;
+            server_worker_unpark();
         }
     };
 
-    Cleaner cleaner;
+    Parker parker;
 
     return func(std::forward<Args&&>(args)...);
 }
 
+// Returns the number of workers running a task, including parked ones,
+// and the number of pool slots.
+void server_worker_get_usage(size_t& busyWorkers, size_t& slots);
+
 // This function takes an argument in microseconds
 // to match Haiku's commonly used bigtime_t.
 void server_worker_sleep(uint64_t microseconds_delay);
 
-#endif // __SERVER_WORKERS_H__
\ No newline at end of file
+#endif // __SERVER_WORKERS_H__
@@ -1,30 +1,295 @@
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <signal.h>
 #include <string>
-#include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include "servercalls.h"
+#include "server_channel.h"
+#include "server_payload.h"
 #include "server_prefix.h"
+#include "server_stats.h"
+#include "server_systemtime.h"
 #include "server_servercalls.h"
 #include "server_workers.h"
 #include "system.h"
 
 #include "server_main.h"
 
-const int kBufferLength = (1 + HYCLONE_SERVERCALL_MAX_ARGS);
-const int kBufferSize = sizeof(intptr_t) * kBufferLength;
+const int kFrameSize = sizeof(intptr_t) * HYCLONE_SERVERCALL_FRAME_LENGTH;
+const int kReplySize = sizeof(intptr_t) * HYCLONE_SERVERCALL_REPLY_LENGTH;
+const int kMaxEvents = 64;
+const unsigned int kMaxEventThreads = 4;
+
+class ServerConnection : public std::enable_shared_from_this<ServerConnection>
+{
+private:
+    struct PendingCall
+    {
+        intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH];
+        std::vector<char> payload;
+        int64_t receiveTime;
+    };
+
+    int _fd;
+    // Partially received servercall frame and its payload.
+    intptr_t _frame[HYCLONE_SERVERCALL_FRAME_LENGTH];
+    std::vector<char> _payload;
+    size_t _received = 0;
+
+    hserver_connection _state;
+
+    // Calls that have to wait for earlier one-way calls to complete.
+    std::mutex _queueLock;
+    std::deque<std::unique_ptr<PendingCall>> _queue;
+    bool _isDraining = false;
+
+    void _Run(PendingCall& call);
+    void _Drain();
+public:
+    ServerConnection(int fd) : _fd(fd) { }
+    ~ServerConnection() { close(_fd); }
+
+    int GetFd() const { return _fd; }
+    hserver_connection* GetState() { return &_state; }
+
+    // Drains the socket, dispatching every complete frame.
+    // Returns false if the peer has closed the connection.
+    bool Receive();
+    bool Send(const void* data, size_t size);
+    // Sends fd with a single marker byte, which the client drops.
+    bool SendFd(int fd);
+    void Dispatch(const intptr_t* frame, std::vector<char>&& payload);
+};
+
+static int sEpollFd = -1;
+static int sListenSocket = -1;
+static std::mutex sConnectionsLock;
+static std::unordered_map<int, std::shared_ptr<ServerConnection>> sConnections;
+
+static void server_event_loop();
+static void server_accept_connections();
+static void server_close_connection_state(const std::shared_ptr<ServerConnection>& connection);
+
+bool ServerConnection::Receive()
+{
+    while (true)
+    {
+        char* target;
+        size_t remaining;
+
+        if (_received < kFrameSize)
+        {
+            target = (char*)_frame + _received;
+            remaining = kFrameSize - _received;
+        }
+        else
+        {
+            target = _payload.data() + (_received - kFrameSize);
+            remaining = kFrameSize + _payload.size() - _received;
+        }
+
+        ssize_t bytesRead = read(_fd, target, remaining);
+        if (bytesRead == 0)
+        {
+            return false;
+        }
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        _received += bytesRead;
+
+        if (_received == kFrameSize)
+        {
+            size_t payloadSize = _frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_PAYLOAD_SIZE_MASK;
+            if (payloadSize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+            {
+                std::cerr << "Invalid payload size: " << payloadSize << std::endl;
+                return false;
+            }
+            _payload.resize(payloadSize);
+        }
+
+        if (_received == kFrameSize + _payload.size())
+        {
+            _received = 0;
+            Dispatch(_frame, std::move(_payload));
+            _payload.clear();
+        }
+    }
+}
+
+bool ServerConnection::Send(const void* data, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t bytesWritten = write(_fd, (const char*)data + sent, size - sent);
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd pfd = { _fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return false;
+        }
+        sent += bytesWritten;
+    }
+    return true;
+}
+
+bool ServerConnection::SendFd(int fd)
+{
+    char marker = 0;
+    struct iovec iov = { &marker, sizeof(marker) };
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    while (true)
+    {
+        ssize_t bytesWritten = sendmsg(_fd, &message, 0);
+        if (bytesWritten == sizeof(marker))
+        {
+            return true;
+        }
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd pfd = { _fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+        }
+        return false;
+    }
+}
+
+void ServerConnection::Dispatch(const intptr_t* frame, std::vector<char>&& payload)
+{
+    auto call = std::make_unique<PendingCall>();
+    memcpy(call->frame, frame, kFrameSize);
+    call->payload = std::move(payload);
+    call->receiveTime = server_system_time_nsecs();
+    // std::cerr << "received servercall: " + std::to_string(call->frame[0]) << std::endl;
+
+    bool isOneWay = call->frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_FLAG_ONEWAY;
+
+    {
+        auto lock = std::unique_lock(_queueLock);
+        // One-way calls, and anything that comes after them while they are
+        // still pending, run in order on a single worker.
+        if (isOneWay || _isDraining)
+        {
+            _queue.push_back(std::move(call));
+            if (!_isDraining)
+            {
+                _isDraining = true;
+                server_worker_run([](std::shared_ptr<ServerConnection> connection)
+                {
+                    connection->_Drain();
+                }, shared_from_this());
+            }
+            return;
+        }
+    }
+
+    server_worker_run([](std::shared_ptr<ServerConnection> connection, std::unique_ptr<PendingCall> dispatchCall)
+    {
+        connection->_Run(*dispatchCall);
+    }, shared_from_this(), std::move(call));
+}
+
+void ServerConnection::_Drain()
+{
+    while (true)
+    {
+        std::unique_ptr<PendingCall> call;
+
+        {
+            auto lock = std::unique_lock(_queueLock);
+            if (_queue.empty())
+            {
+                _isDraining = false;
+                return;
+            }
+            call = std::move(_queue.front());
+            _queue.pop_front();
+        }
+
+        _Run(*call);
+    }
+}
+
+void ServerConnection::_Run(PendingCall& call)
+{
+    server_stats_record_queue(call.frame[0], server_system_time_nsecs() - call.receiveTime);
+
+    std::vector<char> replyPayload;
+    intptr_t returnValue =
+        server_dispatch_with_payload(_fd, call.frame,
+            call.payload.data(), call.payload.size(), replyPayload, &_state);
+
+    if (call.frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] & HYCLONE_SERVERCALL_FLAG_ONEWAY)
+    {
+        return;
+    }
+
+    std::vector<char> reply(kReplySize + replyPayload.size());
+    intptr_t replyHeader[HYCLONE_SERVERCALL_REPLY_LENGTH] = { returnValue, (intptr_t)replyPayload.size() };
+    memcpy(reply.data(), replyHeader, kReplySize);
+    if (!replyPayload.empty())
+    {
+        memcpy(reply.data() + kReplySize, replyPayload.data(), replyPayload.size());
+    }
+
+    Send(reply.data(), reply.size());
+}
 
 int server_main(int argc, char **argv)
 {
@@ -100,9 +365,6 @@ int server_main(int argc, char **argv)
     daemon(0, 0);
     freopen((std::filesystem::path(gHaikuPrefix) / ".hyclone.log").c_str(), "w", stderr);
 
-    std::vector<pollfd> pollfds;
-    pollfds.push_back({listen_socket, POLLIN, 0});
-
     auto& system = System::GetInstance();
     {
         auto lock = system.Lock();
@@ -110,106 +372,192 @@ int server_main(int argc, char **argv)
         system.RegisterConnection(listen_socket, Connection(0, 0));
     }
 
+    fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL) | O_NONBLOCK);
+
+    sListenSocket = listen_socket;
+    sEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (sEpollFd == -1)
+    {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    // All fds are registered as one-shot, so that each is served by only one
+    // event thread at a time. They are re-armed once they have been drained.
+    epoll_event listenEvent;
+    listenEvent.events = EPOLLIN | EPOLLONESHOT;
+    listenEvent.data.ptr = NULL;
+    if (epoll_ctl(sEpollFd, EPOLL_CTL_ADD, listen_socket, &listenEvent) == -1)
+    {
+        perror("epoll_ctl");
+        return 1;
+    }
+
+    unsigned int eventThreadCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, kMaxEventThreads);
+    for (unsigned int i = 1; i < eventThreadCount; ++i)
+    {
+        std::thread(server_event_loop).detach();
+    }
+
+    server_event_loop();
+
+    return 0;
+}
+
+void server_event_loop()
+{
+    auto& system = System::GetInstance();
+    epoll_event events[kMaxEvents];
+
     while (!system.IsShuttingDown())
     {
-        status = poll(pollfds.data(), (nfds_t)pollfds.size(), -1);
-        if (status == -1)
+        int count = epoll_wait(sEpollFd, events, kMaxEvents, -1);
+        if (count == -1)
         {
-            perror("poll");
-            return 1;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            std::exit(1);
         }
 
-        size_t oldSize = pollfds.size();
-        for (size_t i = 0; i < oldSize; ++i)
+        for (int i = 0; i < count; ++i)
         {
-            const auto &[fd, events, revents] = pollfds[i];
-            if (fd == listen_socket)
+            if (events[i].data.ptr == NULL)
             {
-                if (revents & POLLIN)
-                {
-                    int data_socket = accept(listen_socket, NULL, NULL);
-                    if (data_socket < 0)
-                    {
-                        perror("accept");
-                        return 1;
-                    }
-                    std::cerr << "accepted connection" << std::endl;
-                    pollfds.push_back({data_socket, POLLIN, 0});
-                }
+                server_accept_connections();
+                continue;
             }
-            else if (revents & POLLIN)
-            {
-                int inputBytes = 0;
-                if (ioctl(fd, FIONREAD, &inputBytes) == -1)
-                {
-                    continue;
-                }
-                // POLLIN set but no bytes available. This
-                // probably means that the client has closed
-                // the connection.
-                if (inputBytes == 0)
-                {
-                    goto connection_close;
-                }
-                // Not enough data for a servercall.
-                if (inputBytes < kBufferSize)
-                {
-                    continue;
-                }
 
-                std::unique_ptr<intptr_t[]> buffer(new intptr_t[kBufferLength]);
-                ssize_t bytes_read = read(fd, buffer.get(), kBufferSize);
-                if (bytes_read == -1 || bytes_read != kBufferSize)
-                {
-                    std::cerr << "read failed" << std::endl;
-                }
-                // std::cerr << "received servercall: " + std::to_string(buffer[0]) << std::endl;
+            ServerConnection* connection = (ServerConnection*)events[i].data.ptr;
+            bool alive = !(events[i].events & EPOLLERR);
 
-                const auto dispatch = [](int dispatchFd, std::unique_ptr<intptr_t[]> dispatchBuffer)
-                {
-                    intptr_t returnValue =
-                        server_dispatch(dispatchFd,
-                            dispatchBuffer[0], dispatchBuffer[1], dispatchBuffer[2],
-                            dispatchBuffer[3], dispatchBuffer[4], dispatchBuffer[5],
-                            dispatchBuffer[6]);
+            if (alive && (events[i].events & EPOLLIN))
+            {
+                alive = connection->Receive();
+            }
+            else if (events[i].events & EPOLLHUP)
+            {
+                alive = false;
+            }
+
+            if (!alive)
+            {
+                server_close_connection_state(connection->shared_from_this());
+                continue;
+            }
 
-                    write(dispatchFd, &returnValue, sizeof(returnValue));
-                };
+            epoll_event event;
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+            event.data.ptr = connection;
+            epoll_ctl(sEpollFd, EPOLL_CTL_MOD, connection->GetFd(), &event);
+        }
+    }
+}
 
-                server_worker_run(dispatch, fd, std::move(buffer));
+void server_accept_connections()
+{
+    while (true)
+    {
+        int data_socket = accept4(sListenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (data_socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
             }
-            else if (revents & POLLHUP || revents & POLLERR)
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
-            connection_close:
-                std::cerr << "Closing: " << fd << std::endl;
-                close(fd);
-                // For process that have already been gracefully disconnected,
-                // the call should silently fail with a B_BAD_VALUE on server_dispatch
-                // before reaching server_hserver_call_disconnect.
-                server_worker_run([](int dispatchFd)
-                {
-                    server_dispatch(dispatchFd, SERVERCALL_ID_disconnect, 0, 0, 0, 0, 0, 0);
-                }, fd);
+                perror("accept");
+            }
+            break;
+        }
 
-                std::swap(pollfds[i], pollfds.back());
-                pollfds.pop_back();
-                --oldSize;
+        std::cerr << "accepted connection" << std::endl;
 
-                // This means that pollfds.back() is actually a valid entry,
-                // as no new entry has been added. We need to iterate through it.
-                if (oldSize == pollfds.size())
-                {
-                    --i;
-                }
+        auto connection = std::make_shared<ServerConnection>(data_socket);
 
-                for (const auto & open : pollfds)
-                {
-                    std::cerr << open.fd << " ";
-                }
-                std::cerr << std::endl;
-            }
+        {
+            auto lock = std::unique_lock(sConnectionsLock);
+            sConnections[data_socket] = connection;
+        }
+
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        event.data.ptr = connection.get();
+        if (epoll_ctl(sEpollFd, EPOLL_CTL_ADD, data_socket, &event) == -1)
+        {
+            perror("epoll_ctl");
+            auto lock = std::unique_lock(sConnectionsLock);
+            sConnections.erase(data_socket);
         }
     }
 
-    return 0;
-}
\ No newline at end of file
+    epoll_event listenEvent;
+    listenEvent.events = EPOLLIN | EPOLLONESHOT;
+    listenEvent.data.ptr = NULL;
+    epoll_ctl(sEpollFd, EPOLL_CTL_MOD, sListenSocket, &listenEvent);
+}
+
+void server_close_connection_state(const std::shared_ptr<ServerConnection>& connection)
+{
+    int fd = connection->GetFd();
+
+    std::cerr << "Closing: " << fd << std::endl;
+
+    epoll_ctl(sEpollFd, EPOLL_CTL_DEL, fd, NULL);
+
+    {
+        auto lock = std::unique_lock(sConnectionsLock);
+        sConnections.erase(fd);
+    }
+
+    server_close_channel(fd);
+
+    // For process that have already been gracefully disconnected,
+    // the call should silently fail with a B_BAD_VALUE on server_dispatch
+    // before reaching server_hserver_call_disconnect.
+    // It goes through the connection like any other call, so that it
+    // does not overtake one-way calls the client has sent before closing.
+    // The fd itself is only closed once the last in-flight call on this
+    // connection drops its reference, so that its number cannot be reused
+    // by a new connection while the old one is still being torn down.
+    intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH] =
+        { SERVERCALL_ID_disconnect, 0, 0, 0, 0, 0, 0, HYCLONE_SERVERCALL_FLAG_ONEWAY };
+    connection->Dispatch(frame, std::vector<char>());
+}
+
+std::shared_ptr<hserver_connection> server_get_connection(intptr_t conn_id)
+{
+    auto lock = std::unique_lock(sConnectionsLock);
+    auto it = sConnections.find((int)conn_id);
+    if (it == sConnections.end())
+    {
+        return NULL;
+    }
+    return std::shared_ptr<hserver_connection>(it->second, it->second->GetState());
+}
+
+size_t server_get_connection_count()
+{
+    auto lock = std::unique_lock(sConnectionsLock);
+    return sConnections.size();
+}
+
+bool server_send_connection_fd(intptr_t conn_id, intptr_t handle)
+{
+    std::shared_ptr<ServerConnection> connection;
+
+    {
+        auto lock = std::unique_lock(sConnectionsLock);
+        auto it = sConnections.find((int)conn_id);
+        if (it == sConnections.end())
+        {
+            return false;
+        }
+        connection = it->second;
+    }
+
+    return connection->SendFd((int)handle);
+}
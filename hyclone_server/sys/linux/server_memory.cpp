@@ -2,7 +2,9 @@
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
+#include <linux/fs.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
@@ -50,10 +52,101 @@ intptr_t server_open_shared_file(const char* name, size_t size, bool writable)
     return fd;
 }
 
+void server_remove_shared_file(const char* name)
+{
+    auto path = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME / name;
+    unlink(path.c_str());
+}
+
+// Copies the parts of src that hold data, in the kernel.
+// Holes are left as holes, so pages the source never touched cost nothing.
+static bool server_copy_file_data(int src, int dst, off_t size)
+{
+    off_t offset = 0;
+    while (offset < size)
+    {
+        off_t dataStart = lseek(src, offset, SEEK_DATA);
+        if (dataStart < 0)
+        {
+            if (errno == ENXIO)
+            {
+                break;
+            }
+            if (errno != EINVAL)
+            {
+                return false;
+            }
+            // No hole information, copy everything.
+            dataStart = offset;
+        }
+
+        off_t dataEnd = lseek(src, dataStart, SEEK_HOLE);
+        if (dataEnd < 0)
+        {
+            dataEnd = size;
+        }
+
+        off_t inOffset = dataStart;
+        off_t outOffset = dataStart;
+        while (inOffset < dataEnd)
+        {
+            ssize_t copied = copy_file_range(src, &inOffset, dst, &outOffset, dataEnd - inOffset, 0);
+            if (copied < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (copied <= 0)
+            {
+                return false;
+            }
+        }
+
+        offset = dataEnd;
+    }
+    return true;
+}
+
 intptr_t server_clone_shared_file(const char* name, const char* path, bool writable)
 {
     auto shmpath = std::filesystem::path(gHaikuPrefix) / HYCLONE_SHM_NAME / name;
-    std::filesystem::copy_file(path, shmpath, std::filesystem::copy_options::overwrite_existing);
+
+    int src = open(path, O_RDONLY);
+    if (src < 0)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    int dst = -1;
+    bool copied = false;
+    if (fstat(src, &st) == 0)
+    {
+        dst = open(shmpath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    }
+    if (dst >= 0)
+    {
+        // Reflinks share the blocks until either side writes to them. This only works
+        // when both files live on a filesystem like btrfs or xfs; the shm directory is
+        // usually tmpfs, where this fails and the data is copied eagerly below.
+        copied = ioctl(dst, FICLONE, src) == 0;
+        if (!copied)
+        {
+            copied = ftruncate(dst, st.st_size) == 0 && server_copy_file_data(src, dst, st.st_size);
+        }
+        close(dst);
+    }
+    close(src);
+
+    if (!copied)
+    {
+        std::error_code ec;
+        std::filesystem::copy_file(path, shmpath, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            return -1;
+        }
+    }
+
     int fd = writable ?
         open(shmpath.c_str(), O_RDWR) :
         open(shmpath.c_str(), O_RDONLY);
@@ -88,7 +181,7 @@ void server_close_file(intptr_t handle)
 
 intptr_t server_acquire_process_file_handle(int pid, intptr_t handle, bool writable)
 {
-    auto path = std::filesystem::path("proc") / std::to_string(pid) / "fd" / std::to_string((int)handle);
+    auto path = std::filesystem::path("/proc") / std::to_string(pid) / "fd" / std::to_string((int)handle);
     int fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
     if (fd < 0)
     {
@@ -97,6 +190,11 @@ intptr_t server_acquire_process_file_handle(int pid, intptr_t handle, bool writa
     return fd;
 }
 
+std::string server_get_file_handle_path(intptr_t handle)
+{
+    return (std::filesystem::path("/proc") / std::to_string(getpid()) / "fd" / std::to_string((int)handle)).string();
+}
+
 bool server_get_entry_ref(intptr_t handle, EntryRef& ref)
 {
     struct stat st;
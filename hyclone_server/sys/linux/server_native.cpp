@@ -2,16 +2,20 @@
 #include <signal.h>
 
 #include <algorithm>
+#include <cerrno>
 #include <cstddef>
 #include <cstring>
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <linux/futex.h>
 #include <pthread.h>
 #include <string>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <unordered_set>
@@ -21,8 +25,36 @@
 #include "haiku_fs_info.h"
 #include "server_errno.h"
 #include "server_native.h"
+#include "server_payload.h"
+#include "server_servercalls.h"
 #include "system.h"
 
+static size_t server_native_read_process_memory(int pid, void* address, void* buffer, size_t size)
+{
+    struct iovec local_iov = { buffer, size };
+    struct iovec remote_iov = { address, size };
+
+    return (size_t)process_vm_readv((pid_t)pid, &local_iov, 1, &remote_iov, 1, 0);
+}
+
+static size_t server_native_write_process_memory(int pid, void* address, const void* buffer, size_t size)
+{
+    struct iovec local_iov = { (void*)buffer, size };
+    struct iovec remote_iov = { address, size };
+
+    return (size_t)process_vm_writev((pid_t)pid, &local_iov, 1, &remote_iov, 1, 0);
+}
+
+// Returns the inline payload of the current servercall, if it comes from this process.
+static ServercallPayload* server_get_payload(int pid)
+{
+    if (gCurrentContext == NULL || gCurrentContext->payload == NULL || gCurrentContext->pid != pid)
+    {
+        return NULL;
+    }
+    return gCurrentContext->payload;
+}
+
 size_t server_read_process_memory(int pid, void* address, void* buffer, size_t size)
 {
     if (size == 0)
@@ -30,11 +62,22 @@ size_t server_read_process_memory(int pid, void* address, void* buffer, size_t s
         return 0;
     }
 
-    struct iovec local_iov = { buffer, size };
-    struct iovec remote_iov = { address, size };
+    ServercallPayload* payload = server_get_payload(pid);
+    if (payload != NULL && payload->Read((uintptr_t)address, buffer, size))
+    {
+        return size;
+    }
 
-    return (size_t)process_vm_readv((pid_t)pid, &local_iov, 1, &remote_iov, 1, 0);
+    size_t result = server_native_read_process_memory(pid, address, buffer, size);
+
+    if (payload != NULL && payload->HasPendingWrites() && result == size)
+    {
+        payload->Overlay((uintptr_t)address, buffer, size);
+    }
+
+    return result;
 }
+
 size_t server_write_process_memory(int pid, void* address, const void* buffer, size_t size)
 {
     if (size == 0)
@@ -42,10 +85,38 @@ size_t server_write_process_memory(int pid, void* address, const void* buffer, s
         return 0;
     }
 
-    struct iovec local_iov = { (void*)buffer, size };
-    struct iovec remote_iov = { address, size };
+    ServercallPayload* payload = server_get_payload(pid);
+    if (payload != NULL)
+    {
+        if (payload->Write((uintptr_t)address, buffer, size))
+        {
+            return size;
+        }
 
-    return (size_t)process_vm_writev((pid_t)pid, &local_iov, 1, &remote_iov, 1, 0);
+        // Writes queued in the reply must land before this one.
+        if (payload->HasPendingWrites())
+        {
+            ServercallPayload::ForEachWrite(payload->TakeReply(),
+                [&](uintptr_t writeAddress, const char* data, size_t writeSize)
+            {
+                server_native_write_process_memory(pid, (void*)writeAddress, data, writeSize);
+            });
+        }
+
+        payload->Update((uintptr_t)address, buffer, size);
+    }
+
+    return server_native_write_process_memory(pid, address, buffer, size);
+}
+
+size_t server_write_process_memory_direct(int pid, void* address, const void* buffer, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    return server_native_write_process_memory(pid, address, buffer, size);
 }
 
 void server_send_request(int pid, int tid)
@@ -60,7 +131,9 @@ void server_kill_process(int pid)
 
 void server_close_connection(intptr_t conn_id)
 {
-    close((int)conn_id);
+    // The descriptor itself is owned by the event loop, which closes it
+    // once all in-flight calls on the connection have completed.
+    shutdown((int)conn_id, SHUT_RDWR);
 }
 
 void server_fill_team_info(haiku_team_info* info)
@@ -422,4 +495,55 @@ status_t server_write_stat(const std::filesystem::path& path, const haiku_stat&
 void server_exit_thread()
 {
     pthread_exit(NULL);
+}
+
+bool server_futex_wait(uint32_t* address, uint32_t value, int64_t timeoutMicroseconds)
+{
+    timespec timeout;
+    timespec* timeoutPtr = NULL;
+    if (timeoutMicroseconds >= 0)
+    {
+        timeout.tv_sec = timeoutMicroseconds / 1000000;
+        timeout.tv_nsec = (timeoutMicroseconds % 1000000) * 1000;
+        timeoutPtr = &timeout;
+    }
+
+    // The word lives in memory shared with another process,
+    // so FUTEX_PRIVATE_FLAG must not be used.
+    long result = syscall(SYS_futex, address, FUTEX_WAIT, value, timeoutPtr, NULL, 0);
+    return result == 0 || errno != ETIMEDOUT;
+}
+
+void server_futex_wake(uint32_t* address, int count)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+
+int server_futex_wait_multiple(uint32_t* const* addresses, const uint32_t* values, size_t count)
+{
+    struct futex_waitv waiters[SERVER_FUTEX_WAIT_MULTIPLE_MAX];
+    count = std::min(count, (size_t)SERVER_FUTEX_WAIT_MULTIPLE_MAX);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        memset(&waiters[i], 0, sizeof(waiters[i]));
+        waiters[i].val = values[i];
+        waiters[i].uaddr = (uintptr_t)addresses[i];
+        // Shared, like server_futex_wait.
+        waiters[i].flags = FUTEX_32;
+    }
+
+    long result = syscall(SYS_futex_waitv, waiters, count, 0, NULL, 0);
+    return result < 0 ? -errno : (int)result;
+}
+
+bool server_futex_wait_multiple_supported()
+{
+    // An empty wait fails with EINVAL when the call exists.
+    static const bool sSupported = syscall(SYS_futex_waitv, NULL, 0, 0, NULL, 0) == -1 && errno != ENOSYS;
+    return sSupported;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "port.h"
 #include "process.h"
 #include "server_native.h"
+#include "server_reaper.h"
 #include "server_servercalls.h"
 #include "server_systemnotification.h"
 #include "server_workers.h"
@@ -50,12 +51,14 @@ status_t System::Init()
 std::weak_ptr<Process> System::RegisterProcess(int pid, int uid, int gid, int euid, int egid)
 {
     auto ptr = std::make_shared<Process>(pid, uid, gid, euid, egid);
+    auto lock = std::unique_lock(_processesLock);
     _processes[pid] = ptr;
     return ptr;
 }
 
 std::weak_ptr<Process> System::GetProcess(int pid)
 {
+    auto lock = std::shared_lock(_processesLock);
     auto it = _processes.find(pid);
     if (it == _processes.end())
         return std::weak_ptr<Process>();
@@ -64,6 +67,7 @@ std::weak_ptr<Process> System::GetProcess(int pid)
 
 int System::NextProcessId(int pid) const
 {
+    auto lock = std::shared_lock(_processesLock);
     auto it = _processes.upper_bound(pid);
     if (it == _processes.end())
         return -1;
@@ -72,6 +76,7 @@ int System::NextProcessId(int pid) const
 
 size_t System::UnregisterProcess(int pid)
 {
+    auto lock = std::unique_lock(_processesLock);
     _processes.erase(pid);
     return _processes.size();
 }
@@ -79,6 +84,7 @@ size_t System::UnregisterProcess(int pid)
 std::weak_ptr<Thread> System::RegisterThread(int pid, int tid)
 {
     auto ptr = std::make_shared<Thread>(pid, tid);
+    auto lock = std::unique_lock(_threadsLock);
     _threads[tid] = ptr;
     ptr->_registered = true;
     return ptr;
@@ -86,6 +92,7 @@ std::weak_ptr<Thread> System::RegisterThread(int pid, int tid)
 
 std::weak_ptr<Thread> System::GetThread(int tid)
 {
+    auto lock = std::shared_lock(_threadsLock);
     auto it = _threads.find(tid);
     if (it == _threads.end())
         return std::weak_ptr<Thread>();
@@ -94,28 +101,44 @@ std::weak_ptr<Thread> System::GetThread(int tid)
 
 size_t System::UnregisterThread(int tid)
 {
-    auto it = _threads.find(tid);
-    if (it != _threads.end())
+    std::shared_ptr<Thread> thread;
+    size_t size;
+
+    {
+        auto lock = std::unique_lock(_threadsLock);
+        auto it = _threads.find(tid);
+        if (it != _threads.end())
+        {
+            thread = std::move(it->second);
+            _threads.erase(it);
+        }
+        size = _threads.size();
+    }
+
+    if (thread)
     {
-        it->second->_registered = false;
-        it->second->_blockCondition.notify_all();
-        it->second->_sendDataCondition.notify_all();
-        it->second->_receiveDataCondition.notify_all();
-        it->second->_suspended = false;
-        it->second->_suspended.notify_all();
-        _threads.erase(it);
+        thread->_registered = false;
+        thread->_blockCondition.notify_all();
+        thread->_sendDataCondition.notify_all();
+        thread->_receiveDataCondition.notify_all();
+        thread->_suspended = false;
+        thread->_suspended.notify_all();
     }
-    return _threads.size();
+
+    return size;
 }
 
 const Connection& System::RegisterConnection(intptr_t conn_id, const Connection& conn)
 {
+    auto lock = std::unique_lock(_connectionsLock);
     auto result = _connections.emplace(conn_id, conn);
+    // References to elements of an unordered_map stay valid until they are erased.
     return result.first->second;
 }
 
 Connection System::GetThreadFromConnection(intptr_t conn_id)
 {
+    auto lock = std::shared_lock(_connectionsLock);
     auto it = _connections.find(conn_id);
     if (it == _connections.end())
         return Connection(-1, -1);
@@ -124,14 +147,17 @@ Connection System::GetThreadFromConnection(intptr_t conn_id)
 
 size_t System::UnregisterConnection(intptr_t conn_id)
 {
+    auto lock = std::unique_lock(_connectionsLock);
     _connections.erase(conn_id);
     return _connections.size();
 }
 
 int System::RegisterPort(std::shared_ptr<Port>&& port)
 {
+    auto lock = std::unique_lock(_portsLock);
     int id = _ports.Add(port);
     port->_info.port = id;
+    port->_ring->port = id;
     port->_registered = true;
     // Haiku doesn't seem to do anything
     // about ports with duplicate names,
@@ -142,6 +168,7 @@ int System::RegisterPort(std::shared_ptr<Port>&& port)
 
 std::weak_ptr<Port> System::GetPort(int portId)
 {
+    auto lock = std::shared_lock(_portsLock);
     if (_ports.IsValidId(portId))
     {
         return _ports.Get(portId);
@@ -151,6 +178,7 @@ std::weak_ptr<Port> System::GetPort(int portId)
 
 int System::FindPort(const std::string& portName)
 {
+    auto lock = std::shared_lock(_portsLock);
     auto it = _portNames.find(portName);
     if (it != _portNames.end())
     {
@@ -161,29 +189,48 @@ int System::FindPort(const std::string& portName)
 
 size_t System::UnregisterPort(int portId)
 {
-    std::shared_ptr<Port> port = _ports.Get(portId);
+    std::shared_ptr<Port> port;
+    size_t size;
+
+    {
+        auto lock = std::unique_lock(_portsLock);
+        if (_ports.IsValidId(portId))
+        {
+            port = _ports.Get(portId);
+        }
+        if (port)
+        {
+            // Another port may have taken the name in the meantime.
+            auto it = _portNames.find(port->GetName());
+            if (it != _portNames.end() && it->second == portId)
+            {
+                _portNames.erase(it);
+            }
+            _ports.Remove(portId);
+        }
+        size = _ports.Size();
+    }
+
     if (port)
     {
-        _portNames.erase(port->GetName());
-        _ports.Remove(portId);
-        port->_registered = false;
-        port->_readCondVar.notify_all();
-        port->_writeCondVar.notify_all();
+        port->_Unregister();
     }
-    return _ports.Size();
+
+    return size;
 }
 
 int System::CreateSemaphore(int pid, int count, const char* name)
 {
     std::shared_ptr<Semaphore> semaphore = std::make_shared<Semaphore>(pid, count, name);
+    auto lock = std::unique_lock(_semaphoresLock);
     int id = _semaphores.Add(semaphore);
-    semaphore->_info.sem = id;
-    semaphore->_registered = true;
+    semaphore->_Register(id);
     return id;
 }
 
 std::weak_ptr<Semaphore> System::GetSemaphore(int id)
 {
+    auto lock = std::shared_lock(_semaphoresLock);
     if (_semaphores.IsValidId(id))
     {
         return _semaphores.Get(id);
@@ -191,19 +238,36 @@ std::weak_ptr<Semaphore> System::GetSemaphore(int id)
     return std::weak_ptr<Semaphore>();
 }
 
+size_t System::GetSemaphoreCount() const
+{
+    auto lock = std::shared_lock(_semaphoresLock);
+    return _semaphores.size();
+}
+
 size_t System::UnregisterSemaphore(int id)
 {
-    if (_semaphores.IsValidId(id))
+    std::shared_ptr<Semaphore> sem;
+    size_t size;
+
+    {
+        auto lock = std::unique_lock(_semaphoresLock);
+        if (_semaphores.IsValidId(id))
+        {
+            sem = _semaphores.Get(id);
+            _semaphores.Remove(id);
+        }
+        size = _semaphores.Size();
+    }
+
+    if (sem)
     {
-        auto sem = _semaphores.Get(id);
-        sem->_registered = false;
-        sem->_countCondVar.notify_all();
-        _semaphores.Remove(id);
+        sem->_Unregister();
     }
-    return _semaphores.Size();
+
+    return size;
 }
 
-std::weak_ptr<Area> System::RegisterArea(const haiku_area_info& info)
+int System::_NextAreaId()
 {
     int nextId = _nextAreaId;
     _nextAreaId = (_nextAreaId == INT_MAX) ? 1 : _nextAreaId + 1;
@@ -214,7 +278,15 @@ std::weak_ptr<Area> System::RegisterArea(const haiku_area_info& info)
         _nextAreaId = (_nextAreaId == INT_MAX) ? 1 : _nextAreaId + 1;
     }
 
+    return nextId;
+}
+
+std::weak_ptr<Area> System::RegisterArea(const haiku_area_info& info)
+{
     auto ptr = std::make_shared<Area>(info);
+
+    auto lock = std::unique_lock(_areasLock);
+    int nextId = _NextAreaId();
     ptr->_info.area = nextId;
     _areas[nextId] = ptr;
     return ptr;
@@ -222,15 +294,6 @@ std::weak_ptr<Area> System::RegisterArea(const haiku_area_info& info)
 
 std::weak_ptr<Area> System::RegisterArea(const std::shared_ptr<Area>& ptr)
 {
-    int nextId = _nextAreaId;
-    _nextAreaId = (_nextAreaId == INT_MAX) ? 1 : _nextAreaId + 1;
-
-    while (_areas.find(nextId) != _areas.end())
-    {
-        nextId = _nextAreaId;
-        _nextAreaId = (_nextAreaId == INT_MAX) ? 1 : _nextAreaId + 1;
-    }
-
     if (ptr->IsShared())
     {
         auto lock = _memoryService.Lock();
@@ -240,6 +303,8 @@ std::weak_ptr<Area> System::RegisterArea(const std::shared_ptr<Area>& ptr)
         }
     }
 
+    auto lock = std::unique_lock(_areasLock);
+    int nextId = _NextAreaId();
     ptr->_info.area = nextId;
     _areas[nextId] = ptr;
     return ptr;
@@ -247,11 +312,13 @@ std::weak_ptr<Area> System::RegisterArea(const std::shared_ptr<Area>& ptr)
 
 bool System::IsValidAreaId(int id) const
 {
+    auto lock = std::shared_lock(_areasLock);
     return _areas.find(id) != _areas.end();
 }
 
 std::weak_ptr<Area> System::GetArea(int id)
 {
+    auto lock = std::shared_lock(_areasLock);
     auto it = _areas.find(id);
     if (it == _areas.end())
         return std::weak_ptr<Area>();
@@ -260,36 +327,55 @@ std::weak_ptr<Area> System::GetArea(int id)
 
 size_t System::UnregisterArea(int id)
 {
-    if (_areas.contains(id))
+    std::shared_ptr<Area> area;
+    size_t size;
+
     {
-        const auto& area = _areas.at(id);
-        if (area->IsShared())
+        auto lock = std::unique_lock(_areasLock);
+        auto it = _areas.find(id);
+        if (it != _areas.end())
         {
-            auto lock = _memoryService.Lock();
-            _memoryService.ReleaseSharedFile(area->_entryRef);
+            area = std::move(it->second);
+            _areas.erase(it);
         }
-        _areas.erase(id);
+        size = _areas.size();
+    }
+
+    if (area && area->IsShared())
+    {
+        auto lock = _memoryService.Lock();
+        _memoryService.ReleaseSharedFile(area->_entryRef);
     }
-    return _areas.size();
+
+    return size;
 }
 
 void System::Shutdown()
 {
     _isShuttingDown = true;
-    for (const auto& process : _processes)
     {
-        server_kill_process(process.first);
+        auto lock = std::shared_lock(_processesLock);
+        for (const auto& process : _processes)
+        {
+            server_kill_process(process.first);
+        }
     }
-    for (const auto& [id, area] : _areas)
     {
-        if (area->IsShared())
+        auto lock = std::shared_lock(_areasLock);
+        for (const auto& [id, area] : _areas)
         {
-            _memoryService.ReleaseSharedFile(area->_entryRef);
+            if (area->IsShared())
+            {
+                _memoryService.ReleaseSharedFile(area->_entryRef);
+            }
         }
     }
-    for (const auto& connection : _connections)
     {
-        server_close_connection(connection.first);
+        auto lock = std::shared_lock(_connectionsLock);
+        for (const auto& connection : _connections)
+        {
+            server_close_connection(connection.first);
+        }
     }
 }
 
@@ -363,12 +449,11 @@ intptr_t server_hserver_call_connect(hserver_context& context, int pid, int tid,
 
 intptr_t server_hserver_call_disconnect(hserver_context& context)
 {
-    std::shared_ptr<Port> debuggerPort;
-    std::shared_ptr<Semaphore> debuggerWriteLock;
-    std::vector<Port::Message> debuggerMessages;
-    std::vector<int> teamNotificationEvents;
+    DeadTeam deadTeam;
     std::vector<int> threadNotificationEvents;
     bool processEnded = false;
+    bool threadEnded = false;
+    bool execUnlockNeeded = false;
 
     {
         auto& system = System::GetInstance();
@@ -376,8 +461,6 @@ intptr_t server_hserver_call_disconnect(hserver_context& context)
 
         const auto& connection = system.GetThreadFromConnection(context.conn_id);
 
-        bool execUnlockNeeded = false;
-
         if (context.process && connection.isPrimary)
         {
             auto procLock = context.process->Lock();
@@ -396,38 +479,21 @@ intptr_t server_hserver_call_disconnect(hserver_context& context)
 
                 processEnded = true;
 
-                context.process->PrepareForDeletion();
-
-                for (const auto& s: context.process->GetOwningSemaphores())
-                {
-                    system.UnregisterSemaphore(s);
-                }
-                context.process->ClearOwningSemaphores();
-
-                for (const auto& s: context.process->GetOwningPorts())
-                {
-                    system.UnregisterPort(s);
-                }
-                context.process->ClearOwningPorts();
-
-                area_id area = -1;
-                while ((area = context.process->NextAreaId(area)) != -1)
-                {
-                    system.UnregisterArea(area);
-                }
-                context.process->ClearAreas();
+                // Only detach what the team owns here. The objects themselves are
+                // released by the reaper, without holding up other teams.
+                deadTeam.process = context.process;
+                deadTeam.tid = context.tid;
+                deadTeam.semaphores = context.process->TakeOwningSemaphores();
+                deadTeam.ports = context.process->TakeOwningPorts();
+                deadTeam.areas = context.process->TakeAreas();
 
                 context.process->ClearImages();
 
-                teamNotificationEvents.push_back(context.process->IsExecutingExec() ?
-                    TEAM_EXEC : TEAM_REMOVED);
+                deadTeam.event = context.process->IsExecutingExec() ? TEAM_EXEC : TEAM_REMOVED;
 
                 if (context.process->GetDebuggerPort() != -1 && !context.process->IsExecutingExec())
                 {
-                    if (context.process->GetInfo().debugger_nub_port != -1)
-                    {
-                        system.UnregisterPort(context.process->GetInfo().debugger_nub_port);
-                    }
+                    deadTeam.debuggerNubPort = context.process->GetInfo().debugger_nub_port;
 
                     Port::Message message;
                     message.code = B_DEBUGGER_MESSAGE_TEAM_DELETED;
@@ -441,11 +507,12 @@ intptr_t server_hserver_call_disconnect(hserver_context& context)
                     debuggerMessage.team_deleted.origin.thread = -1;
                     debuggerMessage.team_deleted.origin.nub_port = -1;
 
-                    debuggerMessages.emplace_back(std::move(message));
+                    deadTeam.debuggerMessages.emplace_back(std::move(message));
                 }
             }
 
             system.UnregisterThread(context.tid);
+            threadEnded = true;
 
             threadNotificationEvents.push_back(THREAD_REMOVED);
 
@@ -467,54 +534,48 @@ intptr_t server_hserver_call_disconnect(hserver_context& context)
                 }
             }
 
-            if (debuggerMessages.size())
+            if (deadTeam.debuggerMessages.size())
             {
-                debuggerPort = system.GetPort(context.process->GetDebuggerPort()).lock();
-                debuggerWriteLock = system.GetSemaphore(context.process->GetDebuggerWriteLock()).lock();
+                deadTeam.debuggerPort = system.GetPort(context.process->GetDebuggerPort()).lock();
+                deadTeam.debuggerWriteLock = system.GetSemaphore(context.process->GetDebuggerWriteLock()).lock();
             }
         }
 
-        if (execUnlockNeeded)
-        {
-            std::cerr << "Unlocking exec for process " << context.pid << std::endl;
-            context.process->Exec(false);
-        }
-
         system.UnregisterConnection(context.conn_id);
 
         std::cerr << "Unregistered: " << context.conn_id << " " << context.pid << " " << context.tid << std::endl;
     }
 
-    if (debuggerMessages.size() && debuggerPort && debuggerWriteLock)
+    if (execUnlockNeeded)
     {
-        debuggerWriteLock->Acquire(context.tid, 1);
+        // The process lives on in the new image, so this cannot wait for the reaper,
+        // or it would undo what the new image has registered in the meantime.
+        context.process->PrepareForDeletion();
 
-        for (auto& message: debuggerMessages)
         {
-            debuggerPort->Write(std::move(message), B_INFINITE_TIMEOUT);
+            auto& msgService = System::GetInstance().GetMessagingService();
+            auto msgLock = msgService.Lock();
+            msgService.UnregisterService(context.process);
         }
 
-        debuggerWriteLock->Release(1);
+        std::cerr << "Unlocking exec for process " << context.pid << std::endl;
+        context.process->Exec(false);
     }
 
-    if (processEnded)
+    // Ends any B_KILL_CAN_INTERRUPT wait the thread has left behind.
+    if (threadEnded && context.thread)
     {
-        auto& msgService = System::GetInstance().GetMessagingService();
-        auto msgLock = msgService.Lock();
-
-        // Will silently fail if the process is not the registered
-        // message server.
-        msgService.UnregisterService(context.process);
+        context.thread->Interrupt(true);
     }
 
-    for (const auto& event: teamNotificationEvents)
+    for (const auto& event: threadNotificationEvents)
     {
-        System::GetInstance().GetTeamNotificationService().Notify(event, context.process);
+        System::GetInstance().GetThreadNotificationService().Notify(event, context.thread);
     }
 
-    for (const auto& event: threadNotificationEvents)
+    if (processEnded)
     {
-        System::GetInstance().GetThreadNotificationService().Notify(event, context.thread);
+        server_reap_team(std::move(deadTeam));
     }
 
     return B_OK;
@@ -551,9 +612,11 @@ intptr_t server_hserver_call_fork(hserver_context& context, int newPid)
         // Copy information, especially area info, as soon as possible.
         // Else, calls such as `area_for` may fail before the copy is complete.
         context.process->Fork(*child);
-        std::cerr << context.pid << " unlocked fork for " << newPid << "." << std::endl;
     }
 
+    child->FinishFork();
+    std::cerr << context.pid << " unlocked fork for " << newPid << "." << std::endl;
+
     if (child)
     {
         system.GetTeamNotificationService().Notify(TEAM_ADDED, child);
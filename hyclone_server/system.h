@@ -4,6 +4,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -54,6 +55,16 @@ private:
     IdMap<std::shared_ptr<haiku_fs_info>, int> _fsInfos;
     std::map<int, std::shared_ptr<Area>> _areas;
     std::unordered_map<EntryRef, std::string> _entryRefs;
+    // Each table has its own lock, so that lookups from unrelated
+    // teams do not contend with each other.
+    mutable std::shared_mutex _processesLock;
+    mutable std::shared_mutex _threadsLock;
+    mutable std::shared_mutex _connectionsLock;
+    // Also guards _portNames.
+    mutable std::shared_mutex _portsLock;
+    mutable std::shared_mutex _semaphoresLock;
+    // Also guards _nextAreaId.
+    mutable std::shared_mutex _areasLock;
     std::recursive_mutex _lock;
     NotificationManager _notificationManager;
     AppLoadNotificationService _appLoadNotificationService;
@@ -68,6 +79,8 @@ private:
     VfsService _vfsService;
     System() = default;
     ~System() = default;
+
+    int _NextAreaId();
 public:
     System(const System&) = delete;
     System(System&&) = delete;
@@ -94,7 +107,7 @@ public:
 
     int CreateSemaphore(int pid, int count, const char* name);
     std::weak_ptr<Semaphore> GetSemaphore(int id);
-    size_t GetSemaphoreCount() const { return _semaphores.size(); }
+    size_t GetSemaphoreCount() const;
     size_t UnregisterSemaphore(int id);
 
     std::weak_ptr<Area> RegisterArea(const haiku_area_info& info);
@@ -142,6 +155,8 @@ public:
     VfsService& GetVfsService() { return _vfsService; }
     const VfsService& GetVfsService() const { return _vfsService; }
 
+    // Serializes operations that span several tables, such as registering
+    // and tearing down processes. Single lookups do not need it.
     std::unique_lock<std::recursive_mutex> Lock() { return std::unique_lock<std::recursive_mutex>(_lock); }
 
     static System& GetInstance();
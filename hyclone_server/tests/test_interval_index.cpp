@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "interval_index.h"
+
+// Checks IntervalIndex against a brute-force scan of the same ranges.
+
+static std::map<int, std::pair<uintptr_t, uintptr_t>> sRanges;
+static IntervalIndex<int> sIndex;
+static int sFailures = 0;
+
+static void Check(bool condition, const char* what, uintptr_t address)
+{
+    if (!condition)
+    {
+        std::cout << "FAIL: " << what << " at 0x" << std::hex << address << std::dec << std::endl;
+        ++sFailures;
+    }
+}
+
+static bool Contains(int id, uintptr_t address)
+{
+    const auto& [start, end] = sRanges.at(id);
+    return start <= address && address < end;
+}
+
+static void CheckFind(uintptr_t address)
+{
+    bool expected = std::any_of(sRanges.begin(), sRanges.end(), [&](const auto& entry)
+    {
+        return Contains(entry.first, address);
+    });
+
+    int id = -1;
+    bool found = sIndex.Find(address, id);
+    Check(found == expected, "Find", address);
+    if (found)
+    {
+        Check(sRanges.contains(id) && Contains(id, address), "Find returned a wrong range", address);
+    }
+}
+
+static void CheckFindNext(uintptr_t address)
+{
+    uintptr_t expectedStart = UINTPTR_MAX;
+    for (const auto& [id, range] : sRanges)
+    {
+        if (range.first > address)
+            expectedStart = std::min(expectedStart, range.first);
+    }
+
+    int id = -1;
+    bool found = sIndex.FindNext(address, id);
+    Check(found == (expectedStart != UINTPTR_MAX), "FindNext", address);
+    if (found)
+    {
+        Check(sRanges.contains(id) && sRanges.at(id).first == expectedStart, "FindNext returned a wrong range", address);
+    }
+}
+
+static void CheckFindOverlapping(uintptr_t address, size_t size)
+{
+    std::vector<std::pair<uintptr_t, int>> expected;
+    for (const auto& [id, range] : sRanges)
+    {
+        if (range.first < address + size && address < range.second)
+            expected.emplace_back(range.first, id);
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int> result = sIndex.FindOverlapping(address, size);
+
+    Check(result.size() == expected.size(), "FindOverlapping count", address);
+    if (result.size() != expected.size())
+        return;
+
+    for (size_t i = 0; i < result.size(); ++i)
+    {
+        // Ranges with the same start may come in any order.
+        Check(sRanges.contains(result[i]) && sRanges.at(result[i]).first == expected[i].first,
+            "FindOverlapping order", address);
+        Check(std::any_of(expected.begin(), expected.end(), [&](const auto& entry) { return entry.second == result[i]; }),
+            "FindOverlapping returned a wrong range", address);
+    }
+}
+
+int main()
+{
+    std::mt19937_64 random(12345);
+    const uintptr_t kSpace = 1 << 20;
+
+    const auto randomAddress = [&]() { return (uintptr_t)(random() % kSpace); };
+    const auto randomSize = [&]() { return (size_t)(1 + random() % 4096); };
+
+    int nextId = 0;
+
+    for (int iteration = 0; iteration < 20000; ++iteration)
+    {
+        int operation = random() % 10;
+        if (operation < 5 || sRanges.empty())
+        {
+            uintptr_t start = randomAddress();
+            size_t size = randomSize();
+            sIndex.Set(nextId, start, size);
+            sRanges[nextId] = { start, start + size };
+            ++nextId;
+        }
+        else if (operation < 8)
+        {
+            auto it = std::next(sRanges.begin(), random() % sRanges.size());
+            sIndex.Remove(it->first);
+            sRanges.erase(it);
+        }
+        else
+        {
+            // Moves an existing range.
+            auto it = std::next(sRanges.begin(), random() % sRanges.size());
+            uintptr_t start = randomAddress();
+            size_t size = randomSize();
+            sIndex.Set(it->first, start, size);
+            it->second = { start, start + size };
+        }
+
+        Check(sIndex.Size() == sRanges.size(), "Size", 0);
+
+        if (iteration % 100 == 0)
+        {
+            for (int i = 0; i < 50; ++i)
+            {
+                uintptr_t address = randomAddress();
+                CheckFind(address);
+                CheckFindNext(address);
+                CheckFindOverlapping(address, randomSize() * 4);
+            }
+        }
+
+        if (sFailures > 10)
+            break;
+    }
+
+    sIndex.Clear();
+    sRanges.clear();
+    CheckFind(0);
+    CheckFindNext(0);
+    CheckFindOverlapping(0, kSpace);
+
+    if (sFailures != 0)
+    {
+        std::cout << sFailures << " checks failed." << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
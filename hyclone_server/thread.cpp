@@ -7,6 +7,8 @@
 #include "haiku_errors.h"
 #include "haiku_thread.h"
 #include "process.h"
+#include "server_channel.h"
+#include "server_memory.h"
 #include "server_native.h"
 #include "server_requests.h"
 #include "server_servercalls.h"
@@ -15,6 +17,7 @@
 #include "server_workers.h"
 #include "system.h"
 #include "thread.h"
+#include "thread_wait_table.h"
 #include "user_thread_defs.h"
 
 #define B_IDLE_PRIORITY              0
@@ -27,6 +30,59 @@
 #define B_URGENT_PRIORITY            110
 #define B_REAL_TIME_PRIORITY         120
 
+static std::mutex sWaitSlotsLock;
+static std::vector<int> sFreeWaitSlots;
+static int sNextWaitSlot = 0;
+
+static thread_wait_slot* server_get_thread_wait_table()
+{
+    static thread_wait_slot* sTable = []() -> thread_wait_slot*
+    {
+        size_t size = sizeof(thread_wait_slot) * HYCLONE_THREAD_WAIT_TABLE_SIZE;
+        intptr_t handle = server_open_shared_file(HYCLONE_THREAD_WAIT_TABLE_NAME, size, true);
+        if (handle < 0)
+        {
+            return NULL;
+        }
+
+        void* address = server_map_memory(handle, size, 0, true);
+        server_close_file(handle);
+        return (thread_wait_slot*)address;
+    }();
+
+    return sTable;
+}
+
+// Replaces the slot's status and bumps its sequence.
+// If expected is given, fails when the slot no longer matches it.
+static bool server_thread_wait_store(thread_wait_slot* slot, int32_t status,
+    thread_wait_slot* expected = NULL)
+{
+    thread_wait_slot current;
+    if (expected != NULL)
+    {
+        current = *expected;
+    }
+    else
+    {
+        __atomic_load(slot, &current, __ATOMIC_ACQUIRE);
+    }
+
+    thread_wait_slot next;
+    do
+    {
+        next = { current.sequence + 1, status };
+        if (__atomic_compare_exchange(slot, &current, &next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+    }
+    while (expected == NULL);
+
+    *expected = current;
+    return false;
+}
+
 Thread::Thread(int pid, int tid) : _tid(tid)
 {
     memset(&_info, 0, sizeof(_info));
@@ -34,6 +90,48 @@ Thread::Thread(int pid, int tid) : _tid(tid)
     _info.team = pid;
 }
 
+Thread::~Thread()
+{
+    if (_waitSlot >= 0)
+    {
+        auto lock = std::unique_lock(sWaitSlotsLock);
+        sFreeWaitSlots.push_back(_waitSlot);
+    }
+}
+
+int Thread::GetWaitSlot()
+{
+    if (_waitSlot >= 0)
+    {
+        return _waitSlot;
+    }
+
+    if (server_get_thread_wait_table() == NULL)
+    {
+        return B_NO_MEMORY;
+    }
+
+    auto lock = std::unique_lock(sWaitSlotsLock);
+    if (!sFreeWaitSlots.empty())
+    {
+        _waitSlot = sFreeWaitSlots.back();
+        sFreeWaitSlots.pop_back();
+    }
+    else if (sNextWaitSlot < HYCLONE_THREAD_WAIT_TABLE_SIZE)
+    {
+        _waitSlot = sNextWaitSlot++;
+    }
+    else
+    {
+        return B_NO_MEMORY;
+    }
+
+    // The previous owner may have left a status behind.
+    server_thread_wait_store(server_get_thread_wait_table() + _waitSlot, HYCLONE_THREAD_WAIT_NO_STATUS);
+
+    return _waitSlot;
+}
+
 void Thread::SuspendSelf()
 {
     _suspended = true;
@@ -78,55 +176,75 @@ status_t Thread::Block(std::unique_lock<std::mutex>& lock, uint32 flags, bigtime
         return waitStatus;
     }
 
-    // nope, so wait
-    _blocked = true;
-
-    bool useTimeout = (flags & (B_ABSOLUTE_TIMEOUT | B_RELATIVE_TIMEOUT)) &&
-        !server_is_infinite_timeout(timeout, flags);
+    thread_wait_slot* slot = _waitSlot >= 0 ? server_get_thread_wait_table() + _waitSlot : NULL;
 
-    server_worker_run_wait([&]()
+    // The thread may have been unblocked through its slot before it got here.
+    thread_wait_slot current = { 0, HYCLONE_THREAD_WAIT_NO_STATUS };
+    if (slot != NULL)
     {
-        if (!useTimeout)
-        {
-            _blockCondition.wait(lock, [&]()
-            {
-                return !_blocked;
-            });
-        }
-        else if (flags & B_RELATIVE_TIMEOUT)
-        {
-            _blockCondition.wait_for(lock, std::chrono::microseconds(timeout), [&]()
-            {
-                return !_blocked;
-            });
-        }
-        else // if (flags & B_ABSOLUTE_TIMEOUT)
+        __atomic_load(slot, &current, __ATOMIC_ACQUIRE);
+    }
+    if (current.status <= 0)
+    {
+        _blockStatus = current.status;
+    }
+    else
+    {
+        // nope, so wait
+        _blocked = true;
+
+        bool useTimeout = (flags & (B_ABSOLUTE_TIMEOUT | B_RELATIVE_TIMEOUT)) &&
+            !server_is_infinite_timeout(timeout, flags);
+
+        server_worker_run_wait([&]()
         {
-            if (flags & B_TIMEOUT_REAL_TIME_BASE)
+            if (!useTimeout)
             {
-                _blockCondition.wait_until(lock,
-                    std::chrono::system_clock::time_point(std::chrono::microseconds(timeout)), [&]()
+                _blockCondition.wait(lock, [&]()
                 {
                     return !_blocked;
                 });
             }
-            else
+            else if (flags & B_RELATIVE_TIMEOUT)
             {
-                _blockCondition.wait_until(lock,
-                    std::chrono::steady_clock::time_point(std::chrono::microseconds(timeout)), [&]()
+                _blockCondition.wait_for(lock, std::chrono::microseconds(timeout), [&]()
                 {
                     return !_blocked;
                 });
             }
+            else // if (flags & B_ABSOLUTE_TIMEOUT)
+            {
+                if (flags & B_TIMEOUT_REAL_TIME_BASE)
+                {
+                    _blockCondition.wait_until(lock,
+                        std::chrono::system_clock::time_point(std::chrono::microseconds(timeout)), [&]()
+                    {
+                        return !_blocked;
+                    });
+                }
+                else
+                {
+                    _blockCondition.wait_until(lock,
+                        std::chrono::steady_clock::time_point(std::chrono::microseconds(timeout)), [&]()
+                    {
+                        return !_blocked;
+                    });
+                }
+            }
+        });
+
+        if (_blocked)
+        {
+            _blockStatus = B_TIMED_OUT;
         }
-    });
 
-    if (_blocked)
-    {
-        _blockStatus = B_TIMED_OUT;
+        _blocked = false;
     }
 
-    _blocked = false;
+    if (slot != NULL)
+    {
+        server_thread_wait_store(slot, HYCLONE_THREAD_WAIT_NO_STATUS);
+    }
 
     if (server_write_process_memory(_info.team, &_userThreadAddress->wait_status,
         &_blockStatus, sizeof(_blockStatus)) != sizeof(_blockStatus))
@@ -139,20 +257,78 @@ status_t Thread::Block(std::unique_lock<std::mutex>& lock, uint32 flags, bigtime
 
 status_t Thread::Unblock(status_t status)
 {
-    if (server_write_process_memory(_info.team, &_userThreadAddress->wait_status,
-        &status, sizeof(status)) != sizeof(status))
+    // Blocked in the server, which stores the status once it wakes up.
+    if (_blocked)
     {
-        return B_BAD_ADDRESS;
+        _blockStatus = status;
+        _blocked = false;
+
+        _blockCondition.notify_all();
+
+        return B_OK;
+    }
+
+    status_t waitStatus;
+
+    // Without a slot, the thread can only block in the server, under the thread's lock.
+    if (_waitSlot < 0)
+    {
+        if (server_read_process_memory(_info.team, &_userThreadAddress->wait_status,
+            &waitStatus, sizeof(waitStatus)) != sizeof(waitStatus))
+        {
+            return B_BAD_ADDRESS;
+        }
+        if (waitStatus > 0 && server_write_process_memory(_info.team, &_userThreadAddress->wait_status,
+            &status, sizeof(status)) != sizeof(status))
+        {
+            return B_BAD_ADDRESS;
+        }
+
+        return B_OK;
     }
 
-    _blockStatus = status;
-    _blocked = false;
+    // The thread may be blocked in its own team. The store fails if that wait
+    // ends in the meantime, in which case the wait status is read again.
+    thread_wait_slot* slot = server_get_thread_wait_table() + _waitSlot;
+    thread_wait_slot current;
+    __atomic_load(slot, &current, __ATOMIC_ACQUIRE);
+
+    do
+    {
+        if (server_read_process_memory(_info.team, &_userThreadAddress->wait_status,
+            &waitStatus, sizeof(waitStatus)) != sizeof(waitStatus))
+        {
+            return B_BAD_ADDRESS;
+        }
+
+        // Not waiting, or already unblocked.
+        if (waitStatus <= 0 || current.status <= 0)
+        {
+            return B_OK;
+        }
+    }
+    while (!server_thread_wait_store(slot, status, &current));
 
-    _blockCondition.notify_all();
+    server_futex_wake(&slot->sequence, INT32_MAX);
 
     return B_OK;
 }
 
+void Thread::SetInterruptHandler(std::function<void(bool)>&& handler)
+{
+    auto lock = std::unique_lock(_interruptLock);
+    _interruptHandler = std::move(handler);
+}
+
+void Thread::Interrupt(bool kill)
+{
+    auto lock = std::unique_lock(_interruptLock);
+    if (_interruptHandler)
+    {
+        _interruptHandler(kill);
+    }
+}
+
 status_t Thread::SendData(std::unique_lock<std::mutex>& lock, thread_id sender, int code, std::vector<uint8_t>&& data)
 {
     if (_sender != -1)
@@ -275,10 +451,7 @@ intptr_t server_hserver_call_register_thread_info(hserver_context& context, void
     }
 
     std::shared_ptr<Thread> thread;
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(context.tid).lock();
-    }
+    thread = system.GetThread(context.tid).lock();
 
     if (!thread)
     {
@@ -309,10 +482,7 @@ intptr_t server_hserver_call_get_thread_info(hserver_context& context, int threa
 
     std::shared_ptr<Thread> thread;
 
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(threadId).lock();
-    }
+    thread = system.GetThread(threadId).lock();
 
     if (!thread)
     {
@@ -344,7 +514,6 @@ intptr_t server_hserver_call_get_next_thread_info(hserver_context& context, int
     }
     else
     {
-        auto lock = system.Lock();
         process = system.GetProcess(team).lock();
     }
 
@@ -420,10 +589,7 @@ intptr_t server_hserver_call_rename_thread(hserver_context& context, int threadI
 
     std::shared_ptr<Thread> thread;
 
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(threadId).lock();
-    }
+    thread = system.GetThread(threadId).lock();
 
     if (!thread)
     {
@@ -454,10 +620,7 @@ intptr_t server_hserver_call_set_thread_priority(hserver_context& context, int t
 
     std::shared_ptr<Thread> thread;
 
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(threadId).lock();
-    }
+    thread = system.GetThread(threadId).lock();
 
     if (!thread)
     {
@@ -501,10 +664,7 @@ intptr_t server_hserver_call_suspend_thread(hserver_context& context, int thread
 
     std::shared_ptr<Thread> thread;
 
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(threadId).lock();
-    }
+    thread = system.GetThread(threadId).lock();
 
     if (!thread)
     {
@@ -535,10 +695,7 @@ intptr_t server_hserver_call_resume_thread(hserver_context& context, int threadI
 
     std::shared_ptr<Thread> thread;
 
-    {
-        auto lock = system.Lock();
-        thread = system.GetThread(threadId).lock();
-    }
+    thread = system.GetThread(threadId).lock();
 
     if (!thread)
     {
@@ -560,9 +717,10 @@ intptr_t server_hserver_call_wait_for_resume(hserver_context& context)
 
 intptr_t server_hserver_call_register_user_thread(hserver_context& context, void* address)
 {
+    auto lock = context.thread->Lock();
     context.thread->SetUserThreadAddress((user_thread*)address);
 
-    return B_OK;
+    return context.thread->GetWaitSlot();
 }
 
 intptr_t server_hserver_call_block_thread(hserver_context& context, int flags, unsigned long long timeout)
@@ -577,7 +735,6 @@ intptr_t server_hserver_call_unblock_thread(hserver_context& context, int thread
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         thread = system.GetThread(threadId).lock();
     }
 
@@ -592,13 +749,23 @@ intptr_t server_hserver_call_unblock_thread(hserver_context& context, int thread
     }
 }
 
+intptr_t server_hserver_call_interrupt(hserver_context& context)
+{
+    // Sent after the call it was meant for may already have completed.
+    if (server_is_channel_interrupted(context.conn_id))
+    {
+        context.thread->Interrupt(false);
+    }
+
+    return B_OK;
+}
+
 intptr_t server_hserver_call_send_data(hserver_context& context, int threadId, int code, const void* data, size_t len)
 {
     std::shared_ptr<Thread> thread;
 
     {
         auto& system = System::GetInstance();
-        auto lock = system.Lock();
         thread = system.GetThread(threadId).lock();
     }
 
@@ -2,6 +2,7 @@
 #define __HYCLONE_THREAD_H__
 
 #include <atomic>
+#include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
@@ -23,11 +24,15 @@ private:
     std::mutex _requestLock;
     std::shared_ptr<Request> _request;
     std::atomic<bool> _suspended = false;
+    std::mutex _interruptLock;
+    std::function<void(bool)> _interruptHandler;
     std::condition_variable _blockCondition;
     std::condition_variable _sendDataCondition;
     std::condition_variable _receiveDataCondition;
     std::vector<uint8_t> _receiveData;
     user_thread* _userThreadAddress = NULL;
+    // The thread's slot in the thread wait table, if any.
+    int _waitSlot = -1;
     int _tid;
     status_t _blockStatus;
     int _sender = -1;
@@ -36,7 +41,7 @@ private:
     bool _registered = false;
 public:
     Thread(int pid, int tid);
-    ~Thread() = default;
+    ~Thread();
 
     std::unique_lock<std::mutex> Lock() { return std::unique_lock(_lock); }
     std::unique_lock<std::mutex> RequestLock() { return std::unique_lock(_requestLock); }
@@ -52,11 +57,18 @@ public:
     status_t Block(std::unique_lock<std::mutex>& lock, uint32 flags, bigtime_t timeout);
     status_t Unblock(status_t status);
 
+    // Installs what ends the interruptible wait the thread is in, or clears it.
+    void SetInterruptHandler(std::function<void(bool)>&& handler);
+    // Ends the current interruptible wait, if any. kill is set when the thread is going away.
+    void Interrupt(bool kill);
+
     status_t SendData(std::unique_lock<std::mutex>& lock, thread_id sender, int code, std::vector<uint8_t>&& data);
     status_t ReceiveData(std::unique_lock<std::mutex>& lock, thread_id& sender, int& code, std::vector<uint8_t>& data);
 
     user_thread* GetUserThreadAddress() const { return _userThreadAddress; }
     void SetUserThreadAddress(user_thread* address) { _userThreadAddress = address; }
+    // Returns the thread's slot in the thread wait table, assigning one if needed.
+    int GetWaitSlot();
 
     bool IsRequesting() const { return _request != std::shared_ptr<Request>(); }
     std::shared_future<intptr_t> SendRequest(std::shared_ptr<Request> request);
@@ -0,0 +1,322 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "servercall_stats.h"
+#include "servercalls.h"
+
+// Dumps or resets the servercall statistics of a running HyClone server.
+
+static const char* const kServercallNames[] =
+{
+#define HYCLONE_SERVERCALL0(name) #name,
+#define HYCLONE_SERVERCALL1(name, arg1) #name,
+#define HYCLONE_SERVERCALL2(name, arg1, arg2) #name,
+#define HYCLONE_SERVERCALL3(name, arg1, arg2, arg3) #name,
+#define HYCLONE_SERVERCALL4(name, arg1, arg2, arg3, arg4) #name,
+#define HYCLONE_SERVERCALL5(name, arg1, arg2, arg3, arg4, arg5) #name,
+#define HYCLONE_SERVERCALL6(name, arg1, arg2, arg3, arg4, arg5, arg6) #name,
+#include "servercall_defs.h"
+#undef HYCLONE_SERVERCALL0
+#undef HYCLONE_SERVERCALL1
+#undef HYCLONE_SERVERCALL2
+#undef HYCLONE_SERVERCALL3
+#undef HYCLONE_SERVERCALL4
+#undef HYCLONE_SERVERCALL5
+#undef HYCLONE_SERVERCALL6
+};
+
+// Leaves room for the record header of the reply.
+static const size_t kStatsBufferSize =
+    HYCLONE_SERVERCALL_MAX_PAYLOAD - sizeof(servercall_inline_record);
+
+static bool stats_get_socket_path(std::string& path)
+{
+    std::filesystem::path prefix;
+    const char* hPrefixPtr = getenv("HPREFIX");
+    if (hPrefixPtr != NULL)
+    {
+        prefix = hPrefixPtr;
+    }
+    else
+    {
+        const char* home = getenv("HOME");
+        if (home == NULL)
+        {
+            return false;
+        }
+        prefix = std::filesystem::path(home) / ".hprefix";
+    }
+
+    std::error_code error;
+    path = (std::filesystem::canonical(prefix, error) / HYCLONE_SOCKET_NAME).string();
+    return !error;
+}
+
+static bool stats_send(int fd, const void* data, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t ret = write(fd, (const char*)data + sent, size - sent);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+static bool stats_receive(int fd, void* data, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t ret = read(fd, (char*)data + received, size - received);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+// Performs a servercall without registering with the server. Writes to
+// buffer, if any, are shipped back inline, as the server cannot reach us.
+static bool stats_call(int fd, intptr_t id, intptr_t a1, void* buffer, size_t size, intptr_t& result)
+{
+    struct
+    {
+        intptr_t frame[HYCLONE_SERVERCALL_FRAME_LENGTH];
+        servercall_inline_record record;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.frame[0] = id;
+    request.frame[1] = a1;
+    request.frame[2] = (intptr_t)buffer;
+    request.frame[3] = size;
+
+    size_t requestSize = sizeof(request.frame);
+    if (buffer != NULL)
+    {
+        request.record = { (uint64_t)(uintptr_t)buffer, (uint32_t)size, SERVERCALL_INLINE_OUT };
+        request.frame[HYCLONE_SERVERCALL_FRAME_LENGTH - 1] = sizeof(request.record);
+        requestSize += sizeof(request.record);
+    }
+
+    if (!stats_send(fd, &request, requestSize))
+    {
+        return false;
+    }
+
+    intptr_t replyHeader[HYCLONE_SERVERCALL_REPLY_LENGTH];
+    if (!stats_receive(fd, replyHeader, sizeof(replyHeader)))
+    {
+        return false;
+    }
+
+    result = replyHeader[0];
+    size_t replySize = replyHeader[1];
+    if (replySize > HYCLONE_SERVERCALL_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    std::vector<char> reply(replySize);
+    if (!stats_receive(fd, reply.data(), replySize))
+    {
+        return false;
+    }
+
+    size_t offset = 0;
+    while (offset + sizeof(servercall_inline_record) <= replySize)
+    {
+        servercall_inline_record record;
+        memcpy(&record, reply.data() + offset, sizeof(record));
+        offset += sizeof(record);
+
+        uintptr_t start = record.address;
+        if (start >= (uintptr_t)buffer && start + record.size <= (uintptr_t)buffer + size
+            && offset + record.size <= replySize)
+        {
+            memcpy((void*)start, reply.data() + offset, record.size);
+        }
+        offset += SERVERCALL_INLINE_ALIGN(record.size);
+    }
+
+    return true;
+}
+
+// Returns the upper bound of the bucket the given percentile falls in, in microseconds.
+static std::string stats_percentile(const uint32_t* histogram, uint64_t count, double percentile)
+{
+    uint64_t target = (uint64_t)(count * percentile);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < SERVERCALL_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += histogram[i];
+        if (seen > target)
+        {
+            if (i == SERVERCALL_STATS_HISTOGRAM_BUCKETS - 1)
+            {
+                return ">=" + std::to_string(1ULL << (i - 1));
+            }
+            return "<" + std::to_string(1ULL << i);
+        }
+    }
+    return "-";
+}
+
+static void stats_print(const servercall_stats_info& info, const std::vector<servercall_stats_entry>& entries,
+    bool showAll)
+{
+    std::cout << "Elapsed:      " << info.elapsedTime / 1000000 << " ms" << std::endl;
+    std::cout << "Connections:  " << info.connectionCount << std::endl;
+    std::cout << "Workers:      " << info.busyWorkers << " busy, " << info.workerSlots << " slots" << std::endl;
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(32) << "servercall" << std::right
+        << std::setw(12) << "count"
+        << std::setw(14) << "exec ms"
+        << std::setw(10) << "avg us"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(12) << "queue avg"
+        << std::setw(12) << "queue p99" << std::endl;
+
+    for (const auto& entry : entries)
+    {
+        if (entry.count == 0 && !showAll)
+        {
+            continue;
+        }
+
+        std::string name = (entry.id < sizeof(kServercallNames) / sizeof(kServercallNames[0])) ?
+            kServercallNames[entry.id] : std::to_string(entry.id);
+        uint64_t count = entry.count;
+        uint64_t queueCount = 0;
+        for (size_t i = 0; i < SERVERCALL_STATS_HISTOGRAM_BUCKETS; ++i)
+        {
+            queueCount += entry.queueHistogram[i];
+        }
+
+        std::cout << std::left << std::setw(32) << name << std::right
+            << std::setw(12) << count
+            << std::setw(14) << entry.execTime / 1000000
+            << std::setw(10) << (count ? entry.execTime / count / 1000 : 0)
+            << std::setw(10) << stats_percentile(entry.execHistogram, count, 0.5)
+            << std::setw(10) << stats_percentile(entry.execHistogram, count, 0.99)
+            << std::setw(12) << (queueCount ? entry.queueTime / queueCount / 1000 : 0)
+            << std::setw(12) << stats_percentile(entry.queueHistogram, queueCount, 0.99) << std::endl;
+    }
+}
+
+static void stats_usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [--all] [--reset]" << std::endl;
+    std::cerr << "  --all    Also list servercalls that have not been called." << std::endl;
+    std::cerr << "  --reset  Reset the statistics after printing them." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    bool showAll = false;
+    bool reset = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--all") == 0)
+        {
+            showAll = true;
+        }
+        else if (strcmp(argv[i], "--reset") == 0)
+        {
+            reset = true;
+        }
+        else
+        {
+            stats_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::string socketPath;
+    if (!stats_get_socket_path(socketPath))
+    {
+        std::cerr << "Failed to determine the HyClone prefix." << std::endl;
+        std::cerr << "Ensure that the HPREFIX environment variable is set." << std::endl;
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        std::cerr << "Failed to connect to the HyClone server at " << socketPath << "." << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    servercall_stats_info info;
+    std::vector<servercall_stats_entry> entries;
+    std::vector<char> buffer(kStatsBufferSize);
+
+    do
+    {
+        intptr_t result;
+        if (!stats_call(fd, SERVERCALL_ID_get_servercall_stats, entries.size(),
+            buffer.data(), buffer.size(), result) || result < 0)
+        {
+            std::cerr << "Failed to query the servercall statistics." << std::endl;
+            close(fd);
+            return 1;
+        }
+
+        memcpy(&info, buffer.data(), sizeof(info));
+        auto page = (const servercall_stats_entry*)(buffer.data() + sizeof(info));
+        entries.insert(entries.end(), page, page + info.entryCount);
+
+        if (info.entryCount == 0)
+        {
+            break;
+        }
+    }
+    while (entries.size() < info.callCount);
+
+    stats_print(info, entries, showAll);
+
+    if (reset)
+    {
+        intptr_t result;
+        if (!stats_call(fd, SERVERCALL_ID_reset_servercall_stats, 0, NULL, 0, result) || result != 0)
+        {
+            std::cerr << "Failed to reset the servercall statistics." << std::endl;
+            close(fd);
+            return 1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
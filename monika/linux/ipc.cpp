@@ -23,13 +23,13 @@ size_t _moni_read_port_etc(port_id port, int32 *msgCode,
     void *msgBuffer, size_t bufferSize, uint32 flags,
     bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->read_port_etc(port, msgCode, msgBuffer, bufferSize, flags, timeout);
+    return GET_HOSTCALLS()->read_port_etc(port, msgCode, msgBuffer, bufferSize, flags, timeout);
 }
 
 status_t _moni_write_port_etc(port_id port, int32 messageCode, const void *msgBuffer,
     size_t bufferSize, uint32 flags, bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->write_port_etc(port, messageCode, msgBuffer, bufferSize, flags, timeout);
+    return GET_HOSTCALLS()->write_port_etc(port, messageCode, msgBuffer, bufferSize, flags, timeout);
 }
 
 int32 _moni_port_count(port_id port)
@@ -54,7 +54,13 @@ status_t _moni_get_next_port_info(team_id team, int32* cookie, struct haiku_port
 
 ssize_t _moni_port_buffer_size_etc(port_id port, uint32 flags, bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->port_buffer_size_etc(port, flags, timeout);
+    haiku_port_message_info info;
+    status_t status = GET_HOSTCALLS()->get_port_message_info_etc(port, &info, sizeof(info), flags, timeout);
+    if (status != B_OK)
+    {
+        return status;
+    }
+    return info.size;
 }
 
 status_t _moni_set_port_owner(port_id port, team_id team)
@@ -69,14 +75,14 @@ status_t _moni_close_port(port_id id)
 
 status_t _moni_delete_port(port_id id)
 {
-    return GET_SERVERCALLS()->delete_port(id);
+    return GET_HOSTCALLS()->delete_port(id);
 }
 
 status_t _moni_get_port_message_info_etc(port_id port,
     haiku_port_message_info* info, size_t infoSize, uint32 flags,
     bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->get_port_message_info_etc(port, info, infoSize, flags, timeout);
+    return GET_HOSTCALLS()->get_port_message_info_etc(port, info, infoSize, flags, timeout);
 }
 
 status_t _moni_register_messaging_service(sem_id lockingSem,
@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/mempolicy.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 
@@ -23,6 +24,10 @@ const addr_t kMaxRandomize = 0x8000000000ul;
 const addr_t kMaxRandomize = 0x800000ul;
 #endif
 
+// Areas from this size on are aligned and advised for transparent huge pages.
+const size_t kLargeAreaSize = 4 * 1024 * 1024;
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
 #define HAIKU_MS_ASYNC      0x01
 #define HAIKU_MS_SYNC       0x02
 #define HAIKU_MS_INVALIDATE 0x04
@@ -36,6 +41,10 @@ static int ShareArea(void* mappedAddr, size_t size, int area_id,
     int fd, off_t offset, char hostPath[PATH_MAX],
     int mmap_flags, int mmap_prot, int open_flags);
 static int LockArea(void* mappedAddr, size_t size, uint32 lock);
+static int CreateAreaFile(const char* name, size_t size);
+static long MapAligned(void* hintAddr, void* lowestAddr, size_t size, int mmap_prot, int mmap_flags, int fd);
+static void AdviseArea(void* mappedAddr, size_t size, bool isLarge, int memoryNode);
+static void CloseAreaFile(int fd);
 
 class MmanLock
 {
@@ -74,19 +83,44 @@ int32_t _moni_create_area(const char *name, void **address,
         return result;
     }
 
+    bool isLarge = (size >= kLargeAreaSize || lock == B_CONTIGUOUS) && !(protection & B_STACK_AREA);
+    int memoryNode = GET_HOSTCALLS()->get_memory_node();
+
+    // Pages of locked areas may be faulted in by mmap itself,
+    // unless a memory policy has to be set up before they are touched.
+    if (lock == B_FULL_LOCK && !isLarge && memoryNode < 0)
+    {
+        mmap_flags |= MAP_POPULATE;
+    }
+
+    // Cloneable areas are backed by a memfd right away,
+    // which the server and cloning teams then open through /proc.
+    int fd = -1;
+    if (protection & B_CLONEABLE_AREA)
+    {
+        fd = CreateAreaFile(name, size);
+        if (fd >= 0)
+        {
+            mmap_flags |= MAP_SHARED;
+            mmap_flags &= ~(MAP_ANONYMOUS | MAP_PRIVATE);
+        }
+    }
+
     MmanLock mmanLock;
 
     if (addressSpec == B_EXACT_ADDRESS && GET_HOSTCALLS()->is_in_reserved_range(hintAddr, size))
     {
         if (GET_HOSTCALLS()->reserved_range_longest_mappable_from(hintAddr, size) < size)
         {
+            CloseAreaFile(fd);
             return B_NO_MEMORY;
         }
 
         // Safe to call MAP_FIXED in this case.
-        result = LINUX_SYSCALL6(__NR_mmap, hintAddr, size, mmap_prot, mmap_flags | MAP_FIXED, -1, 0);
+        result = LINUX_SYSCALL6(__NR_mmap, hintAddr, size, mmap_prot, mmap_flags | MAP_FIXED, fd, 0);
         if (result < 0)
         {
+            CloseAreaFile(fd);
             return LinuxToB(-result);
         }
 
@@ -96,9 +130,19 @@ int32_t _moni_create_area(const char *name, void **address,
     }
     else
     {
-        result = LINUX_SYSCALL6(__NR_mmap, hintAddr, size, mmap_prot, mmap_flags, -1, 0);
+        result = -ENOMEM;
+        if (isLarge && addressSpec != B_EXACT_ADDRESS)
+        {
+            bool hasBase = addressSpec == B_BASE_ADDRESS || addressSpec == B_RANDOMIZED_BASE_ADDRESS;
+            result = MapAligned(hintAddr, hasBase ? baseAddr : NULL, size, mmap_prot, mmap_flags, fd);
+        }
+        if (result < 0)
+        {
+            result = LINUX_SYSCALL6(__NR_mmap, hintAddr, size, mmap_prot, mmap_flags, fd, 0);
+        }
         if (result < 0)
         {
+            CloseAreaFile(fd);
             return LinuxToB(-result);
         }
     }
@@ -109,9 +153,12 @@ int32_t _moni_create_area(const char *name, void **address,
     if (result != B_OK)
     {
         LINUX_SYSCALL2(__NR_munmap, mappedAddr, size);
+        CloseAreaFile(fd);
         return result;
     }
 
+    AdviseArea(mappedAddr, size, isLarge, memoryNode);
+
     struct haiku_area_info info;
 
     strlcpy(info.name, name, sizeof(info.name));
@@ -129,11 +176,26 @@ int32_t _moni_create_area(const char *name, void **address,
     if (areaId < 0)
     {
         LINUX_SYSCALL2(__NR_munmap, mappedAddr, size);
+        CloseAreaFile(fd);
         // This is actually an error code returned by the server.
         return areaId;
     }
 
-    if (protection & B_CLONEABLE_AREA)
+    if (fd >= 0)
+    {
+        // Already mapped from the file, the server only needs to know about it.
+        char hostPath[1];
+        result = GET_SERVERCALLS()->share_area(areaId, fd, 0, hostPath, sizeof(hostPath));
+        CloseAreaFile(fd);
+
+        if (result != B_OK)
+        {
+            GET_SERVERCALLS()->unregister_area(areaId);
+            LINUX_SYSCALL2(__NR_munmap, mappedAddr, size);
+            return result;
+        }
+    }
+    else if (protection & B_CLONEABLE_AREA)
     {
         char hostPath[PATH_MAX];
         result = ShareArea(mappedAddr, size, areaId,
@@ -171,34 +233,28 @@ area_id MONIKA_EXPORT _moni_clone_area(const char *name, void **address,
     int mmap_flags, mmap_prot, open_flags;
 
     char hostPath[PATH_MAX];
-    long status = GET_SERVERCALLS()->get_shared_area_path(sourceArea, hostPath, sizeof(hostPath));
+    long status = ProcessMmapArgs(baseAddr, addressSpec, size,
+        lock, protection, REGION_PRIVATE_MAP,
+        0, sourceArea,
+        hintAddr, mmap_flags, mmap_prot, open_flags);
+
     if (status != B_OK)
     {
         return status;
     }
 
-    status = ProcessMmapArgs(baseAddr, addressSpec, size,
-        lock, protection, REGION_PRIVATE_MAP,
-        0, sourceArea,
-        hintAddr, mmap_flags, mmap_prot, open_flags);
-
     mmap_flags |= MAP_SHARED;
     mmap_flags &= ~MAP_PRIVATE;
 
-    int fd = LINUX_SYSCALL4(__NR_openat, AT_FDCWD, hostPath, open_flags, 0);
+    // The server passes the area's memory over our connection.
+    int fd = GET_HOSTCALLS()->get_shared_area_fd(sourceArea, (open_flags & O_ACCMODE) == O_RDWR);
     if (fd < 0)
     {
-        return LinuxToB(-fd);
+        return fd;
     }
 
     LINUX_SYSCALL1(__NR_fsync, fd);
 
-    if (status != B_OK)
-    {
-        LINUX_SYSCALL1(__NR_close, fd);
-        return status;
-    }
-
     bool isExactAddress = addressSpec == B_EXACT_ADDRESS || addressSpec == B_CLONE_ADDRESS;
     if (isExactAddress && GET_HOSTCALLS()->is_in_reserved_range(hintAddr, size))
     {
@@ -297,7 +353,7 @@ int _moni_delete_area(int area)
     CHECK_COMMPAGE();
 
     struct haiku_area_info info;
-    long status = GET_SERVERCALLS()->get_area_info(area, &info);
+    long status = GET_HOSTCALLS()->get_area_info(area, &info);
 
     if (status != B_OK)
     {
@@ -334,7 +390,7 @@ area_id _moni_transfer_area(area_id area, void **_address,
     uint32 addressSpec, team_id target)
 {
     struct haiku_area_info info;
-    long status = GET_SERVERCALLS()->get_area_info(area, &info);
+    long status = GET_HOSTCALLS()->get_area_info(area, &info);
 
     if (status != B_OK)
     {
@@ -385,7 +441,7 @@ int MONIKA_EXPORT _moni_set_area_protection(int area, uint32_t newProtection)
     CHECK_COMMPAGE();
 
     struct haiku_area_info info;
-    long status = GET_SERVERCALLS()->get_area_info(area, &info);
+    long status = GET_HOSTCALLS()->get_area_info(area, &info);
 
     if (status != B_OK)
     {
@@ -856,7 +912,7 @@ int _moni_map_file(const char *name, void **address,
 int _moni_resize_area(int32_t area, size_t newSize)
 {
     struct haiku_area_info info;
-    long status = GET_SERVERCALLS()->get_area_info(area, &info);
+    long status = GET_HOSTCALLS()->get_area_info(area, &info);
 
     if (status != B_OK)
     {
@@ -943,12 +999,12 @@ int _moni_resize_area(int32_t area, size_t newSize)
 
 area_id _moni_area_for(void *address)
 {
-    return GET_SERVERCALLS()->area_for(address);
+    return GET_HOSTCALLS()->area_for(address);
 }
 
 status_t _moni_get_area_info(area_id area, void* info)
 {
-    return GET_SERVERCALLS()->get_area_info(area, info);
+    return GET_HOSTCALLS()->get_area_info(area, info);
 }
 
 status_t _moni_get_next_area_info(team_id team, ssize_t *cookie, void* info)
@@ -1010,7 +1066,9 @@ int ProcessMmapArgs(void* address, uint32 addressSpec, size_t& size,
     int fd, area_id sourceArea,
     void*& hintAddr, int& mmap_flags, int& mmap_prot, int& open_flags)
 {
-    if (lock == B_CONTIGUOUS || lock == B_LOMEM)
+    // Physically contiguous memory cannot be had from user space.
+    // B_CONTIGUOUS is handled as a fully locked area backed by huge pages where possible.
+    if (lock == B_LOMEM)
     {
         return HAIKU_POSIX_ENOSYS;
     }
@@ -1019,7 +1077,7 @@ int ProcessMmapArgs(void* address, uint32 addressSpec, size_t& size,
 
     if (sourceArea != -1)
     {
-        long status = GET_SERVERCALLS()->get_area_info(sourceArea, &sourceInfo);
+        long status = GET_HOSTCALLS()->get_area_info(sourceArea, &sourceInfo);
 
         if (status != B_OK)
         {
@@ -1190,6 +1248,7 @@ int LockArea(void* mappedAddr, size_t size, uint32 lock)
             status = LINUX_SYSCALL3(__NR_mlock2, mappedAddr, size, MLOCK_ONFAULT);
             break;
         case B_FULL_LOCK:
+        case B_CONTIGUOUS:
             status = LINUX_SYSCALL2(__NR_mlock, mappedAddr, size);
             break;
         default:
@@ -1198,3 +1257,92 @@ int LockArea(void* mappedAddr, size_t size, uint32 lock)
 
     return LinuxToB(-status);
 }
+
+int CreateAreaFile(const char* name, size_t size)
+{
+    long fd = LINUX_SYSCALL2(__NR_memfd_create, name, MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (LINUX_SYSCALL2(__NR_ftruncate, fd, size) < 0)
+    {
+        LINUX_SYSCALL1(__NR_close, fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void CloseAreaFile(int fd)
+{
+    if (fd >= 0)
+    {
+        LINUX_SYSCALL1(__NR_close, fd);
+    }
+}
+
+// Maps size bytes at a huge page boundary, no lower than lowestAddr.
+// Fails if the extra room for the alignment is only found elsewhere,
+// so that the caller can fall back to a plain mapping.
+long MapAligned(void* hintAddr, void* lowestAddr, size_t size, int mmap_prot, int mmap_flags, int fd)
+{
+    size_t reservedSize = size + kHugePageSize;
+    long reserved = LINUX_SYSCALL6(__NR_mmap, hintAddr, reservedSize, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved < 0)
+    {
+        return reserved;
+    }
+
+    uintptr_t reservedStart = (uintptr_t)reserved;
+    uintptr_t reservedEnd = reservedStart + reservedSize;
+    uintptr_t start = (reservedStart + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    uintptr_t end = (start + size + B_PAGE_SIZE - 1) & ~(uintptr_t)(B_PAGE_SIZE - 1);
+
+    if (start < (uintptr_t)lowestAddr)
+    {
+        LINUX_SYSCALL2(__NR_munmap, reservedStart, reservedSize);
+        return -ENOMEM;
+    }
+
+    long result = LINUX_SYSCALL6(__NR_mmap, start, size, mmap_prot, mmap_flags | MAP_FIXED, fd, 0);
+    if (result < 0)
+    {
+        LINUX_SYSCALL2(__NR_munmap, reservedStart, reservedSize);
+        return result;
+    }
+
+    if (start > reservedStart)
+    {
+        LINUX_SYSCALL2(__NR_munmap, reservedStart, start - reservedStart);
+    }
+    if (reservedEnd > end)
+    {
+        LINUX_SYSCALL2(__NR_munmap, end, reservedEnd - end);
+    }
+
+    return result;
+}
+
+// Sets up the memory policy before the pages of a new area are first touched.
+// Failures are ignored, these are only hints.
+void AdviseArea(void* mappedAddr, size_t size, bool isLarge, int memoryNode)
+{
+    if (isLarge)
+    {
+        LINUX_SYSCALL3(__NR_madvise, mappedAddr, size, MADV_HUGEPAGE);
+    }
+
+    if (memoryNode >= 0)
+    {
+        unsigned long nodeMask[16] = { };
+        const size_t bitsPerWord = sizeof(unsigned long) * 8;
+        if ((size_t)memoryNode < sizeof(nodeMask) * 8)
+        {
+            nodeMask[memoryNode / bitsPerWord] |= 1ul << (memoryNode % bitsPerWord);
+            LINUX_SYSCALL6(__NR_mbind, mappedAddr, size, MPOL_PREFERRED, nodeMask, sizeof(nodeMask) * 8 + 1, 0);
+        }
+    }
+}
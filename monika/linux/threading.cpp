@@ -39,12 +39,12 @@ status_t _moni_resume_thread(thread_id thread)
 
 status_t _moni_block_thread(uint32 flags, bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->block_thread(flags, timeout);
+    return GET_HOSTCALLS()->block_thread(flags, timeout);
 }
 
 status_t _moni_unblock_thread(thread_id thread, status_t status)
 {
-    return GET_SERVERCALLS()->unblock_thread(thread, status);
+    return GET_HOSTCALLS()->unblock_thread(thread, status);
 }
 
 status_t _moni_send_data(thread_id thread, int32 code, const void* buffer, size_t size)
@@ -130,23 +130,29 @@ sem_id _moni_create_sem(int count, const char *name)
 
 status_t _moni_acquire_sem(sem_id id)
 {
-    return GET_SERVERCALLS()->acquire_sem(id);
+    return GET_HOSTCALLS()->acquire_sem_etc(id, 1, 0, 0);
 }
 
 status_t _moni_acquire_sem_etc(sem_id id, uint32 count, uint32 flags,
     bigtime_t timeout)
 {
-    return GET_SERVERCALLS()->acquire_sem_etc(id, count, flags, timeout);
+    return GET_HOSTCALLS()->acquire_sem_etc(id, count, flags, timeout);
 }
 
 status_t _moni_release_sem(sem_id id)
 {
-    return GET_SERVERCALLS()->release_sem(id);
+    return GET_HOSTCALLS()->release_sem_etc(id, 1, 0);
 }
 
 status_t _moni_release_sem_etc(sem_id id, uint32 count, uint32 flags)
 {
-    return GET_SERVERCALLS()->release_sem_etc(id, count, flags);
+    return GET_HOSTCALLS()->release_sem_etc(id, count, flags);
+}
+
+status_t _moni_switch_sem_etc(sem_id releaseSem, sem_id id, uint32 count,
+    uint32 flags, bigtime_t timeout)
+{
+    return GET_SERVERCALLS()->switch_sem_etc(releaseSem, id, count, flags, timeout);
 }
 
 status_t _moni_delete_sem(sem_id id)
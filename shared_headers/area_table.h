@@ -0,0 +1,129 @@
+#ifndef __HYCLONE_AREA_TABLE_H__
+#define __HYCLONE_AREA_TABLE_H__
+
+#include <cstdint>
+
+#include "haiku_area.h"
+
+// Information about the areas of one team, written by the server and read by
+// the team without a servercall. The table lives in the shared memory directory.
+//
+// The server makes sequence odd while it changes entries, and even again
+// afterwards. Readers retry while it is odd or has changed under them.
+// byId and byAddress hold the indices of the count used entries, sorted by area
+// ID and by start address, so lookups are binary searches. Areas that do not fit
+// are only known to the server, so finding nothing in the table is not an answer.
+
+#define AREA_TABLE_FILE_PREFIX "area_table_"
+#define AREA_TABLE_CAPACITY 4096
+
+struct area_table
+{
+    uint32_t sequence;
+    uint32_t count;
+    uint16_t byId[AREA_TABLE_CAPACITY];
+    uint16_t byAddress[AREA_TABLE_CAPACITY];
+    haiku_area_info entries[AREA_TABLE_CAPACITY];
+};
+
+inline void area_table_begin_write(area_table* table)
+{
+    __atomic_store_n(&table->sequence, table->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+inline void area_table_end_write(area_table* table)
+{
+    __atomic_store_n(&table->sequence, table->sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Copies out the entry lookup returns, once it has run on a consistent table.
+// lookup gets the number of used entries and returns an entry index,
+// or AREA_TABLE_CAPACITY if there is none.
+template <typename Lookup>
+inline bool area_table_read(const area_table* table, haiku_area_info& info, Lookup&& lookup)
+{
+    while (true)
+    {
+        uint32_t sequence = __atomic_load_n(&table->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        uint32_t count = __atomic_load_n(&table->count, __ATOMIC_RELAXED);
+        if (count > AREA_TABLE_CAPACITY)
+        {
+            count = AREA_TABLE_CAPACITY;
+        }
+
+        uint32_t index = lookup(count);
+        bool found = index < AREA_TABLE_CAPACITY;
+        if (found)
+        {
+            info = table->entries[index];
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&table->sequence, __ATOMIC_RELAXED) == sequence)
+        {
+            return found;
+        }
+    }
+}
+
+inline bool area_table_find_address(const area_table* table, const void* address, haiku_area_info& info)
+{
+    return area_table_read(table, info, [table, address](uint32_t count) -> uint32_t
+    {
+        // Find the last area starting at or below address.
+        uint32_t low = 0;
+        uint32_t high = count;
+        while (low < high)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            uint32_t index = table->byAddress[middle] % AREA_TABLE_CAPACITY;
+            if ((const uint8_t*)table->entries[index].address <= (const uint8_t*)address)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        if (low == 0)
+        {
+            return AREA_TABLE_CAPACITY;
+        }
+
+        uint32_t index = table->byAddress[low - 1] % AREA_TABLE_CAPACITY;
+        const haiku_area_info& entry = table->entries[index];
+        if ((const uint8_t*)address < (const uint8_t*)entry.address + entry.size)
+        {
+            return index;
+        }
+        return AREA_TABLE_CAPACITY;
+    });
+}
+
+inline bool area_table_find_id(const area_table* table, area_id id, haiku_area_info& info)
+{
+    return area_table_read(table, info, [table, id](uint32_t count) -> uint32_t
+    {
+        uint32_t low = 0;
+        uint32_t high = count;
+        while (low < high)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            uint32_t index = table->byId[middle] % AREA_TABLE_CAPACITY;
+            area_id middleId = table->entries[index].area;
+            if (middleId == id)
+                return index;
+            if (middleId < id)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return AREA_TABLE_CAPACITY;
+    });
+}
+
+#endif // __HYCLONE_AREA_TABLE_H__
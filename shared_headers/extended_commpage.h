@@ -6,6 +6,7 @@
 #include "BeDefs.h"
 #include "commpage_defs.h"
 #include "haiku_errors.h"
+#include "haiku_port.h"
 #include "haiku_semaphore.h"
 #include "haiku_sysinfo.h"
 #include "servercalls.h"
@@ -31,6 +32,7 @@ struct hostcalls
     int64_t (*get_max_sems)();
     int64_t (*get_max_procs)();
     int (*get_process_usage)(int pid, int who, team_usage_info* info);
+    int (*get_memory_node)();
 
     // Memory reservation
     void (*lock_reserved_range_data)();
@@ -56,6 +58,11 @@ struct hostcalls
     void* (*idmap_get)(void* idmap, int id);
     void (*idmap_remove)(void* idmap, int id);
 
+    // Areas
+    int (*area_for)(void* address);
+    int (*get_area_info)(int area, void* info);
+    int (*get_shared_area_fd)(int area, bool writable);
+
     // Fork
     int (*fork)();
     int (*exec)(const char* path, const char* const* flatArgs, size_t flatArgsSize, int argc, int envc, int umask);
@@ -65,13 +72,25 @@ struct hostcalls
     int (*spawn_thread)(void* thread_creation_attributes);
     void (*exit_thread)(int status);
     int (*wait_for_thread)(int thread, uint32_t flags, int64_t timeout, int* status);
+    int (*block_thread)(uint32_t flags, int64_t timeout);
+    int (*unblock_thread)(int thread, int status);
 
     // Mutex
     int (*mutex_lock)(int32_t* mutex, const char* name, uint32_t flags, int64_t timeout);
     int (*mutex_unblock)(int32_t* mutex, uint32_t flags);
     int (*mutex_switch_lock)(int32_t* fromMutex, int32_t* toMutex, const char* name, uint32_t flags, int64_t timeout);
 
+    // Ports
+    int (*write_port_etc)(int port, int32_t messageCode, const void* buffer, size_t bufferSize, uint32_t flags, int64_t timeout);
+    intptr_t (*read_port_etc)(int port, int32_t* messageCode, void* buffer, size_t bufferSize, uint32_t flags, int64_t timeout);
+    int (*get_port_message_info_etc)(int port, haiku_port_message_info* info, size_t infoSize, uint32_t flags, int64_t timeout);
+    intptr_t (*read_port_multiple_etc)(int port, void* buffer, size_t bufferSize, int maxCount, uint32_t flags, int64_t timeout);
+    intptr_t (*read_port_sized_etc)(int port, void* buffer, size_t bufferSize, uint32_t flags, int64_t timeout);
+    int (*delete_port)(int port);
+
     // Semaphore
+    int (*acquire_sem_etc)(int id, uint32_t count, uint32_t flags, int64_t timeout);
+    int (*release_sem_etc)(int id, uint32_t count, uint32_t flags);
     int (*realtime_sem_open)(const char *name, int openFlagsOrShared, haiku_mode_t mode, uint32_t semCount, haiku_sem_t* sem, haiku_sem_t** usedSem);
 
     // Signals
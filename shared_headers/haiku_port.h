@@ -20,4 +20,14 @@ typedef struct haiku_port_message_info {
     team_id     sender_team;
 } haiku_port_message_info;
 
+/* Precedes each message stored by read_port_multiple_etc and read_port_sized_etc.
+   The next header starts at the following multiple of HAIKU_PORT_MESSAGE_ALIGN. */
+typedef struct haiku_port_message_header {
+    int32       code;
+    team_id     sender_team;
+    size_t      size;
+} haiku_port_message_header;
+
+#define HAIKU_PORT_MESSAGE_ALIGN 8
+
 #endif
\ No newline at end of file
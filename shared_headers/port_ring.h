@@ -0,0 +1,312 @@
+#ifndef __HYCLONE_PORT_RING_H__
+#define __HYCLONE_PORT_RING_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <pthread.h>
+
+#include "haiku_port.h"
+
+// A port's message queue, kept in a shared file mapped by the server and by
+// every team that uses the port. Teams copy messages in and out of the ring
+// themselves and wake each other up through the sequence futexes. The server
+// creates and deletes the ring and keeps the messages that do not fit.
+//
+// Each queued message has a slot. Its contents live in a separate byte ring.
+// When a message does not fit into the free data space, the server keeps it
+// and marks the slot with PORT_RING_SLOT_EXTERNAL. Readers hand such slots
+// over to the server, so messages still come out in order.
+//
+// Everything except the sequence words is protected by lock. Changes are only
+// committed once a message has been fully copied, so a team that dies while
+// holding the lock leaves a consistent ring behind. The next owner still checks
+// it, and drops the queue if it is broken.
+
+// Rings live in the shared memory directory, named after this prefix and the
+// ring ID returned by the get_port_ring servercall.
+#define PORT_RING_FILE_PREFIX "port_ring_"
+
+#define PORT_RING_DATA_SIZE (64 * 1024)
+#define PORT_RING_ALIGN 8
+
+enum port_ring_flags : uint32_t
+{
+    PORT_RING_CLOSED = 1,
+    PORT_RING_DELETED = 2,
+};
+
+#define PORT_RING_SLOT_EXTERNAL 1
+
+struct port_ring_slot
+{
+    int32_t code;
+    uint32_t flags;
+    uint32_t offset;
+    // Bytes taken from the data ring, including padding at its end.
+    uint32_t reserved;
+    haiku_port_message_info info;
+};
+
+struct port_ring
+{
+    pthread_mutex_t lock;
+    // Bumped when a message is added and when one is removed.
+    uint32_t readSequence;
+    uint32_t writeSequence;
+    uint32_t readWaiters;
+    uint32_t writeWaiters;
+    uint32_t flags;
+    int32_t port;
+    int32_t capacity;
+    int32_t count;
+    int32_t totalCount;
+    uint32_t head;
+    uint32_t dataHead;
+    uint32_t dataTail;
+    uint32_t dataUsed;
+    // Bumped whenever a broken queue is dropped.
+    uint32_t generation;
+};
+
+inline size_t port_ring_data_offset(int32_t capacity)
+{
+    size_t size = sizeof(port_ring) + sizeof(port_ring_slot) * capacity;
+    return (size + 63) & ~(size_t)63;
+}
+
+inline size_t port_ring_size(int32_t capacity)
+{
+    return port_ring_data_offset(capacity) + PORT_RING_DATA_SIZE;
+}
+
+// Sets up a zero-filled ring.
+inline void port_ring_init(port_ring* ring, int32_t capacity)
+{
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&ring->lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    ring->capacity = capacity;
+}
+
+// capacity must come from the caller's own records, not from the shared header.
+inline port_ring_slot* port_ring_slot_at(port_ring* ring, int32_t capacity, uint32_t index)
+{
+    return (port_ring_slot*)(ring + 1) + (index % capacity);
+}
+
+inline char* port_ring_data(port_ring* ring, int32_t capacity)
+{
+    return (char*)ring + port_ring_data_offset(capacity);
+}
+
+inline uint32_t port_ring_align(uint32_t size)
+{
+    return (size + PORT_RING_ALIGN - 1) & ~(uint32_t)(PORT_RING_ALIGN - 1);
+}
+
+// Where a message stored by read_port_multiple_etc at offset ends, without the padding.
+inline size_t port_ring_record_end(size_t offset, size_t size)
+{
+    return offset + sizeof(haiku_port_message_header) + size;
+}
+
+// Where the message following a message stored at offset starts.
+inline size_t port_ring_next_record(size_t offset, size_t size)
+{
+    size_t end = port_ring_record_end(offset, size);
+    return (end + HAIKU_PORT_MESSAGE_ALIGN - 1) & ~(size_t)(HAIKU_PORT_MESSAGE_ALIGN - 1);
+}
+
+inline bool port_ring_is_valid(const port_ring* ring, int32_t capacity)
+{
+    return ring->count >= 0 && ring->count <= capacity
+        && ring->head < (uint32_t)capacity
+        && ring->dataUsed <= PORT_RING_DATA_SIZE
+        && ring->dataHead < PORT_RING_DATA_SIZE
+        && ring->dataTail < PORT_RING_DATA_SIZE;
+}
+
+inline bool port_ring_slot_is_valid(const port_ring_slot* slot)
+{
+    return (slot->flags & PORT_RING_SLOT_EXTERNAL)
+        || (slot->offset < PORT_RING_DATA_SIZE
+            && slot->info.size <= PORT_RING_DATA_SIZE - slot->offset
+            && slot->reserved <= PORT_RING_DATA_SIZE);
+}
+
+// Finds room for size bytes in the data ring, without taking it yet.
+inline bool port_ring_find_space(const port_ring* ring, size_t size, uint32_t& offset, uint32_t& reserved)
+{
+    if (size > PORT_RING_DATA_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t aligned = port_ring_align(size);
+
+    if (ring->dataUsed == 0)
+    {
+        offset = 0;
+        reserved = aligned;
+        return aligned <= PORT_RING_DATA_SIZE;
+    }
+
+    if (ring->dataTail > ring->dataHead)
+    {
+        uint32_t endFree = PORT_RING_DATA_SIZE - ring->dataTail;
+        if (aligned <= endFree)
+        {
+            offset = ring->dataTail;
+            reserved = aligned;
+            return true;
+        }
+        if (aligned <= ring->dataHead)
+        {
+            // Skip the end of the ring, the padding goes with this message.
+            offset = 0;
+            reserved = aligned + endFree;
+            return true;
+        }
+        return false;
+    }
+
+    if (aligned <= ring->dataHead - ring->dataTail)
+    {
+        offset = ring->dataTail;
+        reserved = aligned;
+        return true;
+    }
+
+    return false;
+}
+
+// Appends a slot for a message whose contents, if any, are already in place.
+inline void port_ring_commit_push(port_ring* ring, int32_t capacity, const port_ring_slot& slot)
+{
+    if (!(slot.flags & PORT_RING_SLOT_EXTERNAL))
+    {
+        if (ring->dataUsed == 0)
+        {
+            ring->dataHead = 0;
+        }
+        ring->dataTail = (slot.offset + port_ring_align(slot.info.size)) % PORT_RING_DATA_SIZE;
+        ring->dataUsed += slot.reserved;
+    }
+
+    *port_ring_slot_at(ring, capacity, ring->head + ring->count) = slot;
+    ++ring->count;
+    __atomic_add_fetch(&ring->readSequence, 1, __ATOMIC_RELEASE);
+}
+
+// Removes the first slot once its contents have been copied out.
+inline void port_ring_commit_pop(port_ring* ring, int32_t capacity)
+{
+    const port_ring_slot* slot = port_ring_slot_at(ring, capacity, ring->head);
+
+    if (!(slot->flags & PORT_RING_SLOT_EXTERNAL))
+    {
+        ring->dataHead = (slot->offset + port_ring_align(slot->info.size)) % PORT_RING_DATA_SIZE;
+        ring->dataUsed -= std::min(slot->reserved, ring->dataUsed);
+        if (ring->dataUsed == 0)
+        {
+            ring->dataHead = ring->dataTail = 0;
+        }
+    }
+
+    ring->head = (ring->head + 1) % capacity;
+    --ring->count;
+    ++ring->totalCount;
+    __atomic_add_fetch(&ring->writeSequence, 1, __ATOMIC_RELEASE);
+}
+
+// Checks a ring whose lock was held by a team that died, dropping the queue if it is broken.
+// Must be called with the lock held.
+inline void port_ring_recover(port_ring* ring, int32_t capacity)
+{
+    bool valid = port_ring_is_valid(ring, capacity);
+    for (int32_t i = 0; valid && i < ring->count; ++i)
+    {
+        valid = port_ring_slot_is_valid(port_ring_slot_at(ring, capacity, ring->head + i));
+    }
+
+    if (valid)
+    {
+        return;
+    }
+
+    ring->count = 0;
+    ring->head = 0;
+    ring->dataHead = 0;
+    ring->dataTail = 0;
+    ring->dataUsed = 0;
+    ++ring->generation;
+    __atomic_add_fetch(&ring->readSequence, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&ring->writeSequence, 1, __ATOMIC_RELEASE);
+}
+
+// Satisfies TimedLockable, for use with std::unique_lock.
+class PortRingLock
+{
+private:
+    port_ring* _ring;
+    int32_t _capacity;
+
+    bool _Acquired(int error)
+    {
+        if (error == EOWNERDEAD)
+        {
+            port_ring_recover(_ring, _capacity);
+            pthread_mutex_consistent(&_ring->lock);
+            return true;
+        }
+        return error == 0;
+    }
+public:
+    // capacity must come from the caller's own records, not from the shared header.
+    PortRingLock(port_ring* ring, int32_t capacity) : _ring(ring), _capacity(capacity) { }
+
+    void lock()
+    {
+        _Acquired(pthread_mutex_lock(&_ring->lock));
+    }
+
+    bool try_lock()
+    {
+        return _Acquired(pthread_mutex_trylock(&_ring->lock));
+    }
+
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& duration)
+    {
+        auto deadline = std::chrono::system_clock::now() + duration;
+        int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            deadline.time_since_epoch()).count();
+
+        struct timespec timeout;
+        timeout.tv_sec = nanoseconds / 1000000000;
+        timeout.tv_nsec = nanoseconds % 1000000000;
+
+        return _Acquired(pthread_mutex_timedlock(&_ring->lock, &timeout));
+    }
+
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& time)
+    {
+        return try_lock_for(time - Clock::now());
+    }
+
+    void unlock()
+    {
+        pthread_mutex_unlock(&_ring->lock);
+    }
+};
+
+#endif // __HYCLONE_PORT_RING_H__
@@ -0,0 +1,79 @@
+#ifndef __HYCLONE_SEM_TABLE_H__
+#define __HYCLONE_SEM_TABLE_H__
+
+#include <cstdint>
+
+// Semaphore states, shared between the server and every team and indexed by
+// semaphore ID. The table lives in the shared memory directory.
+//
+// Each state packs the available count, the number of threads waiting in the
+// server and a valid bit into one word. Teams may take or return counts with a
+// single compare-and-swap while nobody is waiting. Once a thread waits, only
+// the server changes the state, so that it can wake its waiters.
+
+#define HYCLONE_SEM_TABLE_NAME "sem_table"
+#define HYCLONE_SEM_TABLE_SIZE 65536
+
+#define SEM_STATE_VALID (1ULL << 63)
+#define SEM_STATE_WAITERS_SHIFT 32
+#define SEM_STATE_WAITERS_MASK 0x7fffffffULL
+
+inline int32_t sem_state_count(uint64_t state)
+{
+    return (int32_t)(uint32_t)state;
+}
+
+inline uint32_t sem_state_waiters(uint64_t state)
+{
+    return (state >> SEM_STATE_WAITERS_SHIFT) & SEM_STATE_WAITERS_MASK;
+}
+
+inline uint64_t sem_state_make(int32_t count, uint32_t waiters)
+{
+    return SEM_STATE_VALID | ((uint64_t)(waiters & SEM_STATE_WAITERS_MASK) << SEM_STATE_WAITERS_SHIFT)
+        | (uint32_t)count;
+}
+
+// Returns false if the server has to handle the acquisition.
+inline bool sem_state_try_acquire(uint64_t* state, int32_t count)
+{
+    uint64_t oldState = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+    uint64_t newState;
+
+    do
+    {
+        if (!(oldState & SEM_STATE_VALID) || sem_state_waiters(oldState) != 0
+            || sem_state_count(oldState) < count)
+        {
+            return false;
+        }
+        newState = sem_state_make(sem_state_count(oldState) - count, 0);
+    }
+    while (!__atomic_compare_exchange_n(state, &oldState, newState, true,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return true;
+}
+
+// Returns false if the server has to handle the release.
+inline bool sem_state_try_release(uint64_t* state, int32_t count)
+{
+    uint64_t oldState = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+    uint64_t newState;
+
+    do
+    {
+        if (!(oldState & SEM_STATE_VALID) || sem_state_waiters(oldState) != 0
+            || sem_state_count(oldState) > INT32_MAX - count)
+        {
+            return false;
+        }
+        newState = sem_state_make(sem_state_count(oldState) + count, 0);
+    }
+    while (!__atomic_compare_exchange_n(state, &oldState, newState, true,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return true;
+}
+
+#endif // __HYCLONE_SEM_TABLE_H__
@@ -0,0 +1,41 @@
+#ifndef __HYCLONE_SERVERCALL_CHANNEL_H__
+#define __HYCLONE_SERVERCALL_CHANNEL_H__
+
+#include <cstdint>
+
+#include "servercalls.h"
+
+// A shared memory servercall slot. Each client thread owns one, attached to its
+// socket connection with the attach_channel servercall. The state word doubles as
+// the futex both sides sleep on.
+//
+// The client fills in args and the payload, moves the state from IDLE to SUBMITTED
+// and wakes the server. The server stores the result and the reply payload, moves
+// the state to COMPLETED and wakes the client, which sets it back to IDLE. When the
+// connection goes away, the server moves the state to CLOSED. The client then treats
+// the connection as lost: it disconnects and the call fails with ENOSYS.
+//
+// When a signal handler runs while the client waits for a call, the client sets
+// interrupted and sends an interrupt servercall through the idle socket, so that
+// waits that may be interrupted end with B_INTERRUPTED. The client clears
+// interrupted before submitting the next call.
+enum servercall_channel_state : uint32_t
+{
+    SERVERCALL_CHANNEL_IDLE = 0,
+    SERVERCALL_CHANNEL_SUBMITTED = 1,
+    SERVERCALL_CHANNEL_COMPLETED = 2,
+    SERVERCALL_CHANNEL_CLOSED = 3,
+};
+
+struct servercall_channel
+{
+    uint32_t state;
+    // The size of the request payload, replaced by the size of the reply payload.
+    uint32_t payloadSize;
+    uint32_t interrupted;
+    intptr_t args[HYCLONE_SERVERCALL_MAX_ARGS + 1];
+    intptr_t result;
+    char payload[HYCLONE_SERVERCALL_MAX_PAYLOAD];
+};
+
+#endif // __HYCLONE_SERVERCALL_CHANNEL_H__
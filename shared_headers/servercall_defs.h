@@ -1,5 +1,9 @@
 HYCLONE_SERVERCALL6(connect, int, int, intptr_t, intptr_t, intptr_t, intptr_t)
 HYCLONE_SERVERCALL0(disconnect)
+HYCLONE_SERVERCALL1(attach_channel, int)
+HYCLONE_SERVERCALL3(batch, const void*, size_t, intptr_t*)
+HYCLONE_SERVERCALL3(get_servercall_stats, int, void*, size_t)
+HYCLONE_SERVERCALL0(reset_servercall_stats)
 HYCLONE_SERVERCALL2(request_ack, int, int)
 HYCLONE_SERVERCALL1(request_read, void*)
 HYCLONE_SERVERCALL1(request_reply, intptr_t)
@@ -14,7 +18,7 @@ HYCLONE_SERVERCALL1(image_relocated, int)
 HYCLONE_SERVERCALL1(shutdown, bool)
 HYCLONE_SERVERCALL2(register_area, void*, unsigned int)
 HYCLONE_SERVERCALL5(share_area, int, intptr_t, size_t, char*, size_t)
-HYCLONE_SERVERCALL3(get_shared_area_path, int, char*, size_t)
+HYCLONE_SERVERCALL2(send_shared_area_fd, int, bool)
 HYCLONE_SERVERCALL5(transfer_area, int, void**, unsigned int, int, int)
 HYCLONE_SERVERCALL2(get_area_info, int, void*)
 HYCLONE_SERVERCALL4(get_next_area_info, int, void*, void*, void*)
@@ -22,6 +26,7 @@ HYCLONE_SERVERCALL1(unregister_area, int)
 HYCLONE_SERVERCALL2(set_area_protection, int, unsigned int)
 HYCLONE_SERVERCALL2(resize_area, int, size_t)
 HYCLONE_SERVERCALL1(area_for, void*)
+HYCLONE_SERVERCALL0(get_area_table)
 HYCLONE_SERVERCALL2(unmap_memory, void*, size_t)
 HYCLONE_SERVERCALL3(set_memory_protection, void*, size_t, unsigned int)
 HYCLONE_SERVERCALL3(set_memory_lock, void*, size_t, int)
@@ -42,13 +47,17 @@ HYCLONE_SERVERCALL1(port_count, int)
 HYCLONE_SERVERCALL2(set_port_owner, int, int)
 HYCLONE_SERVERCALL6(read_port_etc, int, int*, void*, size_t, unsigned int, unsigned long long)
 HYCLONE_SERVERCALL6(write_port_etc, int, int, const void*, size_t, unsigned int, unsigned long long)
+HYCLONE_SERVERCALL6(read_port_multiple_etc, int, void*, size_t, int, unsigned int, unsigned long long)
+HYCLONE_SERVERCALL5(read_port_sized_etc, int, void*, size_t, unsigned int, unsigned long long)
 HYCLONE_SERVERCALL5(get_port_message_info_etc, int, void*, size_t, unsigned int, unsigned long long)
+HYCLONE_SERVERCALL1(get_port_ring, int)
 HYCLONE_SERVERCALL3(create_sem, int, const char*, size_t)
 HYCLONE_SERVERCALL1(acquire_sem, int)
 HYCLONE_SERVERCALL4(acquire_sem_etc, int, unsigned int, unsigned int, unsigned long long)
 HYCLONE_SERVERCALL1(release_sem, int)
 HYCLONE_SERVERCALL3(release_sem_etc, int, unsigned int, unsigned int)
 HYCLONE_SERVERCALL1(delete_sem, int)
+HYCLONE_SERVERCALL5(switch_sem_etc, int, int, unsigned int, unsigned int, unsigned long long)
 HYCLONE_SERVERCALL2(get_sem_count, int, int*)
 HYCLONE_SERVERCALL0(get_system_sem_count)
 HYCLONE_SERVERCALL2(read_fs_info, int, void*)
@@ -115,4 +124,14 @@ HYCLONE_SERVERCALL2(getgroups, size_t, int*)
 HYCLONE_SERVERCALL3(setgroups, size_t, const int*, intptr_t*)
 HYCLONE_SERVERCALL1(install_default_debugger, int)
 HYCLONE_SERVERCALL2(install_team_debugger, int, int)
-HYCLONE_SERVERCALL3(register_nub, int, int, int)
\ No newline at end of file
+HYCLONE_SERVERCALL3(register_nub, int, int, int)
+HYCLONE_SERVERCALL0(interrupt)
+
+#ifdef HYCLONE_SERVERCALL_ONEWAY
+// Notifications whose callers do not depend on the result.
+HYCLONE_SERVERCALL_ONEWAY(debug_output)
+HYCLONE_SERVERCALL_ONEWAY(image_relocated)
+HYCLONE_SERVERCALL_ONEWAY(interrupt)
+HYCLONE_SERVERCALL_ONEWAY(unregister_fd)
+HYCLONE_SERVERCALL_ONEWAY(unregister_image)
+#endif
@@ -0,0 +1,39 @@
+#ifndef __HYCLONE_SERVERCALL_STATS_H__
+#define __HYCLONE_SERVERCALL_STATS_H__
+
+#include <cstdint>
+
+// Bucket i of a histogram counts durations shorter than 2^i microseconds
+// that did not fit in the previous buckets. The last bucket counts the rest.
+#define SERVERCALL_STATS_HISTOGRAM_BUCKETS (16)
+
+// Returned first by get_servercall_stats.
+struct servercall_stats_info
+{
+    // Number of servercall ids known to the server.
+    uint32_t callCount;
+    // Number of entries following this header.
+    uint32_t entryCount;
+    uint32_t connectionCount;
+    // Workers currently running a task, including parked ones.
+    uint32_t busyWorkers;
+    uint32_t workerSlots;
+    uint32_t reserved;
+    // Nanoseconds since the stats were last reset.
+    uint64_t elapsedTime;
+};
+
+struct servercall_stats_entry
+{
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t count;
+    // Total nanoseconds spent waiting for a worker, and running.
+    // Only calls received through the socket wait for a worker.
+    uint64_t queueTime;
+    uint64_t execTime;
+    uint32_t queueHistogram[SERVERCALL_STATS_HISTOGRAM_BUCKETS];
+    uint32_t execHistogram[SERVERCALL_STATS_HISTOGRAM_BUCKETS];
+};
+
+#endif // __HYCLONE_SERVERCALL_STATS_H__
@@ -50,6 +50,7 @@ struct servercalls
 enum servercall_id
 {
 #include "servercall_defs.h"
+    SERVERCALL_ID_COUNT
 };
 
 #undef HYCLONE_SERVERCALL0
@@ -60,8 +61,73 @@ enum servercall_id
 #undef HYCLONE_SERVERCALL5
 #undef HYCLONE_SERVERCALL6
 
+#define HYCLONE_SERVERCALL0(name)
+#define HYCLONE_SERVERCALL1(name, arg1)
+#define HYCLONE_SERVERCALL2(name, arg1, arg2)
+#define HYCLONE_SERVERCALL3(name, arg1, arg2, arg3)
+#define HYCLONE_SERVERCALL4(name, arg1, arg2, arg3, arg4)
+#define HYCLONE_SERVERCALL5(name, arg1, arg2, arg3, arg4, arg5)
+#define HYCLONE_SERVERCALL6(name, arg1, arg2, arg3, arg4, arg5, arg6)
+#define HYCLONE_SERVERCALL_ONEWAY(name) \
+    case SERVERCALL_ID_##name:
+
+// Whether a call may be sent without waiting for its result.
+// The server still runs it before any call sent after it on the same connection.
+inline bool servercall_is_oneway(intptr_t id)
+{
+    switch (id)
+    {
+#include "servercall_defs.h"
+            return true;
+        default:
+            return false;
+    }
+}
+
+#undef HYCLONE_SERVERCALL0
+#undef HYCLONE_SERVERCALL1
+#undef HYCLONE_SERVERCALL2
+#undef HYCLONE_SERVERCALL3
+#undef HYCLONE_SERVERCALL4
+#undef HYCLONE_SERVERCALL5
+#undef HYCLONE_SERVERCALL6
+#undef HYCLONE_SERVERCALL_ONEWAY
+
 #define HYCLONE_SOCKET_NAME ".hyclone.sock"
 #define HYCLONE_SHM_NAME ".hyclone.shm"
 #define HYCLONE_SERVERCALL_MAX_ARGS (6)
 
+// A servercall frame consists of the call id, the arguments and a word holding
+// the size of the inline payload that follows along with the frame flags.
+// The reply consists of the result and the size of the reply payload that follows.
+#define HYCLONE_SERVERCALL_FRAME_LENGTH (HYCLONE_SERVERCALL_MAX_ARGS + 2)
+#define HYCLONE_SERVERCALL_REPLY_LENGTH (2)
+#define HYCLONE_SERVERCALL_MAX_PAYLOAD (3072)
+// Flags stay below bit 31, so that the word fits a 32-bit intptr_t.
+#define HYCLONE_SERVERCALL_PAYLOAD_SIZE_MASK ((intptr_t)0xFFFF)
+// The client does not wait for a reply, and none is sent.
+#define HYCLONE_SERVERCALL_FLAG_ONEWAY ((intptr_t)1 << 16)
+
+// The request payload is a list of the caller's memory regions that the server
+// may access during the call. Each record of an input region is followed by a copy
+// of its contents, padded to 8 bytes. Memory reads from input regions are served
+// from the payload, and writes to output regions are sent back in the reply payload
+// as records followed by the written bytes, for the client to copy out.
+#define SERVERCALL_INLINE_IN    (1 << 0)
+#define SERVERCALL_INLINE_OUT   (1 << 1)
+
+struct servercall_inline_record
+{
+    uint64_t address;
+    uint32_t size;
+    uint32_t flags;
+};
+
+#define SERVERCALL_INLINE_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+// The batch servercall takes an array of calls, each made of the call id followed
+// by its arguments, and fills in one result for each of them.
+#define HYCLONE_SERVERCALL_BATCH_CALL_LENGTH (HYCLONE_SERVERCALL_MAX_ARGS + 1)
+#define HYCLONE_SERVERCALL_MAX_BATCH_SIZE (1024)
+
 #endif // __HYCLONE_SERVERCALLS_H__
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef __HYCLONE_THREAD_WAIT_TABLE_H__
+#define __HYCLONE_THREAD_WAIT_TABLE_H__
+
+#include <cstdint>
+
+// Wake-up slots for blocked threads, shared between the server and every team.
+// Each thread gets a slot from the register_user_thread servercall.
+//
+// A thread blocked in block_thread sleeps on its slot's sequence while the
+// wait_status in its user_thread stays positive. Threads in the same team
+// unblock it by CASing that wait_status, then bump the sequence and wake it.
+//
+// The server cannot CAS another team's memory, so it stores the new status in
+// the slot instead, and only while the slot holds no status yet. The blocked
+// thread moves it into its wait_status. Once a wait is over the thread clears
+// the slot and bumps the sequence, which makes a racing store from the server fail.
+// Slots are always updated as a whole with a single CAS.
+
+#define HYCLONE_THREAD_WAIT_TABLE_NAME "thread_wait_table"
+#define HYCLONE_THREAD_WAIT_TABLE_SIZE 65536
+
+// Stored in thread_wait_slot::status when the server has not unblocked the thread.
+#define HYCLONE_THREAD_WAIT_NO_STATUS 1
+
+struct alignas(8) thread_wait_slot
+{
+    // Futex word for the blocked thread.
+    uint32_t sequence;
+    // Wait status from the server, or HYCLONE_THREAD_WAIT_NO_STATUS.
+    int32_t status;
+};
+
+#endif // __HYCLONE_THREAD_WAIT_TABLE_H__
@@ -9,6 +9,8 @@
 #define B_USER_MUTEX_UNBLOCK_ALL    0x80000000
 // All threads currently waiting on the mutex will be unblocked. The mutex
 // state will be locked.
+#define B_USER_MUTEX_SHARED         0x40000000
+// The mutex lives in an area shared between teams.
 
 // mutex value flags
 #define B_USER_MUTEX_LOCKED         0x01